@@ -6,10 +6,20 @@
 #ifndef X86COMPILERBACKEND_ABSTRACTSYNTAXTREE_HPP
 #define X86COMPILERBACKEND_ABSTRACTSYNTAXTREE_HPP
 
+#include <climits>
+
 #include "utilities.hpp"
 #include "HashTable.hpp"
 #include "Vector.hpp"
 #include "AssemblyTools.hpp"
+#include "CompilerOptions.hpp"
+#include "IR.hpp"
+#include "Lowering.hpp"
+#include "IROptimizer.hpp"
+#include "Inliner.hpp"
+#include "Evaluator.hpp"
+#include "Specializer.hpp"
+#include "Memoizer.hpp"
 
 const int DEFAULT_BUCKET_SIZE = 32;
 
@@ -44,6 +54,13 @@ enum NODE_TYPE {
     EQUAL
 };
 
+struct SimplificationStats {
+    int folded;                                                                 // Constant subtrees replaced by literals
+    int identities;                                                             // Algebraic identities applied
+    int reassociated;                                                           // Constant chains merged into one constant
+    int nodesRemoved;                                                           // Total number of nodes removed from the tree
+};
+
 class AbstractSyntaxNode {
 private:
     NODE_TYPE type;                                                             // Get current node type
@@ -55,14 +72,40 @@ private:
     NODE_TYPE getType(const char *serialized);
 
     const char *serializeType();
-    void parseLocalVariables(int &alloc,
-                             int *offsets);                                         // Count local variables and determine their offsets
+    void parseLocalVariables(int &alloc, int *offsets,
+                             bool *reads);                                          // Give stack slots to local variables that are read
+    void markReads(bool *reads);                                                    // Mark variables whose values are used
     void
-    parseArguments(int *offsets, int depth);                                        // Determine offsets for function arguments
-
-    void compileOperation(AssemblyListing &func, int *numbers, int *offsets);       // Compile Operation node
-    void compileExpression(AssemblyListing &func, int *numbers, int *offsets);      // Compile expression subtree
-    int pushVarlist(AssemblyListing &func, int *numbers, int *offsets);             // Push function arguments into stack
+    parseArguments(int *offsets, int &alloc, int number);                           // Determine offsets for function arguments
+    int getCleanupSize();                                                           // Argument bytes callee pops in enclosing function
+
+    bool compileOperation(AssemblyListing &func, const CompilerOptions &options, int *numbers,
+                          int *offsets);                                            // Compile statements, return whether end is reachable
+    bool compileInPlaceAssignment(AssemblyListing &func, int *offsets);             // Compile ASSIGN as single memory operation
+    void compileCondition(AssemblyListing &func, const CompilerOptions &options, int *numbers, int *offsets, int label,
+                          bool jumpIfTrue);                                         // Compare and jump to label
+    void compileExpression(AssemblyListing &func, const CompilerOptions &options, int *numbers,
+                           int *offsets);                                           // Compile expression subtree
+    void compileConstantOperand(AssemblyListing &func, const CompilerOptions &options, int *numbers,
+                                int *offsets);                                      // Compile operation with constant right operand
+    int pushVarlist(AssemblyListing &func, const CompilerOptions &options, int *numbers,
+                    int *offsets);                                                  // Push function arguments into stack
+
+    int translateOperation(IRFunction &ir, int *numbers, int *variables, int block);  // Append statements to CFG, return last block
+    void translateCondition(IRFunction &ir, int *numbers, int *variables, int block, int onTrue,
+                            int onFalse);                                           // Terminate block with comparison
+    IROperand translateExpression(IRFunction &ir, int *numbers, int *variables,
+                                  int block);                                       // Append expression to block, return its value
+    int translateVarlist(IRFunction &ir, int *numbers, int *variables, int block,
+                         IROperand *args, int index);                               // Evaluate call arguments, return their number
+    int translateVariable(IRFunction &ir, int *variables);                          // Virtual register of variable
+
+    bool isPure();                                                              // Check that subtree contains no calls
+    bool mayTrap();                                                             // Check that subtree contains division that may fault
+    bool isEqual(AbstractSyntaxNode *other);                                    // Structural comparison of subtrees
+    void makeConstant(int value);                                               // Turn node into integer literal
+    void replaceWithChild(AbstractSyntaxNode *child);                           // Replace node with one of its children
+    void simplifyArithmetic(SimplificationStats &stats);                        // Fold and simplify ADD/SUB/MUL/DIV node
 
 public:
     AbstractSyntaxNode();                                                       // Default constructor
@@ -79,10 +122,14 @@ public:
 
     AbstractSyntaxNode *getLeft();
 
-    AssemblyListing compileFunction(int *numbers,
+    AssemblyListing compileFunction(const CompilerOptions &options, int *numbers,
                                     int idsSize);                              // Function compiler (Should start only in function node)
+    void translateFunction(IRFunction &ir, int *numbers, int idsSize);          // Build CFG of function (Should start only in function node)
 
     int getID();
+    int countNodes();                                                           // Number of nodes in subtree
+
+    void simplify(SimplificationStats &stats);                                  // Constant folding and algebraic simplification
 
     void dump(FILE *out);                                                       // Dump node
 };
@@ -96,11 +143,15 @@ private:
     void reset();                                                               // Empty the tree
     AssemblyListing getOutputFunction();                                        // Generate output function
     AssemblyListing getInputFunction();                                         // Generate input function
+    AssemblyListing getSqrtFunction();                                          // Generate integer square root function
 
 public:
     int *
     functionIDtoNumber();                                                       // Perform simple traversal and determine listing ID for each function
-    AssemblyProgram compile();                                                  // Translate program into assembly
+    AssemblyProgram compile(const CompilerOptions &options, IREvaluator &evaluator, IRSpecializer &specializer,
+                            IRInliner &inliner, IROptimizer &optimizer,
+                            IRMemoizer &memoizer);                              // Translate program into assembly
+    SimplificationStats simplify();                                             // Fold constants and simplify expressions
 
     AbstractSyntaxTree();                                                       // Default constructor
     void load(const char *filename);                                            // Load tree from file
@@ -113,23 +164,39 @@ public:
     void dump(const char *filename);                                            // Dump tree into text file
 };
 
-void AbstractSyntaxNode::parseLocalVariables(int &alloc, int *offsets) {
+void AbstractSyntaxNode::parseLocalVariables(int &alloc, int *offsets, bool *reads) {
     if(!offsets)
         throw_exception("Invalid pointer to offsets provided");
 
-    if (type == VAR) {
+    if (type == VAR && reads[right->id]) { // Variable that is never read gets no slot and offset 0
         alloc++;
         offsets[right->id] = alloc * (-4);
     }
 
     if (right)
-        right->parseLocalVariables(alloc, offsets);
+        right->parseLocalVariables(alloc, offsets, reads);
 
     if (left)
-        left->parseLocalVariables(alloc, offsets);
+        left->parseLocalVariables(alloc, offsets, reads);
 }
 
-void AbstractSyntaxNode::parseArguments(int *offsets, int depth) {
+void AbstractSyntaxNode::markReads(bool *reads) {
+    if (type == ID) {
+        reads[id] = true;
+        return;
+    }
+
+    if (type == VAR || type == INPUT) // Declaration and input only write the variable
+        return;
+
+    if (right)
+        right->markReads(reads);
+
+    if (left && type != ASSIGN) // Assignment target is written, not read
+        left->markReads(reads);
+}
+
+void AbstractSyntaxNode::parseArguments(int *offsets, int &alloc, int number) {
     if (type != VARLIST)
         throw_exception("Parsing arguments in non-varlist node");
 
@@ -137,14 +204,35 @@ void AbstractSyntaxNode::parseArguments(int *offsets, int depth) {
         throw_exception("Invalid pointer to offsets provided");
 
     if (right) {
-        depth++;
-        offsets[right->id] = 4 * depth;
+        if (number < FASTCALL_REGISTER_COUNT) { // Register arguments are stored into local slots on entry
+            alloc++;
+            offsets[right->id] = -4 * alloc;
+        } else {
+            offsets[right->id] = 8 + 4 * (number - FASTCALL_REGISTER_COUNT);
+        }
+
         if (left)
-            left->parseArguments(offsets, depth);
+            left->parseArguments(offsets, alloc, number + 1);
+    }
+}
+
+int AbstractSyntaxNode::getCleanupSize() {
+    AbstractSyntaxNode *function = this;
+    while (function->type != DEF) {
+        function = function->parent;
+        if (!function)
+            throw_exception("Node is outside of function definition");
+    }
+
+    int arguments = 0;
+    for (AbstractSyntaxNode *argument = function->left; argument && argument->right; argument = argument->left) {
+        arguments++;
     }
+
+    return getStackArgumentsSize(arguments);
 }
 
-int AbstractSyntaxNode::pushVarlist(AssemblyListing &func, int *numbers, int *offsets) {
+int AbstractSyntaxNode::pushVarlist(AssemblyListing &func, const CompilerOptions &options, int *numbers, int *offsets) {
     if(type != VARLIST)
         throw_exception("Trying to push arguments in non-varlist node");
 
@@ -154,10 +242,10 @@ int AbstractSyntaxNode::pushVarlist(AssemblyListing &func, int *numbers, int *of
     if(right) {
         int pushed = 0;
         if(left) {
-            pushed = left->pushVarlist(func, numbers, offsets);
+            pushed = left->pushVarlist(func, options, numbers, offsets);
         }
 
-        right->compileExpression(func, numbers, offsets);
+        right->compileExpression(func, options, numbers, offsets);
         func.push(EAX);
         return pushed + 1;
     }
@@ -165,7 +253,7 @@ int AbstractSyntaxNode::pushVarlist(AssemblyListing &func, int *numbers, int *of
     return 0;
 }
 
-void AbstractSyntaxNode::compileExpression(AssemblyListing &func, int *numbers, int *offsets) {
+void AbstractSyntaxNode::compileExpression(AssemblyListing &func, const CompilerOptions &options, int *numbers, int *offsets) {
     if(!offsets)
         throw_exception("Invalid pointer to offsets provided");
 
@@ -174,21 +262,28 @@ void AbstractSyntaxNode::compileExpression(AssemblyListing &func, int *numbers,
 
     if(type == CALL) {
         func.comment("Pushing varlist START");
-        int vars = right->pushVarlist(func, numbers, offsets);
+        int vars = right->pushVarlist(func, options, numbers, offsets);
         func.comment("Pushing varlist END");
-        func.call(numbers[left->id]);
-        func.add(ESP, vars * 4);
+        for (int i = 0; i < vars && i < FASTCALL_REGISTER_COUNT; i++) {
+            func.pop(FASTCALL_REGISTERS[i]); // First argument was pushed last
+        }
+        func.call(numbers[left->id]); // Callee pops the rest
+        return;
+    }
+
+    if(right && right->type == NUM && (type == ADD || type == SUB || type == MUL || type == DIV)) {
+        compileConstantOperand(func, options, numbers, offsets);
         return;
     }
 
     if(right) {
-        right->compileExpression(func, numbers, offsets); // If right subtree is present, execute it. Result is stored in EAX
+        right->compileExpression(func, options, numbers, offsets); // If right subtree is present, execute it. Result is stored in EAX
 
     }
 
     if(left) {
         func.push(EAX); // Save result
-        left->compileExpression(func, numbers, offsets); // If left subtree is present, execute it. Result stored in EBX
+        left->compileExpression(func, options, numbers, offsets); // If left subtree is present, execute it. Result stored in EBX
         func.pop(EBX);
     }
 
@@ -205,7 +300,16 @@ void AbstractSyntaxNode::compileExpression(AssemblyListing &func, int *numbers,
             break;
 
         case SQRT:
-            throw_exception("SQRT is not yet implemented");
+            if(options.sse2) {
+                func.cdq();
+                func.logical_not(EDX);
+                func.logical_and(EAX, EDX); // Clear negative radicand instead of getting NaN
+                func.cvtsi2sd(XMM0, EAX);
+                func.sqrtsd(XMM0, XMM0);
+                func.cvttsd2si(EAX, XMM0); // Exact for every 32-bit radicand
+            } else {
+                func.call(2);
+            }
             break;
 
         case MUL:
@@ -213,6 +317,7 @@ void AbstractSyntaxNode::compileExpression(AssemblyListing &func, int *numbers,
             break;
 
         case DIV:
+            func.cdq();
             func.idiv(EBX);
             break;
 
@@ -220,8 +325,12 @@ void AbstractSyntaxNode::compileExpression(AssemblyListing &func, int *numbers,
             func.mov(EAX, EBP, offsets[id]);
             break;
 
-        case NUM:
-            func.mov(EAX, id);
+        case NUM: // Flags are only set by compileCondition after its operands are evaluated
+            if (id == 0) {
+                func.zero(EAX);
+            } else {
+                func.mov(EAX, id);
+            }
             break;
 
         default:
@@ -232,7 +341,42 @@ void AbstractSyntaxNode::compileExpression(AssemblyListing &func, int *numbers,
 
 
 
-void AbstractSyntaxNode::compileOperation(AssemblyListing &func, int *numbers, int *offsets) {
+void AbstractSyntaxNode::compileConstantOperand(AssemblyListing &func, const CompilerOptions &options, int *numbers, int *offsets) {
+    int imm = right->id;
+
+    if(type == MUL && left->type == ID && !isReducibleMultiplier(imm)) {
+        func.imul(EAX, EBP, offsets[left->id], imm); // Multiply straight from memory
+        return;
+    }
+
+    left->compileExpression(func, options, numbers, offsets);
+
+    switch(type) {
+        case ADD:
+            if(imm)
+                func.add(EAX, imm);
+            break;
+
+        case SUB:
+            if(imm)
+                func.sub(EAX, imm);
+            break;
+
+        case MUL:
+            func.multiply(EAX, imm);
+            break;
+
+        case DIV:
+            func.divide(imm);
+            break;
+
+        default:
+            throw_exception("Invalid node type during constant operand compilation");
+            break;
+    }
+}
+
+bool AbstractSyntaxNode::compileOperation(AssemblyListing &func, const CompilerOptions &options, int *numbers, int *offsets) {
     if(!offsets)
         throw_exception("Invalid pointer to offsets provided");
 
@@ -243,54 +387,51 @@ void AbstractSyntaxNode::compileOperation(AssemblyListing &func, int *numbers, i
         throw_exception("Trying to compile non-operation node as operation one");
 
 
+    bool reachable = true; // Whether statement can complete normally
+
     switch (right->type) {
         case INPUT:
             func.call(0);
-            func.mov(EBP, offsets[right->right->id], EAX);
+            if (offsets[right->right->id]) // Input still has to be consumed when value is not needed
+                func.mov(EBP, offsets[right->right->id], EAX);
             break;
 
         case OUTPUT:
-            right->right->compileExpression(func, numbers, offsets);
+            right->right->compileExpression(func, options, numbers, offsets);
             func.call(1);
             break;
 
         case IF:
-            if(!(right->left->type == EQUAL || right->left->type == ABOVE || right->left->type == EQUAL))
-                throw_exception("Invalid comparison node while compiling IF statement");
             {
-                int labelCount = func.getLabelCount();
-                right->left->left->compileExpression(func, numbers, offsets);
-                func.push(EAX);
-                right->left->right->compileExpression(func, numbers, offsets);
-                func.pop(EBX);
-                func.cmp(EAX, EBX);
-                switch(right->left->type) {
-                    case EQUAL:
-                        func.jne(labelCount);
-                        break;
-
-                    case ABOVE:
-                        func.jge(labelCount);
-                        break;
-
-                    case BELOW:
-                        func.jle(labelCount);
-                        break;
-                }
-                right->right->right->right->compileOperation(func, numbers, offsets);
+                int elseLabel = func.reserveLocalLabel();
+                right->left->compileCondition(func, options, numbers, offsets, elseLabel, false); // Skip THEN branch if false
+                bool thenReachable = right->right->right->right->compileOperation(func, options, numbers, offsets);
                 if(right->right->left) { // ELSE branch is present
-                    func.jmp(labelCount + 1); // DO NOT execute ELSE branch if statement is true
-                    func.addLocalLabel(); // ELSE branch label
-                    right->right->left->right->compileOperation(func, numbers, offsets); // compile ELSE branch
-                    func.addLocalLabel(); // End of if label
+                    int endLabel = func.reserveLocalLabel();
+                    if (thenReachable)
+                        func.jmp(endLabel); // DO NOT execute ELSE branch if statement is true
+                    func.placeLocalLabel(elseLabel); // ELSE branch label
+                    bool elseReachable = right->right->left->right->compileOperation(func, options, numbers,
+                                                                                     offsets); // compile ELSE branch
+                    func.placeLocalLabel(endLabel); // End of if label
+                    reachable = thenReachable || elseReachable;
                 } else {
-                    func.addLocalLabel(); // End of IF statement
+                    func.placeLocalLabel(elseLabel); // End of IF statement
                 }
             }
             break;
 
         case ASSIGN:
-            right->right->compileExpression(func, numbers, offsets);
+            if (!offsets[right->left->id]) { // Dead store, only side effects of the value are kept
+                if (!right->right->isPure() || right->right->mayTrap())
+                    right->right->compileExpression(func, options, numbers, offsets);
+                break;
+            }
+
+            if (right->compileInPlaceAssignment(func, offsets))
+                break;
+
+            right->right->compileExpression(func, options, numbers, offsets);
             func.mov(EBP, offsets[right->left->id], EAX);
             break;
 
@@ -298,50 +439,162 @@ void AbstractSyntaxNode::compileOperation(AssemblyListing &func, int *numbers, i
             break;
 
         case WHILE:
-            if(!(right->left->type == EQUAL || right->left->type == ABOVE || right->left->type == EQUAL))
-                throw_exception("Invalid comparison node while compiling WHILE statement");
-            {
+            { // Rotated loop: single guard check, then body with conditional jump back at the bottom
+                int endLabel = func.reserveLocalLabel();
+                right->left->compileCondition(func, options, numbers, offsets, endLabel, false); // Skip loop entirely if false
+
+                int bodyLabel = func.addLocalLabel(); // Start of the loop body
+                right->right->right->compileOperation(func, options, numbers, offsets); // Compile loop body
+                right->left->compileCondition(func, options, numbers, offsets, bodyLabel, true); // Repeat while true
+                func.placeLocalLabel(endLabel); // End of loop
+            }
+            break;
 
-                int labelCount = func.addLocalLabel(); // Label before check -- Start of the loop
-                right->left->left->compileExpression(func, numbers, offsets); // First operand
-                func.push(EAX);
-                right->left->right->compileExpression(func, numbers, offsets); // Second operand
-                func.pop(EBX);
+        case RETURN:
+            right->right->compileExpression(func, options, numbers, offsets);
+            func.mov(ESP, EBP); // Restore old stack pointer i. e. deallocate everything
+            func.pop(EBP); // Restore old stack frame
+            func.ret(getCleanupSize()); // Pop stack arguments
+            reachable = false;
+            break;
 
-                switch (right->left->type) {
-                    case EQUAL:
-                        func.jne(labelCount + 1);
-                        break;
+    }
 
-                    case ABOVE:
-                        func.jge(labelCount + 1);
-                        break;
+    if(!reachable) // Statements after RETURN are never executed
+        return false;
 
-                    case BELOW:
-                        func.jle(labelCount + 1);
-                        break;
-                }
+    if(left)
+        return left->compileOperation(func, options, numbers, offsets);
+
+    return true;
+}
+
+void AbstractSyntaxNode::compileCondition(AssemblyListing &func, const CompilerOptions &options, int *numbers, int *offsets, int label,
+                                          bool jumpIfTrue) {
+    if (type != EQUAL && type != ABOVE && type != BELOW)
+        throw_exception("Invalid comparison node while compiling condition");
+
+    AbstractSyntaxNode *fst = left;
+    AbstractSyntaxNode *snd = right;
+
+    if (fst->type == NUM && snd->type == NUM) { // Result is known at compile time
+        bool result = (type == EQUAL && fst->id == snd->id) || (type == ABOVE && fst->id > snd->id) ||
+                      (type == BELOW && fst->id < snd->id);
+        if (result == jumpIfTrue)
+            func.jmp(label);
+        return;
+    }
+
+    NODE_TYPE comparison = type;
+    if (fst->type == NUM || (fst->type == ID && snd->type != NUM && snd->type != ID)) {
+        // Keep the operand that can be encoded directly in cmp on the right
+        AbstractSyntaxNode *tmp = fst;
+        fst = snd;
+        snd = tmp;
+
+        if (comparison == ABOVE) {
+            comparison = BELOW;
+        } else if (comparison == BELOW) {
+            comparison = ABOVE;
+        }
+    }
+
+    if (snd->type == NUM) {
+        if (fst->type == ID) {
+            func.cmp(EBP, offsets[fst->id], snd->id); // cmp dword [EBP+off], imm
+        } else {
+            fst->compileExpression(func, options, numbers, offsets);
+            func.cmp(EAX, snd->id);
+        }
+    } else if (snd->type == ID) {
+        fst->compileExpression(func, options, numbers, offsets);
+        func.cmp(EAX, EBP, offsets[snd->id]); // cmp EAX, [EBP+off]
+    } else {
+        fst->compileExpression(func, options, numbers, offsets);
+        func.push(EAX);
+        snd->compileExpression(func, options, numbers, offsets);
+        func.pop(EBX);
+        func.cmp(EBX, EAX);
+    }
 
-                right->right->right->compileOperation(func, numbers, offsets); // Compile loop body
-                func.jmp(labelCount); // Go back to the check
-                func.addLocalLabel(); // End of loop
+    switch (comparison) { // Jump right after cmp so that the pair can be fused
+        case EQUAL:
+            if (jumpIfTrue) {
+                func.je(label);
+            } else {
+                func.jne(label);
             }
             break;
 
-        case RETURN:
-            right->right->compileExpression(func, numbers, offsets);
-            func.mov(ESP, EBP); // Restore old stack pointer i. e. deallocate everything
-            func.pop(EBP); // Restore old stack frame
-            func.ret();
+        case ABOVE:
+            if (jumpIfTrue) {
+                func.jg(label);
+            } else {
+                func.jle(label);
+            }
             break;
 
+        case BELOW:
+            if (jumpIfTrue) {
+                func.jl(label);
+            } else {
+                func.jge(label);
+            }
+            break;
     }
+}
 
-    if(left)
-        left->compileOperation(func, numbers, offsets);
+bool AbstractSyntaxNode::compileInPlaceAssignment(AssemblyListing &func, int *offsets) {
+    if (type != ASSIGN)
+        throw_exception("Trying to compile non-assignment node as assignment");
+
+    int offset = offsets[left->id];
+
+    if (right->type == NUM) { // x = const
+        func.mov_dword(EBP, offset, right->id);
+        return true;
+    }
+
+    if (right->type == ID && right->id == left->id) // x = x
+        return true;
+
+    if (right->type != ADD && right->type != SUB)
+        return false;
+
+    AbstractSyntaxNode *constant = nullptr;
+    if (right->left->type == ID && right->left->id == left->id && right->right->type == NUM) {
+        constant = right->right; // x = x +- const
+    } else if (right->type == ADD && right->right->type == ID && right->right->id == left->id &&
+               right->left->type == NUM) {
+        constant = right->left; // x = const + x
+    } else {
+        return false;
+    }
+
+    int delta = constant->id;
+    if (right->type == SUB) {
+        if (delta == INT_MIN)
+            return false;
+
+        delta = -delta;
+    }
+
+    if (delta == 0) {
+        // Nothing to do
+    } else if (delta == 1) {
+        func.inc(EBP, offset);
+    } else if (delta == -1) {
+        func.dec(EBP, offset);
+    } else if (delta > 0 || delta == INT_MIN) {
+        func.add(EBP, offset, delta);
+    } else {
+        func.sub(EBP, offset, -delta);
+    }
+
+    return true;
 }
 
-AssemblyListing AbstractSyntaxNode::compileFunction(int *numbers, int idsSize) {
+AssemblyListing AbstractSyntaxNode::compileFunction(const CompilerOptions &options, int *numbers, int idsSize) {
     if(!numbers)
         throw_exception("Invalid pointer to listing numbers provided");
 
@@ -353,25 +606,450 @@ AssemblyListing AbstractSyntaxNode::compileFunction(int *numbers, int idsSize) {
     function.mov(EBP, ESP); // Create stack frame
 
     int *offsets = new int[idsSize](); // Array for offsets
+    bool *reads = new bool[idsSize](); // Variables whose values are used
     int alloc = 0; // Number of variables to allocate
-    parseLocalVariables(alloc, offsets); // Parse all the local variables
-    left->parseArguments(offsets, 1); // Parse arguments
+    right->right->right->markReads(reads);
+    parseLocalVariables(alloc, offsets, reads); // Parse all the local variables
+    left->parseArguments(offsets, alloc, 0); // Parse arguments
 
-    function.sub(ESP, alloc * 4); // Allocate space for local variables
+    if (alloc)
+        function.sub(ESP, alloc * 4); // Allocate space for local variables
 
-    right->right->right->compileOperation(function, numbers, offsets);
+    AbstractSyntaxNode *argument = left;
+    for (int i = 0; i < FASTCALL_REGISTER_COUNT && argument && argument->right; i++) {
+        function.mov(EBP, offsets[argument->right->id], FASTCALL_REGISTERS[i]); // Spill register arguments
+        argument = argument->left;
+    }
 
-    function.mov(ESP, EBP); // Restore old stack pointer i. e. deallocate everything
-    function.pop(EBP); // Restore old stack frame
-    function.ret();
+    if (right->right->right->compileOperation(function, options, numbers, offsets)) { // Body can end without RETURN
+        function.mov(ESP, EBP); // Restore old stack pointer i. e. deallocate everything
+        function.pop(EBP); // Restore old stack frame
+        function.ret(getCleanupSize()); // Pop stack arguments
+    }
+
+    delete[] offsets;
+    delete[] reads;
     return function;
 }
 
+void AbstractSyntaxNode::translateFunction(IRFunction &ir, int *numbers, int idsSize) {
+    if(!numbers)
+        throw_exception("Invalid pointer to listing numbers provided");
+
+    if (type != DEF)
+        throw_exception("Function translation started from non-function node");
+
+    int *variables = new int[idsSize]; // Virtual register of every variable
+    for (int i = 0; i < idsSize; i++) {
+        variables[i] = -1;
+    }
+
+    int entry = ir.addBlock(0); // Arguments and initialization of locals
+    int argument = 0;
+    for (AbstractSyntaxNode *arg = left; arg && arg->right; arg = arg->left) {
+        variables[arg->right->id] = ir.addRegister();
+        ir.emit(entry, IR_ARG, variables[arg->right->id], irConstant(argument++), irConstant(0));
+    }
+    ir.argumentCount = argument;
+
+    int body = ir.addBlock(0);
+    ir.jump(entry, body);
+
+    if (right->right->right)
+        right->right->right->translateOperation(ir, numbers, variables, body); // Falling off the end returns zero
+
+    delete[] variables;
+}
+
+int AbstractSyntaxNode::translateVariable(IRFunction &ir, int *variables) {
+    if (type != ID)
+        throw_exception("Trying to translate non-identifier node as variable");
+
+    if (variables[id] < 0) { // Locals start as zero
+        variables[id] = ir.addRegister();
+        ir.emit(0, IR_COPY, variables[id], irConstant(0), irConstant(0));
+    }
+
+    return variables[id];
+}
+
+int AbstractSyntaxNode::translateOperation(IRFunction &ir, int *numbers, int *variables, int block) {
+    if(type != OP)
+        throw_exception("Trying to translate non-operation node as operation one");
+
+    int depth = ir.blocks[block]->loopDepth;
+
+    switch (right->type) {
+        case INPUT:
+            ir.emit(block, IR_INPUT, right->right->translateVariable(ir, variables), irConstant(0), irConstant(0));
+            break;
+
+        case OUTPUT:
+            ir.emit(block, IR_OUTPUT, -1, right->right->translateExpression(ir, numbers, variables, block), irConstant(0));
+            break;
+
+        case IF:
+            {
+                AbstractSyntaxNode *thenOps = right->right->right->right;
+                AbstractSyntaxNode *elseOps = right->right->left ? right->right->left->right : nullptr;
+
+                int thenBlock = ir.addBlock(depth);
+                int elseBlock = right->right->left ? ir.addBlock(depth) : -1;
+                int endBlock = ir.addBlock(depth);
+                right->left->translateCondition(ir, numbers, variables, block, thenBlock,
+                                                elseBlock >= 0 ? elseBlock : endBlock);
+
+                if (thenOps)
+                    thenBlock = thenOps->translateOperation(ir, numbers, variables, thenBlock);
+                ir.jump(thenBlock, endBlock);
+
+                if (elseBlock >= 0) {
+                    if (elseOps)
+                        elseBlock = elseOps->translateOperation(ir, numbers, variables, elseBlock);
+                    ir.jump(elseBlock, endBlock);
+                }
+
+                block = endBlock;
+            }
+            break;
+
+        case ASSIGN:
+            {
+                int dst = right->left->translateVariable(ir, variables);
+                vector<IRInstruction> &instructions = ir.blocks[block]->instructions;
+                int emitted = instructions.getSize();
+                IROperand value = right->right->translateExpression(ir, numbers, variables, block);
+
+                if (instructions.getSize() > emitted && irIsRegister(value, instructions[instructions.getSize() - 1].dst)) {
+                    instructions[instructions.getSize() - 1].dst = dst; // Write result straight into variable
+                } else {
+                    ir.emit(block, IR_COPY, dst, value, irConstant(0));
+                }
+            }
+            break;
+
+        case VAR:
+            break;
+
+        case WHILE:
+            { // guard -> preheader -> body -> latch with conditional jump back to body
+                int preheader = ir.addBlock(depth);
+                int body = ir.addBlock(depth + 1);
+                int exit = ir.addBlock(depth);
+                right->left->translateCondition(ir, numbers, variables, block, preheader, exit);
+                ir.jump(preheader, body);
+
+                int latch = body;
+                if (right->right->right)
+                    latch = right->right->right->translateOperation(ir, numbers, variables, body);
+                right->left->translateCondition(ir, numbers, variables, latch, body, exit);
+
+                block = exit;
+            }
+            break;
+
+        case RETURN:
+            ir.ret(block, right->right->translateExpression(ir, numbers, variables, block));
+            block = ir.addBlock(depth); // Unreachable code after RETURN goes here
+            break;
+
+        default:
+            throw_exception("Invalid node type during operation translation");
+    }
+
+    if(left)
+        return left->translateOperation(ir, numbers, variables, block);
+
+    return block;
+}
+
+void AbstractSyntaxNode::translateCondition(IRFunction &ir, int *numbers, int *variables, int block, int onTrue,
+                                            int onFalse) {
+    IR_CONDITION condition = IR_EQ;
+    switch (type) {
+        case EQUAL:
+            condition = IR_EQ;
+            break;
+
+        case ABOVE:
+            condition = IR_GT;
+            break;
+
+        case BELOW:
+            condition = IR_LT;
+            break;
+
+        default:
+            throw_exception("Invalid comparison node while translating condition");
+    }
+
+    IROperand a = left->translateExpression(ir, numbers, variables, block);
+    IROperand b = right->translateExpression(ir, numbers, variables, block);
+    ir.branch(block, condition, a, b, onTrue, onFalse);
+}
+
+int AbstractSyntaxNode::translateVarlist(IRFunction &ir, int *numbers, int *variables, int block, IROperand *args,
+                                         int index) {
+    if(type != VARLIST)
+        throw_exception("Trying to translate arguments in non-varlist node");
+
+    if (!right)
+        return index;
+
+    int count = index + 1;
+    if (left) // Later arguments are evaluated first, as they are pushed first
+        count = left->translateVarlist(ir, numbers, variables, block, args, index + 1);
+
+    args[index] = right->translateExpression(ir, numbers, variables, block);
+    return count;
+}
+
+IROperand AbstractSyntaxNode::translateExpression(IRFunction &ir, int *numbers, int *variables, int block) {
+    switch (type) {
+        case NUM:
+            return irConstant(id);
+
+        case ID:
+            return irRegister(translateVariable(ir, variables));
+
+        case CALL:
+            {
+                int count = 0;
+                for (AbstractSyntaxNode *arg = right; arg && arg->right; arg = arg->left) {
+                    count++;
+                }
+
+                auto *args = new IROperand[count];
+                right->translateVarlist(ir, numbers, variables, block, args, 0);
+
+                int poolStart = ir.addPool(count);
+                for (int i = 0; i < count; i++) {
+                    ir.pool[poolStart + i] = args[i];
+                }
+                delete[] args;
+
+                return irRegister(ir.emitPooled(block, IR_CALL, irConstant(numbers[left->id]), poolStart, count));
+            }
+
+        case SQRT:
+            return irRegister(ir.emit(block, IR_SQRT, right->translateExpression(ir, numbers, variables, block),
+                                      irConstant(0)));
+
+        case ADD:
+        case SUB:
+        case MUL:
+        case DIV:
+            {
+                IROperand b = right->translateExpression(ir, numbers, variables, block); // Right operand goes first
+                IROperand a = left->translateExpression(ir, numbers, variables, block);
+                IR_OPCODE opcode = type == ADD ? IR_ADD : type == SUB ? IR_SUB : type == MUL ? IR_MUL : IR_DIV;
+                return irRegister(ir.emit(block, opcode, a, b));
+            }
+
+        default:
+            throw_exception("Invalid node type during expression translation");
+    }
+}
+
+static int wrappingAdd(int a, int b) {
+    return static_cast<int>(static_cast<unsigned int>(a) + static_cast<unsigned int>(b));
+}
+
+static int wrappingSub(int a, int b) {
+    return static_cast<int>(static_cast<unsigned int>(a) - static_cast<unsigned int>(b));
+}
+
+static int wrappingMul(int a, int b) {
+    return static_cast<int>(static_cast<unsigned int>(a) * static_cast<unsigned int>(b));
+}
+
+bool AbstractSyntaxNode::isPure() {
+    if (type == CALL)
+        return false;
+
+    return (!left || left->isPure()) && (!right || right->isPure());
+}
+
+bool AbstractSyntaxNode::mayTrap() {
+    if (type == DIV && (!right || right->type != NUM || right->id == 0 || right->id == -1))
+        return true; // Zero divisor and INT_MIN / -1 raise #DE
+
+    return (left && left->mayTrap()) || (right && right->mayTrap());
+}
+
+bool AbstractSyntaxNode::isEqual(AbstractSyntaxNode *other) {
+    if (!other || type != other->type || id != other->id)
+        return false;
+
+    if ((left == nullptr) != (other->left == nullptr) || (right == nullptr) != (other->right == nullptr))
+        return false;
+
+    return (!left || left->isEqual(other->left)) && (!right || right->isEqual(other->right));
+}
+
+int AbstractSyntaxNode::countNodes() {
+    return 1 + (left ? left->countNodes() : 0) + (right ? right->countNodes() : 0);
+}
+
+void AbstractSyntaxNode::makeConstant(int value) {
+    delete left;    // Children destructors detach themselves from this node
+    delete right;
+
+    type = NUM;
+    id = value;
+}
+
+void AbstractSyntaxNode::replaceWithChild(AbstractSyntaxNode *child) {
+    if (!child || (child != left && child != right))
+        throw_exception("Node can only be replaced with its own child");
+
+    AbstractSyntaxNode *newLeft = child->left;
+    AbstractSyntaxNode *newRight = child->right;
+    child->left = nullptr;  // Grandchildren are adopted by this node
+    child->right = nullptr;
+
+    type = child->type;
+    id = child->id;
+
+    delete left;
+    delete right;
+
+    left = newLeft;
+    right = newRight;
+
+    if (left)
+        left->parent = this;
+
+    if (right)
+        right->parent = this;
+}
+
+void AbstractSyntaxNode::simplify(SimplificationStats &stats) {
+    if (left)
+        left->simplify(stats);
+
+    if (right)
+        right->simplify(stats);
+
+    switch (type) {
+        case ADD:
+        case SUB:
+        case MUL:
+        case DIV:
+            simplifyArithmetic(stats);
+            break;
+
+        default:
+            break;
+    }
+}
+
+void AbstractSyntaxNode::simplifyArithmetic(SimplificationStats &stats) {
+    if (!left || !right)
+        throw_exception("Arithmetic node is missing an operand");
+
+    if (left->type == NUM && right->type == NUM) { // Both operands are known, compute the result
+        int a = left->id;
+        int b = right->id;
+
+        switch (type) {
+            case ADD:
+                makeConstant(wrappingAdd(a, b));
+                break;
+
+            case SUB:
+                makeConstant(wrappingSub(a, b));
+                break;
+
+            case MUL:
+                makeConstant(wrappingMul(a, b));
+                break;
+
+            case DIV:
+                if (b == 0 || (a == INT_MIN && b == -1))
+                    return; // Leave it for runtime to fault
+                makeConstant(a / b);
+                break;
+        }
+
+        stats.folded++;
+        return;
+    }
+
+    if ((type == ADD || type == MUL) && left->type == NUM) { // Keep constant operand on the right side
+        AbstractSyntaxNode *tmp = left;
+        left = right;
+        right = tmp;
+    }
+
+    if (type == SUB && left->isEqual(right) && left->isPure() && !left->mayTrap()) { // x - x
+        makeConstant(0);
+        stats.identities++;
+        return;
+    }
+
+    if (right->type != NUM)
+        return;
+
+    int c = right->id;
+
+    if (((type == ADD || type == SUB) && c == 0) || ((type == MUL || type == DIV) && c == 1)) { // x + 0, x - 0, x * 1, x / 1
+        replaceWithChild(left);
+        stats.identities++;
+        return;
+    }
+
+    if (type == MUL && c == 0 && left->isPure() && !left->mayTrap()) { // x * 0
+        makeConstant(0);
+        stats.identities++;
+        return;
+    }
+
+    if ((type == ADD || type == SUB) && (left->type == ADD || left->type == SUB) && left->right->type == NUM) {
+        // (x +- c1) +- c2 is turned into x + (+-c1 +- c2)
+        int inner = left->type == ADD ? left->right->id : wrappingSub(0, left->right->id);
+        int total = type == ADD ? wrappingAdd(inner, c) : wrappingSub(inner, c);
+
+        left->replaceWithChild(left->left);
+        stats.reassociated++;
+
+        if (total == 0) {
+            replaceWithChild(left);
+            return;
+        }
+
+        type = ADD;
+        right->id = total;
+    } else if (type == MUL && left->type == MUL && left->right->type == NUM) { // (x * c1) * c2 = x * (c1 * c2)
+        int total = wrappingMul(left->right->id, c);
+
+        left->replaceWithChild(left->left);
+        stats.reassociated++;
+
+        if (total == 0 && left->isPure() && !left->mayTrap()) {
+            makeConstant(0);
+            return;
+        }
+
+        if (total == 1) {
+            replaceWithChild(left);
+            return;
+        }
+
+        right->id = total;
+    }
+
+    if (type == ADD && right->id < 0 && right->id != INT_MIN) { // Prefer x - c over x + (-c)
+        type = SUB;
+        right->id = -right->id;
+    }
+}
+
 AssemblyListing AbstractSyntaxTree::getOutputFunction() {
     AssemblyListing output; // Output function listing
 
     output.mov(ESI, EAX);
-    output.mov(EDX, 0); // Zero in edx
+    output.zero(EDX); // Zero in edx
     output.mov(ECX, ESP); // Old pointer
 
     output.dec(ESP);
@@ -388,7 +1066,7 @@ AssemblyListing AbstractSyntaxTree::getOutputFunction() {
     output.add(EDX, 48); // Turn it into character
     output.dec(ESP);
     output.mov(ESP, 0, DL);
-    output.mov(EDX, 0); // Free EDX
+    output.zero(EDX); // Free EDX
     output.cmp(EAX, EDX); // Check whether it is over
     output.jne(0); // Continue if it is not over
 
@@ -416,15 +1094,15 @@ AssemblyListing AbstractSyntaxTree::getOutputFunction() {
 AssemblyListing AbstractSyntaxTree::getInputFunction() {
     AssemblyListing input;
     input.push(EBP); // I want one more free register
-    input.mov(EBP, 0);
+    input.zero(EBP);
 
-    input.mov(ESI, 0); // Start from zero
+    input.zero(ESI); // Start from zero
     input.mov(EDI, 10); // Base
 
     input.sub(ESP, 4); // Allocate four bytes bcause I am lazy
     input.mov(ESP, 0, ESI); // Clear everything
 
-    input.mov(EBX, 0); // STDIN descriptor
+    input.zero(EBX); // STDIN descriptor
     input.mov(ECX, ESP); // Buffer address
 
     input.addLocalLabel(); // Reading loop starts here
@@ -459,7 +1137,42 @@ AssemblyListing AbstractSyntaxTree::getInputFunction() {
     return input;
 }
 
-AssemblyProgram AbstractSyntaxTree::compile() {
+AssemblyListing AbstractSyntaxTree::getSqrtFunction() {
+    AssemblyListing sqrt; // Newton iteration x = (x + n / x) / 2 for targets without SSE2
+    int smallLabel = sqrt.reserveLocalLabel();
+    int doneLabel = sqrt.reserveLocalLabel();
+
+    sqrt.cmp(EAX, 1);
+    sqrt.jle(smallLabel); // Roots of 0 and 1 are themselves, negatives give 0
+    sqrt.mov(ECX, EAX); // Radicand
+    sqrt.mov(EBX, EAX); // Initial guess
+
+    int loopLabel = sqrt.addLocalLabel();
+    sqrt.mov(EAX, ECX);
+    sqrt.cdq();
+    sqrt.idiv(EBX); // n / x
+    sqrt.add(EAX, EBX);
+    sqrt.shr(EAX, 1); // Unsigned halving as n / x + x may not fit into int
+    sqrt.cmp(EAX, EBX);
+    sqrt.jge(doneLabel); // Guess stopped decreasing
+    sqrt.mov(EBX, EAX);
+    sqrt.jmp(loopLabel);
+
+    sqrt.placeLocalLabel(doneLabel);
+    sqrt.mov(EAX, EBX);
+    sqrt.ret();
+
+    sqrt.placeLocalLabel(smallLabel);
+    sqrt.cdq();
+    sqrt.logical_not(EDX);
+    sqrt.logical_and(EAX, EDX); // Clear negative radicand
+    sqrt.ret();
+    return sqrt;
+}
+
+AssemblyProgram AbstractSyntaxTree::compile(const CompilerOptions &options, IREvaluator &evaluator,
+                                            IRSpecializer &specializer, IRInliner &inliner, IROptimizer &optimizer,
+                                            IRMemoizer &memoizer) {
     int *numbers = functionIDtoNumber(); // Translate function IDs into listing numbers for further use
 
     AssemblyProgram prog; // Create assembly program
@@ -468,10 +1181,64 @@ AssemblyProgram AbstractSyntaxTree::compile() {
 
     prog.pushListing(getInputFunction());
     prog.pushListing(getOutputFunction());
+    prog.pushListing(getSqrtFunction());
+
+    if (options.optimize) { // Whole program is translated first so that calls can be inlined
+        int count = 0;
+        for (AbstractSyntaxNode *node = current; node; node = node->getLeft()) {
+            count++;
+        }
+
+        auto *functions = new IRFunction[count + SPECIALIZER_MAX_CLONES]; // Specialized copies go after the originals
+        for (int i = 0; i < count; i++) {
+            AbstractSyntaxNode *function = current->getRight();
+            functions[i].number = numbers[function->getRight()->getID()];
+            functions[i].name = string_ids[function->getRight()->getID()];
+            function->translateFunction(functions[i], numbers, string_ids.getSize()); // Build CFG of the function
+            current = current->getLeft();
+        }
+
+        IRListingMap listings;
+        listings.build(functions, count);
+        evaluator.run(functions, count, listings, options); // Computable calls disappear before anything else
+        count = specializer.run(functions, count, count + SPECIALIZER_MAX_CLONES, numbers[IDs.Get("main")], options);
+        listings.build(functions, count); // Specialized copies got listings of their own
+        inliner.run(functions, count, listings, options);
+        if (options.memoize)
+            memoizer.analyze(functions, count, listings); // Purity does not change during optimization
+
+        IRLowering lowering(options);
+        auto *memoized = new bool[count]();
+        int worker = functions[count - 1].number + 1; // Bodies of memoized functions go after all the others
+        for (int i = 0; i < count; i++) {
+            optimizer.run(functions[i], options);
+            if (options.dumpIR)
+                functions[i].dump(stdout);
+
+            int listing;
+            if (options.memoize && memoizer.isMemoizable(functions[i])) { // Callers get table lookup instead
+                memoized[i] = true;
+                listing = prog.pushListing(memoizer.wrap(functions[i], worker++, prog));
+            } else {
+                listing = prog.pushListing(lowering.lower(functions[i])); // Allocate registers and select instructions
+            }
+
+            if (listing != functions[i].number)
+                throw_exception("Listing number of function does not match its position");
+        }
+
+        for (int i = 0; i < count; i++) {
+            if (memoized[i])
+                prog.pushListing(lowering.lower(functions[i])); // Recursive calls still go through the table
+        }
+        delete[] memoized;
+        delete[] functions;
+    }
 
     while (current) { // Traverse through all the functions and compile them as listings
-        prog.pushListing(current->getRight()->compileFunction(numbers,
-                                                              string_ids.getSize())); // Translate function into asm listing
+        AbstractSyntaxNode *function = current->getRight();
+        prog.pushListing(function->compileFunction(options, numbers,
+                                                   string_ids.getSize())); // Translate function into asm listing
         current = current->getLeft(); // Proceed to the next function
     }
     prog.setMainListing(numbers[IDs.Get("main")]);
@@ -480,6 +1247,19 @@ AssemblyProgram AbstractSyntaxTree::compile() {
 }
 
 
+SimplificationStats AbstractSyntaxTree::simplify() {
+    SimplificationStats stats = {};
+
+    if (!root)
+        return stats;
+
+    int before = root->countNodes();
+    root->simplify(stats);
+    stats.nodesRemoved = before - root->countNodes();
+
+    return stats;
+}
+
 AbstractSyntaxNode *AbstractSyntaxNode::getLeft() {
     return left;
 }
@@ -494,7 +1274,7 @@ int AbstractSyntaxNode::getID() {
 
 int *AbstractSyntaxTree::functionIDtoNumber() {
     int *numbers = new int[string_ids.getSize()]();
-    int cur = 2; // Leave space for itoa and atoi
+    int cur = 3; // Leave space for itoa, atoi and sqrt
     AbstractSyntaxNode *current = root->getRight();
     while (current && current->getNodeType() == D) {
         numbers[current->getRight()->getRight()->getID()] = cur++;
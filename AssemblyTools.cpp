@@ -3,6 +3,7 @@
 //
 
 #include "AssemblyTools.hpp"
+#include "Peephole.hpp"
 #include "utilities.hpp"
 
 const int ADDED = 1;
@@ -20,7 +21,10 @@ constexpr const char *regToText(REGISTER reg) {
         CASE_REGNAME(ESP);
         CASE_REGNAME(ESI);
         CASE_REGNAME(EDI);
+        CASE_REGNAME(AL);
+        CASE_REGNAME(CL);
         CASE_REGNAME(DL);
+        CASE_REGNAME(BL);
     }
     return "INVALID_REG";
 }
@@ -39,12 +43,20 @@ void AssemblyListing::mov(REGISTER to, int imm) {
     addOperation(new mov_reg_imm(to, imm));
 }
 
+void AssemblyListing::zero(REGISTER to) {
+    addOperation(new zero_reg(to));
+}
+
 void AssemblyListing::mov(REGISTER to, REGISTER from) {
     addOperation(new mov_reg_reg(to, from));
 }
 
 void AssemblyListing::mov(REGISTER to, REGISTER ptr, int offset) {
-    addOperation(new mov_reg_rm_off32(to, ptr, offset));
+    if (fitsInByte(offset)) {
+        addOperation(new mov_reg_rm_off8(to, ptr, static_cast<char>(offset)));
+    } else {
+        addOperation(new mov_reg_rm_off32(to, ptr, offset));
+    }
 }
 
 void AssemblyListing::mov(REGISTER to, REGISTER ptr, char offset) {
@@ -56,7 +68,19 @@ void AssemblyListing::mov(REGISTER ptr, char offset, REGISTER from) {
 }
 
 void AssemblyListing::mov(REGISTER ptr, int offset, REGISTER from) {
-    addOperation(new mov_rm_reg_off32(ptr, offset, from));
+    if (fitsInByte(offset)) {
+        addOperation(new mov_rm_reg_off8(ptr, static_cast<char>(offset), from));
+    } else {
+        addOperation(new mov_rm_reg_off32(ptr, offset, from));
+    }
+}
+
+void AssemblyListing::mov_dword(REGISTER ptr, int offset, int imm) {
+    if (fitsInByte(offset)) {
+        addOperation(new mov_rm_imm32_off8(ptr, static_cast<char>(offset), imm));
+    } else {
+        addOperation(new mov_rm_imm32_off32(ptr, offset, imm));
+    }
 }
 
 void AssemblyListing::mov(REGISTER ptr, char offset, char byte) {
@@ -72,16 +96,33 @@ void AssemblyListing::ret() {
 }
 
 void AssemblyListing::ret(unsigned short to_pop) {
-    addOperation(new ret_pop(to_pop));
+    if (to_pop) {
+        addOperation(new ret_pop(to_pop));
+    } else {
+        addOperation(new class ret());
+    }
 }
 
 int AssemblyListing::addLocalLabel() {
+    int num = reserveLocalLabel();
+    placeLocalLabel(num);
+    return num;
+}
+
+int AssemblyListing::reserveLocalLabel() {
     int num = labels.getSize();
     labels.push_back(pos);
-    addOperation(new label(num));
     return num;
 }
 
+void AssemblyListing::placeLocalLabel(int labelId) {
+    if (labelId < 0 || labelId >= labels.getSize())
+        throw_exception("Trying to place label that was not reserved");
+
+    labels[labelId] = pos;
+    addOperation(new label(labelId));
+}
+
 void AssemblyListing::interrupt(unsigned char int_num) {
     addOperation(new class interrupt(int_num));
 }
@@ -91,6 +132,11 @@ void AssemblyListing::call(int functionId) {
     addOperation(new class call(functionId));
 }
 
+void AssemblyListing::jmp_listing(int functionId) {
+    requiredListings.push_back(functionId);
+    addOperation(new class jmp_listing(functionId));
+}
+
 void AssemblyListing::jmp(int labelId) {
     addOperation(new class jmp(labelId));
 }
@@ -103,6 +149,26 @@ void AssemblyListing::jne(int labelId) {
     addOperation(new class jne(labelId));
 }
 
+void AssemblyListing::cmov(CONDITION_CODE cc, REGISTER to, REGISTER what) {
+    addOperation(new cmov_reg_reg(cc, to, what));
+}
+
+void AssemblyListing::cmov(CONDITION_CODE cc, REGISTER to, REGISTER ptr, int offset) {
+    if (fitsInByte(offset)) {
+        addOperation(new cmov_reg_rm_off8(cc, to, ptr, static_cast<char>(offset)));
+    } else {
+        addOperation(new cmov_reg_rm_off32(cc, to, ptr, offset));
+    }
+}
+
+void AssemblyListing::setcc(CONDITION_CODE cc, REGISTER what) {
+    addOperation(new setcc_reg(cc, what));
+}
+
+void AssemblyListing::movzx(REGISTER to, REGISTER what) {
+    addOperation(new movzx_reg_reg(to, what));
+}
+
 void AssemblyListing::jl(int labelId) {
     addOperation(new class jl(labelId));
 }
@@ -132,7 +198,11 @@ void AssemblyListing::inc(REGISTER ptr, char offset) {
 }
 
 void AssemblyListing::inc(REGISTER ptr, int offset) {
-    addOperation(new inc_rm_off32(ptr, offset));
+    if (fitsInByte(offset)) {
+        addOperation(new inc_rm_off8(ptr, static_cast<char>(offset)));
+    } else {
+        addOperation(new inc_rm_off32(ptr, offset));
+    }
 }
 
 void AssemblyListing::dec(REGISTER what) {
@@ -144,7 +214,11 @@ void AssemblyListing::dec(REGISTER ptr, char offset) {
 }
 
 void AssemblyListing::dec(REGISTER ptr, int offset) {
-    addOperation(new dec_rm_off32(ptr, offset));
+    if (fitsInByte(offset)) {
+        addOperation(new dec_rm_off8(ptr, static_cast<char>(offset)));
+    } else {
+        addOperation(new dec_rm_off32(ptr, offset));
+    }
 }
 
 void AssemblyListing::imul(REGISTER multiplier) {
@@ -155,6 +229,172 @@ void AssemblyListing::idiv(REGISTER divisor) {
     addOperation(new idiv_reg(divisor));
 }
 
+void AssemblyListing::cdq() {
+    addOperation(new class cdq());
+}
+
+void AssemblyListing::imul(REGISTER to, REGISTER what, int imm) {
+    addOperation(new imul_reg_reg_imm(to, what, imm));
+}
+
+void AssemblyListing::imul(REGISTER to, REGISTER ptr, int offset, int imm) {
+    if (fitsInByte(offset)) {
+        addOperation(new imul_reg_rm_imm_off8(to, ptr, static_cast<char>(offset), imm));
+    } else {
+        addOperation(new imul_reg_rm_imm_off32(to, ptr, offset, imm));
+    }
+}
+
+void AssemblyListing::imul(REGISTER to, REGISTER what) {
+    addOperation(new imul_reg_reg(to, what));
+}
+
+void AssemblyListing::imul_rm(REGISTER to, REGISTER ptr, int offset) {
+    if (fitsInByte(offset)) {
+        addOperation(new imul_reg_rm_off8(to, ptr, static_cast<char>(offset)));
+    } else {
+        addOperation(new imul_reg_rm_off32(to, ptr, offset));
+    }
+}
+
+void AssemblyListing::shl(REGISTER what, unsigned char count) {
+    addOperation(new shl_reg_imm(what, count));
+}
+
+void AssemblyListing::shr(REGISTER what, unsigned char count) {
+    addOperation(new shr_reg_imm(what, count));
+}
+
+void AssemblyListing::sar(REGISTER what, unsigned char count) {
+    addOperation(new sar_reg_imm(what, count));
+}
+
+void AssemblyListing::lea(REGISTER to, REGISTER base, REGISTER index, unsigned char scale, int offset) {
+    addOperation(new lea_reg_sib(to, base, index, scale, offset));
+}
+
+void AssemblyListing::multiply(REGISTER what, int imm) {
+    if (imm == 0) { // Flags are clobbered by multiplication anyway
+        zero(what);
+        return;
+    }
+
+    if (!isReducibleMultiplier(imm)) {
+        imul(what, what, imm);
+        return;
+    }
+
+    bool negative = imm < 0;
+    if (negative)
+        imm = -imm;
+
+    unsigned char shift = 0;
+    while (imm % 2 == 0) {
+        imm /= 2;
+        shift++;
+    }
+
+    if (imm != 1)
+        lea(what, what, what, imm - 1, 0); // x * 3, x * 5 and x * 9 are x + x * scale
+
+    if (shift)
+        shl(what, shift);
+
+    if (negative)
+        neg(what);
+}
+
+// Magic multiplier and shift for signed division by constant, Hacker's Delight 10-1
+static void divisionMagic(int divisor, int &magic, int &shift) {
+    const unsigned int two31 = 0x80000000u;
+    unsigned int absDivisor = divisor < 0 ? -static_cast<unsigned int>(divisor) : divisor;
+    unsigned int t = two31 + (static_cast<unsigned int>(divisor) >> 31u);
+    unsigned int absNc = t - 1 - t % absDivisor;
+    int p = 31;
+    unsigned int q1 = two31 / absNc, r1 = two31 - q1 * absNc;
+    unsigned int q2 = two31 / absDivisor, r2 = two31 - q2 * absDivisor;
+    unsigned int delta = 0;
+
+    do {
+        p++;
+        q1 *= 2;
+        r1 *= 2;
+        if (r1 >= absNc) {
+            q1++;
+            r1 -= absNc;
+        }
+
+        q2 *= 2;
+        r2 *= 2;
+        if (r2 >= absDivisor) {
+            q2++;
+            r2 -= absDivisor;
+        }
+
+        delta = absDivisor - r2;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
+
+    magic = static_cast<int>(q2 + 1);
+    if (divisor < 0)
+        magic = -magic;
+
+    shift = p - 32;
+}
+
+void AssemblyListing::divide(int divisor) {
+    if (divisor == 1)
+        return;
+
+    if (divisor == -1) {
+        neg(EAX);
+        return;
+    }
+
+    if (divisor == 0 || divisor == INT_MIN) { // Keep the trap on zero, |INT_MIN| does not fit
+        mov(EBX, divisor);
+        cdq();
+        idiv(EBX);
+        return;
+    }
+
+    unsigned int absDivisor = divisor < 0 ? -divisor : divisor;
+    if ((absDivisor & (absDivisor - 1)) == 0) {
+        unsigned char shift = 0;
+        while ((1u << shift) != absDivisor)
+            shift++;
+
+        cdq(); // Negative dividends are biased by divisor - 1 to round towards zero
+        if (shift == 1) {
+            sub(EAX, EDX);
+        } else {
+            logical_and(EDX, absDivisor - 1);
+            add(EAX, EDX);
+        }
+        sar(EAX, shift);
+
+        if (divisor < 0)
+            neg(EAX);
+        return;
+    }
+
+    int magic = 0, shift = 0;
+    divisionMagic(divisor, magic, shift);
+
+    mov(EBX, EAX);
+    mov(EAX, magic);
+    imul(EBX); // EDX = high half of magic * dividend
+    if (divisor > 0 && magic < 0)
+        add(EDX, EBX);
+    if (divisor < 0 && magic > 0)
+        sub(EDX, EBX);
+    if (shift)
+        sar(EDX, shift);
+
+    mov(EAX, EDX);
+    shr(EAX, 31);
+    add(EAX, EDX); // Add one if quotient is negative
+}
+
 void AssemblyListing::add(REGISTER to, REGISTER what) {
     addOperation(new add_reg_reg(to, what));
 }
@@ -168,7 +408,19 @@ void AssemblyListing::add(REGISTER ptr, char offset, int imm) {
 }
 
 void AssemblyListing::add(REGISTER ptr, int offset, int imm) {
-    addOperation(new add_rm_imm_off32(ptr, offset, imm));
+    if (fitsInByte(offset)) {
+        addOperation(new add_rm_imm_off8(ptr, static_cast<char>(offset), imm));
+    } else {
+        addOperation(new add_rm_imm_off32(ptr, offset, imm));
+    }
+}
+
+void AssemblyListing::add(REGISTER to, REGISTER ptr, int offset) {
+    if (fitsInByte(offset)) {
+        addOperation(new add_reg_rm_off8(to, ptr, static_cast<char>(offset)));
+    } else {
+        addOperation(new add_reg_rm_off32(to, ptr, offset));
+    }
 }
 
 void AssemblyListing::sub(REGISTER to, REGISTER what) {
@@ -184,7 +436,31 @@ void AssemblyListing::sub(REGISTER ptr, char offset, int imm) {
 }
 
 void AssemblyListing::sub(REGISTER ptr, int offset, int imm) {
-    addOperation(new sub_rm_imm_off32(ptr, offset, imm));
+    if (fitsInByte(offset)) {
+        addOperation(new sub_rm_imm_off8(ptr, static_cast<char>(offset), imm));
+    } else {
+        addOperation(new sub_rm_imm_off32(ptr, offset, imm));
+    }
+}
+
+void AssemblyListing::sub(REGISTER to, REGISTER ptr, int offset) {
+    if (fitsInByte(offset)) {
+        addOperation(new sub_reg_rm_off8(to, ptr, static_cast<char>(offset)));
+    } else {
+        addOperation(new sub_reg_rm_off32(to, ptr, offset));
+    }
+}
+
+void AssemblyListing::push(int imm) {
+    addOperation(new push_imm(imm));
+}
+
+void AssemblyListing::push(REGISTER ptr, int offset) {
+    if (fitsInByte(offset)) {
+        addOperation(new push_rm_off8(ptr, static_cast<char>(offset)));
+    } else {
+        addOperation(new push_rm_off32(ptr, offset));
+    }
 }
 
 void AssemblyListing::push(REGISTER reg) {
@@ -203,6 +479,22 @@ void AssemblyListing::cmp(REGISTER fst, int snd) {
     addOperation(new cmp_reg_imm(fst, snd));
 }
 
+void AssemblyListing::cmp(REGISTER fst, REGISTER ptr, int offset) {
+    if (fitsInByte(offset)) {
+        addOperation(new cmp_reg_rm_off8(fst, ptr, static_cast<char>(offset)));
+    } else {
+        addOperation(new cmp_reg_rm_off32(fst, ptr, offset));
+    }
+}
+
+void AssemblyListing::cmp(REGISTER ptr, int offset, int imm) {
+    if (fitsInByte(offset)) {
+        addOperation(new cmp_rm_imm_off8(ptr, static_cast<char>(offset), imm));
+    } else {
+        addOperation(new cmp_rm_imm_off32(ptr, offset, imm));
+    }
+}
+
 void AssemblyListing::neg(REGISTER what) {
     addOperation(new neg_reg(what));
 }
@@ -211,6 +503,26 @@ void AssemblyListing::logical_and(REGISTER what, unsigned int imm) {
     addOperation(new and_reg_imm(what, imm));
 }
 
+void AssemblyListing::logical_and(REGISTER to, REGISTER what) {
+    addOperation(new and_reg_reg(to, what));
+}
+
+void AssemblyListing::logical_not(REGISTER what) {
+    addOperation(new not_reg(what));
+}
+
+void AssemblyListing::cvtsi2sd(XMM_REGISTER to, REGISTER from) {
+    addOperation(new cvtsi2sd_xmm_reg(to, from));
+}
+
+void AssemblyListing::sqrtsd(XMM_REGISTER to, XMM_REGISTER from) {
+    addOperation(new sqrtsd_xmm_xmm(to, from));
+}
+
+void AssemblyListing::cvttsd2si(REGISTER to, XMM_REGISTER from) {
+    addOperation(new cvttsd2si_reg_xmm(to, from));
+}
+
 int AssemblyListing::getLabelCount() {
     return labels.getSize();
 }
@@ -267,7 +579,7 @@ bool AssemblyListing::markRequiredFunctions(int *listingPositions) {
     return updated;
 }
 
-AssemblyProgram::AssemblyProgram() : listings(), main(0) {}
+AssemblyProgram::AssemblyProgram() : listings(), main(0), bssSize(0) {}
 
 AssemblyProgram::AssemblyProgram(AssemblyProgram &&other) noexcept {
     swap(*this, other);
@@ -279,17 +591,30 @@ AssemblyProgram &AssemblyProgram::operator=(AssemblyProgram &&other) noexcept {
 }
 
 
+unsigned int AssemblyProgram::reserveData(unsigned int size) {
+    unsigned int address = BSS_ADDRESS + bssSize;
+    bssSize += (size + 3) & ~3u; // Keep dwords aligned
+
+    return address;
+}
+
 void AssemblyProgram::setMainListing(int pos) {
     main = pos;
 }
 
+void AssemblyProgram::optimize(PeepholeOptimizer &optimizer) {
+    for (int i = 0; i < listings.getSize(); i++) {
+        listings[i].optimize(optimizer);
+    }
+}
+
 int AssemblyProgram::pushListing(AssemblyListing &&lst) {
     listings.push_back(forward<AssemblyListing>(lst));
     return listings.getSize() - 1;
 }
 
 int *AssemblyProgram::prepare() {
-    int *listingPositions = new int[listings.getSize()];
+    int *listingPositions = new int[listings.getSize()]();
 
     listingPositions[main] = ADDED;
 
@@ -318,13 +643,53 @@ int *AssemblyProgram::prepare() {
 
     pos = 0;
     for (int i = 0; i < listings.getSize(); i++) {
-        pos = listings[i].placeCallOffsets(listingPositions, pos);
+        if (listingPositions[i] != -1)
+            pos = listings[i].placeCallOffsets(listingPositions, pos);
     }
 
     return listingPositions;
 }
 
+void AssemblyListing::layout() {
+    pos = 0;
+    for (int i = 0; i < ops.getSize(); i++) {
+        if (ops[i]->getType() == LABEL_OP) {
+            labels[reinterpret_cast<label *>(ops[i])->getNum()] = pos;
+        }
+        pos += ops[i]->getSize();
+    }
+}
+
+void AssemblyListing::optimize(PeepholeOptimizer &optimizer) {
+    optimizer.run(ops);
+    layout();
+}
+
 void AssemblyListing::placeLocalLabelJumpOffsets() {
+    for (int i = 0; i < ops.getSize(); i++) { // Start with every jump being short
+        if (ops[i]->getType() == JUMP_OP) {
+            reinterpret_cast<Jump *>(ops[i])->setShortForm(true);
+        }
+    }
+
+    bool relaxed = true;
+    while (relaxed) {                                   // Lengthen jumps that can't reach their labels until nothing changes
+        relaxed = false;
+        layout();
+
+        int pos = 0;
+        for (int i = 0; i < ops.getSize(); i++) {
+            pos += ops[i]->getSize();
+            if (ops[i]->getType() == JUMP_OP) {
+                Jump *op_jump = reinterpret_cast<Jump *>(ops[i]);
+                if (op_jump->isShortForm() && !fitsInByte(labels[op_jump->getLabelId()] - pos)) {
+                    op_jump->setShortForm(false);
+                    relaxed = true;
+                }
+            }
+        }
+    }
+
     int pos = 0;
     for (int i = 0; i < ops.getSize(); i++) {
         pos += ops[i]->getSize();
@@ -392,6 +757,11 @@ void AssemblyProgram::toELF(const char *filename) {
 
     Bytecode executable = toBytecode(); // Translate executable into bytecode
     unsigned int executableSize = executable.getSize();
+    unsigned short headerCount = bssSize ? 3 : 2; // Zero-initialized data gets a segment of its own
+    unsigned int codeOffset = sizeof(ELFHeader) + headerCount * sizeof(ELFProgramHeader); // Code follows the headers
+
+    if (bssSize && 0x08048000 + codeOffset + executableSize > BSS_ADDRESS)
+        throw_exception("Program code overlaps zero-initialized data");
 
 
     ELFHeader header = {
@@ -411,40 +781,50 @@ void AssemblyProgram::toELF(const char *filename) {
             .e_type = 2, // Executable file
             .e_machine = 3, // Intel 80386
             .e_version = 1, // Format vesion: current
-            .e_entry = 0x08048074, // Entry point
+            .e_entry = 0x08048000 + codeOffset, // Entry point
             .e_phoff = 52, // Header Table is located right after this header
             .e_shoff = 0, // I don't really head section headers tbh
             .e_flags = 0, // Don't need any flags
             .e_ehsize = 52, // ELF Header size for 32-bit file
             .e_phentsize = 32, // Program Header size for 32-bit file
-            .e_phnum = 2, // Number of program headers
+            .e_phnum = headerCount, // Number of program headers
             .e_shentsize = 40, // Size of section header
             .e_shnum = 0, // No section headers
             .e_shstrndx = 0 // No names
 
     };
 
-    ELFProgramHeader headers[2] = {};
+    ELFProgramHeader headers[3] = {};
     headers[0] = {
             .p_type = 1, // Load to memory
             .p_offset = 0, // From the beginning of file
             .p_vaddr = 0x08048000, // Virtual address
             .p_paddr = 0x08048000, // Physical address
-            .p_filesz = 0x74, // Size in file
-            .p_memsz = 0x74, // Size in memory. Exactly ELF file and two headers
+            .p_filesz = codeOffset, // Size in file
+            .p_memsz = codeOffset, // Size in memory. Exactly ELF file and program headers
             .p_flags = 4, // Readable
             .p_align = 0x10 // Align by 16 bytes border
     };
     headers[1] = {
             .p_type = 1, // Load
-            .p_offset = 0x80, // Right after all the headers
-            .p_vaddr = 0x8048080, // Virtual address
-            .p_paddr = 0x8048080, // Physical address
+            .p_offset = codeOffset, // Right after all the headers
+            .p_vaddr = 0x08048000 + codeOffset, // Virtual address
+            .p_paddr = 0x08048000 + codeOffset, // Physical address
             .p_filesz = executableSize, // Size is equal to the size of program
             .p_memsz = executableSize, // Size in memory is the same
             .p_flags = 1 | 4, // Executable and readable,
             .p_align = 0x10 // Align by 16 bytes
     };
+    headers[2] = {
+            .p_type = 1, // Load
+            .p_offset = 0, // Nothing is read from file
+            .p_vaddr = BSS_ADDRESS, // Virtual address
+            .p_paddr = BSS_ADDRESS, // Physical address
+            .p_filesz = 0, // No bytes in file
+            .p_memsz = bssSize, // Loader fills memory with zeros
+            .p_flags = 2 | 4, // Writable and readable
+            .p_align = 0x1000 // Align by page
+    };
 
     FILE *output = fopen(filename, "wb");
 
@@ -452,7 +832,7 @@ void AssemblyProgram::toELF(const char *filename) {
         throw_exception("Unable to open the file for writing");
 
     fwrite(&header, sizeof(ELFHeader), 1, output);
-    fwrite(headers, sizeof(ELFProgramHeader), 2, output);
+    fwrite(headers, sizeof(ELFProgramHeader), headerCount, output);
     fwrite(executable.data(), sizeof(unsigned char), executable.getSize(), output);
     fclose(output);
 
@@ -486,7 +866,10 @@ void AssemblyProgram::toNASM(const char *filename) {
     }
     delete[] listingPositions;
 
-    // TODO deal with data section
+    if (bssSize) { // Listings use absolute addresses, so the linker has to place .bss at BSS_ADDRESS
+        fprintf(output, "SEGMENT .bss ; ld -Tbss=0x%x\n"
+                        "    resb %u\n", BSS_ADDRESS, bssSize);
+    }
 
     fclose(output);
 }
@@ -6,6 +6,7 @@
 #define X86COMPILERBACKEND_ASSEMBLYTOOLS_HPP
 
 #include <cstdio>
+#include <climits>
 #include "Vector.hpp"
 
 enum REGISTER {
@@ -27,8 +28,59 @@ enum REGISTER {
     BH
 };
 
+enum XMM_REGISTER {
+    XMM0,
+    XMM1,
+    XMM2,
+    XMM3,
+    XMM4,
+    XMM5,
+    XMM6,
+    XMM7
+};
+
 constexpr const char *regToText(REGISTER reg);
 
+// Calling convention of compiled functions: leading arguments travel in registers, callee pops the rest with ret imm16
+const int FASTCALL_REGISTER_COUNT = 3;
+const REGISTER FASTCALL_REGISTERS[FASTCALL_REGISTER_COUNT] = {EAX, EDX, EBX};
+
+// Bytes of arguments that are passed on stack and popped by callee
+inline int getStackArgumentsSize(int arguments) {
+    return arguments > FASTCALL_REGISTER_COUNT ? 4 * (arguments - FASTCALL_REGISTER_COUNT) : 0;
+}
+
+// Zero-initialized data segment is mapped at a fixed address far above the code, so listings can refer to it directly
+const unsigned int BSS_ADDRESS = 0x10000000;
+
+// Low nibble of Jcc, SETcc and CMOVcc opcodes
+enum CONDITION_CODE {
+    CC_E = 0x4,
+    CC_NE = 0x5,
+    CC_L = 0xc,
+    CC_GE = 0xd,
+    CC_LE = 0xe,
+    CC_G = 0xf
+};
+
+inline const char *ccToText(CONDITION_CODE cc) {
+    switch (cc) {
+        case CC_E:
+            return "e";
+        case CC_NE:
+            return "ne";
+        case CC_L:
+            return "l";
+        case CC_GE:
+            return "ge";
+        case CC_LE:
+            return "le";
+        case CC_G:
+            return "g";
+    }
+    return "";
+}
+
 //enum OP_TYPE {
 ////    NOP,
 ////    INT,
@@ -100,10 +152,124 @@ public:
     }
 };
 
+inline bool fitsInByte(int value) {
+    return value >= -128 && value <= 127;
+}
+
+// Group 1 arithmetic (add, or, and, sub, cmp) of 32-bit register and immediate
+inline void regImmBytecode(Bytecode &buf, unsigned char ext, REGISTER reg, int imm) {
+    if (fitsInByte(imm)) {
+        buf.append_byte(0x83); // Sign-extended imm8 form
+        buf.append_byte(0b11000000 | (ext << 3) | reg);
+        buf.append(static_cast<char>(imm));
+    } else if (reg == EAX) {
+        buf.append_byte((ext << 3) | 0x05); // Short accumulator form
+        buf.append(imm);
+    } else {
+        buf.append_byte(0x81);
+        buf.append_byte(0b11000000 | (ext << 3) | reg);
+        buf.append(imm);
+    }
+}
+
+inline int regImmSize(REGISTER reg, int imm) {
+    if (fitsInByte(imm))
+        return 3;
+
+    if (reg == EAX)
+        return 5;
+
+    return 6;
+}
+
+// Group 1 arithmetic of dword [ptr+offset] and immediate
+inline void memImmBytecode(Bytecode &buf, unsigned char ext, REGISTER ptr, int offset, bool shortOffset, int imm) {
+    buf.append_byte(fitsInByte(imm) ? 0x83 : 0x81);
+    buf.append_byte((shortOffset ? 0b01000000 : 0b10000000) | (ext << 3) | ptr);
+
+    if (ptr == ESP)
+        buf.append_byte(0x24);
+
+    if (shortOffset) {
+        buf.append(static_cast<char>(offset));
+    } else {
+        buf.append(offset);
+    }
+
+    if (fitsInByte(imm)) {
+        buf.append(static_cast<char>(imm));
+    } else {
+        buf.append(imm);
+    }
+}
+
+inline int memImmSize(REGISTER ptr, bool shortOffset, int imm) {
+    return 2 + (ptr == ESP) + (shortOffset ? 1 : 4) + (fitsInByte(imm) ? 1 : 4);
+}
+
+// ModRM, SIB and displacement of register and dword [ptr+offset] operands
+inline void regMemBytecode(Bytecode &buf, unsigned char reg, REGISTER ptr, int offset, bool shortOffset) {
+    buf.append_byte((shortOffset ? 0b01000000 : 0b10000000) | (reg << 3) | ptr);
+
+    if (ptr == ESP)
+        buf.append_byte(0x24);
+
+    if (shortOffset) {
+        buf.append(static_cast<char>(offset));
+    } else {
+        buf.append(offset);
+    }
+}
+
+inline int regMemSize(REGISTER ptr, bool shortOffset) {
+    return 1 + (ptr == ESP) + (shortOffset ? 1 : 4);
+}
+
+// Group 2 shift (shl, shr, sar) of 32-bit register by immediate count
+inline void shiftImmBytecode(Bytecode &buf, unsigned char ext, REGISTER reg, unsigned char count) {
+    if (count == 1) {
+        buf.append_byte(0xd1); // Shift by one has no immediate
+        buf.append_byte(0b11000000 | (ext << 3) | reg);
+    } else {
+        buf.append_byte(0xc1);
+        buf.append_byte(0b11000000 | (ext << 3) | reg);
+        buf.append_byte(count);
+    }
+}
+
+inline int shiftImmSize(unsigned char count) {
+    return count == 1 ? 2 : 3;
+}
+
+// Whether multiplication by imm can be done with shifts and lea instead of imul
+inline bool isReducibleMultiplier(int imm) {
+    if (imm == INT_MIN)
+        return false;
+
+    if (imm < 0)
+        imm = -imm;
+
+    if (imm == 0)
+        return true;
+
+    while (imm % 2 == 0)
+        imm /= 2;
+
+    return imm == 1 || imm == 3 || imm == 5 || imm == 9;
+}
+
 enum OP_TYPE {
     OTHER,
     JUMP_OP,
-    CALL_OP
+    CALL_OP,
+    LABEL_OP,
+    COMMENT_OP,
+    PUSH_OP,
+    POP_OP,
+    MOV_REG_IMM_OP,
+    MOV_REG_REG_OP,
+    LOAD_OP,
+    STORE_OP
 };
 
 class Operation {
@@ -161,22 +327,55 @@ private:
 public:
     mov_reg_imm(REGISTER to, int imm) : to(to), imm(imm) {}
 
+    REGISTER getRegister() {
+        return to;
+    }
+
+    int getImmediate() {
+        return imm;
+    }
+
     virtual void toNASM(FILE *output) {
         fprintf(output, "    mov %s, %d\n", regToText(to), imm);
     }
 
     virtual void toBytecode(Bytecode &buf) {
-        if (to <= EDI) {
-            buf.append_byte(0xb8 | to);
-            buf.append(imm);
-        } else {
+        if (to > EDI)
             throw_exception("MOV immediate supports only 32-bit registers");
-        }
+
+        buf.append_byte(0xb8 | to);
+        buf.append(imm);
     }
 
     virtual int getSize() {
         return 5; // B8 + rd + id
     }
+
+    virtual OP_TYPE getType() {
+        return MOV_REG_IMM_OP;
+    }
+};
+
+// Zeroing idiom, shorter than mov reg, 0 but clobbers flags
+class zero_reg : public mov_reg_imm {
+public:
+    explicit zero_reg(REGISTER to) : mov_reg_imm(to, 0) {}
+
+    virtual void toNASM(FILE *output) {
+        fprintf(output, "    xor %s, %s\n", regToText(getRegister()), regToText(getRegister()));
+    }
+
+    virtual void toBytecode(Bytecode &buf) {
+        if (getRegister() > EDI)
+            throw_exception("XOR supports only 32-bit registers");
+
+        buf.append_byte(0x31);
+        buf.append_byte(0b11000000 | (getRegister() << 3) | getRegister());
+    }
+
+    virtual int getSize() {
+        return 2; // 31 /r
+    }
 };
 
 class mov_reg_reg : public Operation {
@@ -186,6 +385,14 @@ private:
 public:
     mov_reg_reg(REGISTER to, REGISTER from) : to(to), from(from) {}
 
+    REGISTER getDestination() {
+        return to;
+    }
+
+    REGISTER getSource() {
+        return from;
+    }
+
     virtual void toNASM(FILE *output) {
         fprintf(output, "    mov %s, %s\n", regToText(to), regToText(from));
     }
@@ -202,15 +409,67 @@ public:
     virtual int getSize() {
         return 2;
     }
+
+    virtual OP_TYPE getType() {
+        return MOV_REG_REG_OP;
+    }
 };
 
-class mov_rm_reg_off8 : public Operation {
-private:
+class Store : public Operation {
+protected:
     REGISTER rmreg;
-    char offset;
+    int offset;
     REGISTER from;
+
+public:
+    Store(REGISTER rmreg, int offset, REGISTER from) : rmreg(rmreg), offset(offset), from(from) {}
+
+    REGISTER getPointer() {
+        return rmreg;
+    }
+
+    int getOffset() {
+        return offset;
+    }
+
+    REGISTER getSource() {
+        return from;
+    }
+
+    virtual OP_TYPE getType() {
+        return STORE_OP;
+    }
+};
+
+class Load : public Operation {
+protected:
+    REGISTER rmreg;
+    int offset;
+    REGISTER to;
+
+public:
+    Load(REGISTER to, REGISTER rmreg, int offset) : rmreg(rmreg), offset(offset), to(to) {}
+
+    REGISTER getPointer() {
+        return rmreg;
+    }
+
+    int getOffset() {
+        return offset;
+    }
+
+    REGISTER getDestination() {
+        return to;
+    }
+
+    virtual OP_TYPE getType() {
+        return LOAD_OP;
+    }
+};
+
+class mov_rm_reg_off8 : public Store {
 public:
-    mov_rm_reg_off8(REGISTER rmreg, char offset, REGISTER from) : rmreg(rmreg), offset(offset), from(from) {}
+    mov_rm_reg_off8(REGISTER rmreg, char offset, REGISTER from) : Store(rmreg, offset, from) {}
 
     virtual void toNASM(FILE *output) {
         fprintf(output, "    mov [%s%+d], %s\n", regToText(rmreg), offset, regToText(from));
@@ -228,7 +487,7 @@ public:
         if(rmreg == ESP)
             buf.append_byte(0x24);
 
-        buf.append(offset);
+        buf.append(static_cast<char>(offset));
     }
 
     virtual int getSize() {
@@ -269,13 +528,69 @@ public:
     }
 };
 
-class mov_rm_reg_off32 : public Operation {
+class mov_rm_imm32_off8 : public Operation {
+private:
+    REGISTER rmreg;
+    char offset;
+    int imm;
+public:
+    mov_rm_imm32_off8(REGISTER rmreg, char offset, int imm) : rmreg(rmreg), offset(offset), imm(imm) {}
+
+    virtual void toNASM(FILE *output) {
+        fprintf(output, "    mov dword [%s%+d], %d\n", regToText(rmreg), offset, imm);
+    }
+
+    virtual void toBytecode(Bytecode &buf) {
+        buf.append_byte(0xc7); // Opcode
+        buf.append_byte(0b01000000 | rmreg);
+        if(rmreg == ESP)
+            buf.append_byte(0x24);
+
+        buf.append(offset);
+        buf.append(imm);
+    }
+
+    virtual int getSize() {
+        if(rmreg == ESP)
+            return 8;
+
+        return 7;
+    }
+};
+
+class mov_rm_imm32_off32 : public Operation {
 private:
     REGISTER rmreg;
     int offset;
-    REGISTER from;
+    int imm;
+public:
+    mov_rm_imm32_off32(REGISTER rmreg, int offset, int imm) : rmreg(rmreg), offset(offset), imm(imm) {}
+
+    virtual void toNASM(FILE *output) {
+        fprintf(output, "    mov dword [%s%+d], %d\n", regToText(rmreg), offset, imm);
+    }
+
+    virtual void toBytecode(Bytecode &buf) {
+        buf.append_byte(0xc7); // Opcode
+        buf.append_byte(0b10000000 | rmreg);
+        if(rmreg == ESP)
+            buf.append_byte(0x24);
+
+        buf.append(offset);
+        buf.append(imm);
+    }
+
+    virtual int getSize() {
+        if(rmreg == ESP)
+            return 11;
+
+        return 10;
+    }
+};
+
+class mov_rm_reg_off32 : public Store {
 public:
-    mov_rm_reg_off32(REGISTER rmreg, int offset, REGISTER from) : rmreg(rmreg), offset(offset), from(from) {}
+    mov_rm_reg_off32(REGISTER rmreg, int offset, REGISTER from) : Store(rmreg, offset, from) {}
 
     virtual void toNASM(FILE *output) {
         fprintf(output, "    mov [%s%+d], %s\n", regToText(rmreg), offset, regToText(from));
@@ -305,13 +620,9 @@ public:
     }
 };
 
-class mov_reg_rm_off8 : public Operation {
-private:
-    REGISTER rmreg;
-    char offset;
-    REGISTER to;
+class mov_reg_rm_off8 : public Load {
 public:
-    mov_reg_rm_off8(REGISTER to, REGISTER rmreg, char offset) : rmreg(rmreg), offset(offset), to(to) {}
+    mov_reg_rm_off8(REGISTER to, REGISTER rmreg, char offset) : Load(to, rmreg, offset) {}
 
     virtual void toNASM(FILE *output) {
         fprintf(output, "    mov %s, [%s%+d]\n", regToText(to), regToText(rmreg), offset);
@@ -329,7 +640,7 @@ public:
         if(rmreg == ESP)
             buf.append_byte(0x24);
 
-        buf.append(offset);
+        buf.append(static_cast<char>(offset));
     }
 
     virtual int getSize() {
@@ -340,13 +651,9 @@ public:
     }
 };
 
-class mov_reg_rm_off32 : public Operation {
-private:
-    REGISTER rmreg;
-    int offset;
-    REGISTER to;
+class mov_reg_rm_off32 : public Load {
 public:
-    mov_reg_rm_off32(REGISTER to, REGISTER rmreg, int offset) : rmreg(rmreg), offset(offset), to(to) {}
+    mov_reg_rm_off32(REGISTER to, REGISTER rmreg, int offset) : Load(to, rmreg, offset) {}
 
     virtual void toNASM(FILE *output) {
         fprintf(output, "    mov %s, [%s%+d]\n", regToText(to), regToText(rmreg), offset);
@@ -374,7 +681,7 @@ public:
 };
 
 class call : public Operation {
-private:
+protected:
     int listingId;
     int offset;
 public:
@@ -406,6 +713,20 @@ public:
     }
 };
 
+class jmp_listing : public call { // Tail call: callee returns straight to our caller
+public:
+    explicit jmp_listing(int listingId) : call(listingId) {}
+
+    virtual void toNASM(FILE *output) {
+        fprintf(output, "    jmp listing%d\n", listingId);
+    }
+
+    virtual void toBytecode(Bytecode &buf) {
+        buf.append_byte(0xe9); // JMP rel32 instruction opcode
+        buf.append(offset); // Relative shift
+    }
+};
+
 class ret : public Operation {
 private:
 
@@ -447,25 +768,50 @@ class Jump : public Operation {
 protected:
     int offset;
     int labelId;
+    bool isShort;                                                   // Use rel8 form instead of rel32
 
     void JccBytecode(Bytecode &buf, unsigned char cc) {
-        buf.append_byte(0x0F);
-        buf.append(cc);
-        buf.append(offset);
+        if (isShort) {
+            buf.append_byte(cc - 0x10); // 7x rel8
+            buf.append(static_cast<char>(offset));
+        } else {
+            buf.append_byte(0x0F);
+            buf.append(cc);
+            buf.append(offset);
+        }
+    }
+
+    const char *distance() {
+        return isShort ? "short " : "";
     }
 
 public:
-    explicit Jump(int labelId) : labelId(labelId) {}
+    explicit Jump(int labelId) : offset(0), labelId(labelId), isShort(false) {}
 
     int getLabelId() {
         return labelId;
     }
 
+    virtual bool isConditional() {
+        return true;
+    }
+
     void setOffset(int offset) {
         this->offset = offset;
     }
 
+    bool isShortForm() {
+        return isShort;
+    }
+
+    void setShortForm(bool isShort) {
+        this->isShort = isShort;
+    }
+
     virtual int getSize() {
+        if (isShort)
+            return 2;
+
         return 6;
     }
 
@@ -478,16 +824,28 @@ class jmp : public Jump {
 public:
     explicit jmp(int labelId) : Jump(labelId) {}
 
+    virtual bool isConditional() {
+        return false;
+    }
+
     virtual void toNASM(FILE *output) {
-        fprintf(output, "    jmp .label%d\n", labelId);
+        fprintf(output, "    jmp %s.label%d\n", distance(), labelId);
     }
 
     virtual void toBytecode(Bytecode &buf) {
-        buf.append_byte(0xe9); // Relative jump opcode
-        buf.append(offset); // Jump offset
+        if (isShort) {
+            buf.append_byte(0xeb); // Short relative jump opcode
+            buf.append(static_cast<char>(offset));
+        } else {
+            buf.append_byte(0xe9); // Relative jump opcode
+            buf.append(offset); // Jump offset
+        }
     }
 
     virtual int getSize() {
+        if (isShort)
+            return 2;
+
         return 5;
     }
 };
@@ -497,7 +855,7 @@ public:
     explicit jg(int labelId) : Jump(labelId) {}
 
     virtual void toNASM(FILE *output) {
-        fprintf(output, "    jg .label%d\n", labelId);
+        fprintf(output, "    jg %s.label%d\n", distance(), labelId);
     }
 
     virtual void toBytecode(Bytecode &buf) {
@@ -510,7 +868,7 @@ public:
     explicit jge(int labelId) : Jump(labelId) {}
 
     virtual void toNASM(FILE *output) {
-        fprintf(output, "    jge .label%d\n", labelId);
+        fprintf(output, "    jge %s.label%d\n", distance(), labelId);
     }
 
     virtual void toBytecode(Bytecode &buf) {
@@ -523,7 +881,7 @@ public:
     explicit jl(int labelId) : Jump(labelId) {}
 
     virtual void toNASM(FILE *output) {
-        fprintf(output, "    jl .label%d\n", labelId);
+        fprintf(output, "    jl %s.label%d\n", distance(), labelId);
     }
 
     virtual void toBytecode(Bytecode &buf) {
@@ -536,7 +894,7 @@ public:
     explicit jle(int labelId) : Jump(labelId) {}
 
     virtual void toNASM(FILE *output) {
-        fprintf(output, "    jle .label%d\n", labelId);
+        fprintf(output, "    jle %s.label%d\n", distance(), labelId);
     }
 
     virtual void toBytecode(Bytecode &buf) {
@@ -549,7 +907,7 @@ public:
     explicit je(int labelId) : Jump(labelId) {}
 
     virtual void toNASM(FILE *output) {
-        fprintf(output, "    je .label%d\n", labelId);
+        fprintf(output, "    je %s.label%d\n", distance(), labelId);
     }
 
     virtual void toBytecode(Bytecode &buf) {
@@ -562,7 +920,7 @@ public:
     explicit jne(int labelId) : Jump(labelId) {}
 
     virtual void toNASM(FILE *output) {
-        fprintf(output, "    jne .label%d\n", labelId);
+        fprintf(output, "    jne %s.label%d\n", distance(), labelId);
     }
 
     virtual void toBytecode(Bytecode &buf) {
@@ -570,117 +928,263 @@ public:
     }
 };
 
-class comment : public Operation {
+class cmov_reg_reg : public Operation {
 private:
-    const char *msg;
+    CONDITION_CODE cc;
+    REGISTER to;
+    REGISTER what;
 public:
-    comment(const char *msg) : msg(msg) {}
+    cmov_reg_reg(CONDITION_CODE cc, REGISTER to, REGISTER what) : cc(cc), to(to), what(what) {}
 
     virtual void toNASM(FILE *output) {
-        fprintf(output, "    ; %s\n", msg);
+        fprintf(output, "    cmov%s %s, %s\n", ccToText(cc), regToText(to), regToText(what));
     }
 
-    virtual void toBytecode(Bytecode &buf) {}
+    virtual void toBytecode(Bytecode &buf) {
+        if (to <= EDI && what <= EDI) {
+            buf.append_byte(0x0f);
+            buf.append_byte(0x40 | cc);
+            buf.append_byte(0b11000000 | (to << 3) | what);
+        } else {
+            throw_exception("Non-32 bit CMOV is not supported");
+        }
+    }
 
     virtual int getSize() {
-        return 0;
+        return 3;
     }
 };
 
-class inc_reg : public Operation {
+class cmov_reg_rm_off8 : public Operation {
 private:
-    REGISTER reg;
+    CONDITION_CODE cc;
+    REGISTER to;
+    REGISTER ptr;
+    char offset;
 public:
-    inc_reg(REGISTER reg) : reg(reg) {}
+    cmov_reg_rm_off8(CONDITION_CODE cc, REGISTER to, REGISTER ptr, char offset) : cc(cc), to(to), ptr(ptr),
+                                                                                    offset(offset) {}
 
     virtual void toNASM(FILE *output) {
-        fprintf(output, "    inc %s\n", regToText(reg));
+        fprintf(output, "    cmov%s %s, [%s%+d]\n", ccToText(cc), regToText(to), regToText(ptr), offset);
     }
 
     virtual void toBytecode(Bytecode &buf) {
-        if (reg <= EDI) {
-            buf.append_byte(0x40 | reg);
+        if (to <= EDI && ptr <= EDI) {
+            buf.append_byte(0x0f);
+            buf.append_byte(0x40 | cc);
+            regMemBytecode(buf, to, ptr, offset, true);
         } else {
-            throw_exception("Increment of non-32-bit registers is not yet supported");
+            throw_exception("Non-32 bit CMOV is not supported");
         }
     }
 
     virtual int getSize() {
-        return 1;
+        return 2 + regMemSize(ptr, true);
     }
 };
 
-class inc_rm_off8 : public Operation {
+class cmov_reg_rm_off32 : public Operation {
 private:
-    REGISTER reg;
-    char offset;
+    CONDITION_CODE cc;
+    REGISTER to;
+    REGISTER ptr;
+    int offset;
 public:
-    inc_rm_off8(REGISTER reg, char offset) : reg(reg), offset(offset) {}
+    cmov_reg_rm_off32(CONDITION_CODE cc, REGISTER to, REGISTER ptr, int offset) : cc(cc), to(to), ptr(ptr),
+                                                                                    offset(offset) {}
 
     virtual void toNASM(FILE *output) {
-        fprintf(output, "    inc [%s%+d]\n", regToText(reg), offset);
+        fprintf(output, "    cmov%s %s, [%s%+d]\n", ccToText(cc), regToText(to), regToText(ptr), offset);
     }
 
     virtual void toBytecode(Bytecode &buf) {
-        if (reg <= EDI) {
-            buf.append_byte(0xff);
-            buf.append_byte(0b01000000 | reg);
-            if(reg == ESP) {
-                buf.append_byte(0x24);
-            }
-            buf.append(offset);
+        if (to <= EDI && ptr <= EDI) {
+            buf.append_byte(0x0f);
+            buf.append_byte(0x40 | cc);
+            regMemBytecode(buf, to, ptr, offset, false);
         } else {
-            throw_exception("Increment addresed by non-32-bit register is not yet supported");
+            throw_exception("Non-32 bit CMOV is not supported");
         }
     }
 
     virtual int getSize() {
-        if(reg == ESP)
-            return 4;
-
-        return 3;
+        return 2 + regMemSize(ptr, false);
     }
 };
 
-class inc_rm_off32 : public Operation {
+class setcc_reg : public Operation {
 private:
-    REGISTER reg;
-    int offset;
+    CONDITION_CODE cc;
+    REGISTER what;
 public:
-    inc_rm_off32(REGISTER reg, int offset) : reg(reg), offset(offset) {}
+    setcc_reg(CONDITION_CODE cc, REGISTER what) : cc(cc), what(what) {}
 
     virtual void toNASM(FILE *output) {
-        fprintf(output, "    inc [%s%+d]\n", regToText(reg), offset);
+        fprintf(output, "    set%s %s\n", ccToText(cc), regToText(what));
     }
 
     virtual void toBytecode(Bytecode &buf) {
-        if (reg <= EDI) {
-            buf.append_byte(0xff);
-            buf.append_byte(0b10000000 | reg);
-            buf.append(offset);
+        if (what >= AL) {
+            buf.append_byte(0x0f);
+            buf.append_byte(0x90 | cc);
+            buf.append_byte(0b11000000 | (what - AL));
         } else {
-            throw_exception("Increment addresed by non-32-bit register is not yet supported");
+            throw_exception("SETcc writes only 8-bit registers");
         }
     }
 
     virtual int getSize() {
-
-        return 7;
+        return 3;
     }
 };
 
-class dec_reg : public Operation {
+class movzx_reg_reg : public Operation {
 private:
-    REGISTER reg;
+    REGISTER to;
+    REGISTER what;
 public:
-    dec_reg(REGISTER reg) : reg(reg) {}
+    movzx_reg_reg(REGISTER to, REGISTER what) : to(to), what(what) {}
 
     virtual void toNASM(FILE *output) {
-        fprintf(output, "    dec %s\n", regToText(reg));
+        fprintf(output, "    movzx %s, %s\n", regToText(to), regToText(what));
     }
 
     virtual void toBytecode(Bytecode &buf) {
-        if (reg <= EDI) {
+        if (to <= EDI && what >= AL) {
+            buf.append_byte(0x0f);
+            buf.append_byte(0xb6);
+            buf.append_byte(0b11000000 | (to << 3) | (what - AL));
+        } else {
+            throw_exception("MOVZX extends only 8-bit registers into 32-bit ones");
+        }
+    }
+
+    virtual int getSize() {
+        return 3;
+    }
+};
+
+class comment : public Operation {
+private:
+    const char *msg;
+public:
+    comment(const char *msg) : msg(msg) {}
+
+    virtual void toNASM(FILE *output) {
+        fprintf(output, "    ; %s\n", msg);
+    }
+
+    virtual void toBytecode(Bytecode &buf) {}
+
+    virtual int getSize() {
+        return 0;
+    }
+
+    virtual OP_TYPE getType() {
+        return COMMENT_OP;
+    }
+};
+
+class inc_reg : public Operation {
+private:
+    REGISTER reg;
+public:
+    inc_reg(REGISTER reg) : reg(reg) {}
+
+    virtual void toNASM(FILE *output) {
+        fprintf(output, "    inc %s\n", regToText(reg));
+    }
+
+    virtual void toBytecode(Bytecode &buf) {
+        if (reg <= EDI) {
+            buf.append_byte(0x40 | reg);
+        } else {
+            throw_exception("Increment of non-32-bit registers is not yet supported");
+        }
+    }
+
+    virtual int getSize() {
+        return 1;
+    }
+};
+
+class inc_rm_off8 : public Operation {
+private:
+    REGISTER reg;
+    char offset;
+public:
+    inc_rm_off8(REGISTER reg, char offset) : reg(reg), offset(offset) {}
+
+    virtual void toNASM(FILE *output) {
+        fprintf(output, "    inc dword [%s%+d]\n", regToText(reg), offset);
+    }
+
+    virtual void toBytecode(Bytecode &buf) {
+        if (reg <= EDI) {
+            buf.append_byte(0xff);
+            buf.append_byte(0b01000000 | reg);
+            if(reg == ESP) {
+                buf.append_byte(0x24);
+            }
+            buf.append(offset);
+        } else {
+            throw_exception("Increment addresed by non-32-bit register is not yet supported");
+        }
+    }
+
+    virtual int getSize() {
+        if(reg == ESP)
+            return 4;
+
+        return 3;
+    }
+};
+
+class inc_rm_off32 : public Operation {
+private:
+    REGISTER reg;
+    int offset;
+public:
+    inc_rm_off32(REGISTER reg, int offset) : reg(reg), offset(offset) {}
+
+    virtual void toNASM(FILE *output) {
+        fprintf(output, "    inc dword [%s%+d]\n", regToText(reg), offset);
+    }
+
+    virtual void toBytecode(Bytecode &buf) {
+        if (reg <= EDI) {
+            buf.append_byte(0xff);
+            buf.append_byte(0b10000000 | reg);
+            if(reg == ESP) {
+                buf.append_byte(0x24);
+            }
+            buf.append(offset);
+        } else {
+            throw_exception("Increment addresed by non-32-bit register is not yet supported");
+        }
+    }
+
+    virtual int getSize() {
+        if(reg == ESP)
+            return 7;
+
+        return 6;
+    }
+};
+
+class dec_reg : public Operation {
+private:
+    REGISTER reg;
+public:
+    dec_reg(REGISTER reg) : reg(reg) {}
+
+    virtual void toNASM(FILE *output) {
+        fprintf(output, "    dec %s\n", regToText(reg));
+    }
+
+    virtual void toBytecode(Bytecode &buf) {
+        if (reg <= EDI) {
             buf.append_byte(0x48 | reg);
         } else {
             throw_exception("Increment of non-32-bit registers is not yet supported");
@@ -700,13 +1204,16 @@ public:
     dec_rm_off8(REGISTER reg, char offset) : reg(reg), offset(offset) {}
 
     virtual void toNASM(FILE *output) {
-        fprintf(output, "    dec [%s%+d]\n", regToText(reg), offset);
+        fprintf(output, "    dec dword [%s%+d]\n", regToText(reg), offset);
     }
 
     virtual void toBytecode(Bytecode &buf) {
         if (reg <= EDI) {
             buf.append_byte(0xff);
             buf.append_byte(0b01001000 | reg);
+            if(reg == ESP) {
+                buf.append_byte(0x24);
+            }
             buf.append(offset);
         } else {
             throw_exception("Decrement addresed by non-32-bit register is not yet supported");
@@ -714,7 +1221,10 @@ public:
     }
 
     virtual int getSize() {
-        return 4;
+        if(reg == ESP)
+            return 4;
+
+        return 3;
     }
 };
 
@@ -726,13 +1236,16 @@ public:
     dec_rm_off32(REGISTER reg, int offset) : reg(reg), offset(offset) {}
 
     virtual void toNASM(FILE *output) {
-        fprintf(output, "    dec [%s%+d]\n", regToText(reg), offset);
+        fprintf(output, "    dec dword [%s%+d]\n", regToText(reg), offset);
     }
 
     virtual void toBytecode(Bytecode &buf) {
         if (reg <= EDI) {
             buf.append_byte(0xff);
             buf.append_byte(0b10001000 | reg);
+            if(reg == ESP) {
+                buf.append_byte(0x24);
+            }
             buf.append(offset);
         } else {
             throw_exception("Increment addresed by non-32-bit register is not yet supported");
@@ -740,7 +1253,10 @@ public:
     }
 
     virtual int getSize() {
-        return 7;
+        if(reg == ESP)
+            return 7;
+
+        return 6;
     }
 };
 
@@ -759,7 +1275,695 @@ public:
             buf.append_byte(0xf7);
             buf.append_byte(0b11111000 | divisor);
         } else {
-            throw_exception("Non-32 bit IDIV is not yet supported");
+            throw_exception("Non-32 bit IDIV is not yet supported");
+        }
+    }
+
+    virtual int getSize() {
+        return 2;
+    }
+};
+
+class cdq : public Operation {
+public:
+    virtual void toNASM(FILE *output) {
+        fprintf(output, "    cdq\n");
+    }
+
+    virtual void toBytecode(Bytecode &buf) {
+        buf.append_byte(0x99);
+    }
+
+    virtual int getSize() {
+        return 1;
+    }
+};
+
+class imul_reg : public Operation {
+private:
+    REGISTER multiplier;
+public:
+    imul_reg(REGISTER multiplier) : multiplier(multiplier) {}
+
+    virtual void toNASM(FILE *output) {
+        fprintf(output, "    imul %s\n", regToText(multiplier));
+    }
+
+    virtual void toBytecode(Bytecode &buf) {
+        if (multiplier <= EDI) {
+            buf.append_byte(0xf7);
+            buf.append_byte(0b11101000 | multiplier);
+        } else {
+            throw_exception("Non-32 bit IMUL is not yet supported");
+        }
+    }
+
+    virtual int getSize() {
+        return 2;
+    }
+};
+
+class imul_reg_reg : public Operation {
+private:
+    REGISTER to;
+    REGISTER what;
+public:
+    imul_reg_reg(REGISTER to, REGISTER what) : to(to), what(what) {}
+
+    virtual void toNASM(FILE *output) {
+        fprintf(output, "    imul %s, %s\n", regToText(to), regToText(what));
+    }
+
+    virtual void toBytecode(Bytecode &buf) {
+        if (to <= EDI && what <= EDI) {
+            buf.append_byte(0x0f);
+            buf.append_byte(0xaf);
+            buf.append_byte(0b11000000 | (to << 3) | what);
+        } else {
+            throw_exception("Non-32 bit IMUL is not yet supported");
+        }
+    }
+
+    virtual int getSize() {
+        return 3;
+    }
+};
+
+class imul_reg_rm_off8 : public Operation {
+private:
+    REGISTER to;
+    REGISTER ptr;
+    char offset;
+public:
+    imul_reg_rm_off8(REGISTER to, REGISTER ptr, char offset) : to(to), ptr(ptr), offset(offset) {}
+
+    virtual void toNASM(FILE *output) {
+        fprintf(output, "    imul %s, [%s%+d]\n", regToText(to), regToText(ptr), offset);
+    }
+
+    virtual void toBytecode(Bytecode &buf) {
+        if (to <= EDI && ptr <= EDI) {
+            buf.append_byte(0x0f);
+            buf.append_byte(0xaf);
+            regMemBytecode(buf, to, ptr, offset, true);
+        } else {
+            throw_exception("Non-32 bit IMUL is not yet supported");
+        }
+    }
+
+    virtual int getSize() {
+        return 2 + regMemSize(ptr, true);
+    }
+};
+
+class imul_reg_rm_off32 : public Operation {
+private:
+    REGISTER to;
+    REGISTER ptr;
+    int offset;
+public:
+    imul_reg_rm_off32(REGISTER to, REGISTER ptr, int offset) : to(to), ptr(ptr), offset(offset) {}
+
+    virtual void toNASM(FILE *output) {
+        fprintf(output, "    imul %s, [%s%+d]\n", regToText(to), regToText(ptr), offset);
+    }
+
+    virtual void toBytecode(Bytecode &buf) {
+        if (to <= EDI && ptr <= EDI) {
+            buf.append_byte(0x0f);
+            buf.append_byte(0xaf);
+            regMemBytecode(buf, to, ptr, offset, false);
+        } else {
+            throw_exception("Non-32 bit IMUL is not yet supported");
+        }
+    }
+
+    virtual int getSize() {
+        return 2 + regMemSize(ptr, false);
+    }
+};
+
+class imul_reg_reg_imm : public Operation {
+private:
+    REGISTER to;
+    REGISTER what;
+    int value;
+public:
+    imul_reg_reg_imm(REGISTER to, REGISTER what, int value) : to(to), what(what), value(value) {}
+
+    virtual void toNASM(FILE *output) {
+        fprintf(output, "    imul %s, %s, %d\n", regToText(to), regToText(what), value);
+    }
+
+    virtual void toBytecode(Bytecode &buf) {
+        if (to <= EDI && what <= EDI) {
+            buf.append_byte(fitsInByte(value) ? 0x6b : 0x69);
+            buf.append_byte(0b11000000 | (to << 3) | what);
+            if (fitsInByte(value)) {
+                buf.append(static_cast<char>(value));
+            } else {
+                buf.append(value);
+            }
+        } else {
+            throw_exception("Non-32 bit IMUL is not yet supported");
+        }
+    }
+
+    virtual int getSize() {
+        return fitsInByte(value) ? 3 : 6;
+    }
+};
+
+class imul_reg_rm_imm_off8 : public Operation {
+private:
+    REGISTER to;
+    REGISTER ptr;
+    char offset;
+    int value;
+public:
+    imul_reg_rm_imm_off8(REGISTER to, REGISTER ptr, char offset, int value) : to(to), ptr(ptr), offset(offset),
+                                                                             value(value) {}
+
+    virtual void toNASM(FILE *output) {
+        fprintf(output, "    imul %s, [%s%+d], %d\n", regToText(to), regToText(ptr), offset, value);
+    }
+
+    virtual void toBytecode(Bytecode &buf) {
+        if (to <= EDI && ptr <= EDI) {
+            buf.append_byte(fitsInByte(value) ? 0x6b : 0x69);
+            buf.append_byte(0b01000000 | (to << 3) | ptr);
+            if (ptr == ESP)
+                buf.append_byte(0x24);
+
+            buf.append(offset);
+            if (fitsInByte(value)) {
+                buf.append(static_cast<char>(value));
+            } else {
+                buf.append(value);
+            }
+        } else {
+            throw_exception("Non-32 bit IMUL is not yet supported");
+        }
+    }
+
+    virtual int getSize() {
+        return 3 + (ptr == ESP) + (fitsInByte(value) ? 1 : 4);
+    }
+};
+
+class imul_reg_rm_imm_off32 : public Operation {
+private:
+    REGISTER to;
+    REGISTER ptr;
+    int offset;
+    int value;
+public:
+    imul_reg_rm_imm_off32(REGISTER to, REGISTER ptr, int offset, int value) : to(to), ptr(ptr), offset(offset),
+                                                                             value(value) {}
+
+    virtual void toNASM(FILE *output) {
+        fprintf(output, "    imul %s, [%s%+d], %d\n", regToText(to), regToText(ptr), offset, value);
+    }
+
+    virtual void toBytecode(Bytecode &buf) {
+        if (to <= EDI && ptr <= EDI) {
+            buf.append_byte(fitsInByte(value) ? 0x6b : 0x69);
+            buf.append_byte(0b10000000 | (to << 3) | ptr);
+            if (ptr == ESP)
+                buf.append_byte(0x24);
+
+            buf.append(offset);
+            if (fitsInByte(value)) {
+                buf.append(static_cast<char>(value));
+            } else {
+                buf.append(value);
+            }
+        } else {
+            throw_exception("Non-32 bit IMUL is not yet supported");
+        }
+    }
+
+    virtual int getSize() {
+        return 6 + (ptr == ESP) + (fitsInByte(value) ? 1 : 4);
+    }
+};
+
+class add_reg_reg : public Operation {
+private:
+    REGISTER to;
+    REGISTER what;
+public:
+    add_reg_reg(REGISTER to, REGISTER what) : to(to), what(what) {}
+
+    virtual void toNASM(FILE *output) {
+        fprintf(output, "    add %s, %s\n", regToText(to), regToText(what));
+    }
+
+    virtual void toBytecode(Bytecode &buf) {
+        if (to <= EDI && what <= EDI) {
+            buf.append_byte(0x01);
+            buf.append_byte(0b11000000 | (what << 3) | to);
+        } else {
+            throw_exception("Non-32-bit exceptions are not yet supported");
+        }
+    }
+
+    virtual int getSize() {
+        return 2;
+    }
+};
+
+class add_reg_imm : public Operation {
+private:
+    REGISTER to;
+    int value;
+public:
+    add_reg_imm(REGISTER to, int value) : to(to), value(value) {}
+
+    virtual void toNASM(FILE *output) {
+        fprintf(output, "    add %s, %d\n", regToText(to), value);
+    }
+
+    virtual void toBytecode(Bytecode &buf) {
+        if (to <= EDI) {
+            regImmBytecode(buf, 0, to, value);
+        } else {
+            throw_exception("Addition to non-32-bit registers is not supported");
+        }
+    }
+
+    virtual int getSize() {
+        return regImmSize(to, value);
+    }
+};
+
+class add_reg_rm_off8 : public Operation {
+private:
+    REGISTER to;
+    REGISTER ptr;
+    char offset;
+public:
+    add_reg_rm_off8(REGISTER to, REGISTER ptr, char offset) : to(to), ptr(ptr), offset(offset) {}
+
+    virtual void toNASM(FILE *output) {
+        fprintf(output, "    add %s, [%s%+d]\n", regToText(to), regToText(ptr), offset);
+    }
+
+    virtual void toBytecode(Bytecode &buf) {
+        if (to <= EDI && ptr <= EDI) {
+            buf.append_byte(0x03);
+            regMemBytecode(buf, to, ptr, offset, true);
+        } else {
+            throw_exception("Only 32-bit registers support addition from memory");
+        }
+    }
+
+    virtual int getSize() {
+        return 1 + regMemSize(ptr, true);
+    }
+};
+
+class add_reg_rm_off32 : public Operation {
+private:
+    REGISTER to;
+    REGISTER ptr;
+    int offset;
+public:
+    add_reg_rm_off32(REGISTER to, REGISTER ptr, int offset) : to(to), ptr(ptr), offset(offset) {}
+
+    virtual void toNASM(FILE *output) {
+        fprintf(output, "    add %s, [%s%+d]\n", regToText(to), regToText(ptr), offset);
+    }
+
+    virtual void toBytecode(Bytecode &buf) {
+        if (to <= EDI && ptr <= EDI) {
+            buf.append_byte(0x03);
+            regMemBytecode(buf, to, ptr, offset, false);
+        } else {
+            throw_exception("Only 32-bit registers support addition from memory");
+        }
+    }
+
+    virtual int getSize() {
+        return 1 + regMemSize(ptr, false);
+    }
+};
+
+class add_rm_imm_off8 : public Operation {
+private:
+    REGISTER ptr;
+    char offset;
+    int value;
+public:
+    add_rm_imm_off8(REGISTER ptr, char offset, int value) : ptr(ptr), offset(offset), value(value) {}
+
+    virtual void toNASM(FILE *output) {
+        fprintf(output, "    add dword [%s%+d], %d\n", regToText(ptr), offset, value);
+    };
+
+    virtual void toBytecode(Bytecode &buf) {
+        if(ptr <= EDI) {
+            memImmBytecode(buf, 0, ptr, offset, true, value);
+        } else {
+            throw_exception("Non-32-bit register adressing is not supported");
+        }
+    }
+
+    virtual int getSize() {
+        return memImmSize(ptr, true, value);
+    }
+};
+
+class add_rm_imm_off32 : public Operation {
+private:
+    REGISTER ptr;
+    int offset;
+    int value;
+public:
+    add_rm_imm_off32(REGISTER ptr, int offset, int value) : ptr(ptr), offset(offset), value(value) {}
+
+    virtual void toNASM(FILE *output) {
+        fprintf(output, "    add dword [%s%+d], %d\n", regToText(ptr), offset, value);
+    };
+
+    virtual void toBytecode(Bytecode &buf) {
+        if(ptr <= EDI) {
+            memImmBytecode(buf, 0, ptr, offset, false, value);
+        } else {
+            throw_exception("Non-32-bit register adressing is not supported");
+        }
+    }
+
+    virtual int getSize() {
+        return memImmSize(ptr, false, value);
+    }
+};
+
+class pop_reg : public Operation {
+private:
+    REGISTER reg;
+public:
+    pop_reg(REGISTER reg) : reg(reg) {}
+
+    REGISTER getRegister() {
+        return reg;
+    }
+
+    virtual void toNASM(FILE *output) {
+        fprintf(output, "    pop %s\n", regToText(reg));
+    }
+
+    virtual void toBytecode(Bytecode &buf) {
+        if(reg <= EDI) {
+            buf.append_byte(0x58 | reg);
+        } else {
+            throw_exception("Popping non-32-bit register is not yet supported");
+        }
+    }
+
+    virtual int getSize() {
+        return 1;
+    }
+
+    virtual OP_TYPE getType() {
+        return POP_OP;
+    }
+};
+
+class push_reg : public Operation {
+private:
+    REGISTER reg;
+public:
+    push_reg(REGISTER reg) : reg(reg) {}
+
+    REGISTER getRegister() {
+        return reg;
+    }
+
+    virtual void toNASM(FILE *output) {
+        fprintf(output, "    push %s\n", regToText(reg));
+    }
+
+    virtual void toBytecode(Bytecode &buf) {
+        if(reg <= EDI) {
+            buf.append_byte(0x50 | reg);
+        } else {
+            throw_exception("Pushing non-32-bit register is not yet supported");
+        }
+    }
+
+    virtual int getSize() {
+        return 1;
+    }
+
+    virtual OP_TYPE getType() {
+        return PUSH_OP;
+    }
+};
+
+class push_imm : public Operation {
+private:
+    int value;
+public:
+    push_imm(int value) : value(value) {}
+
+    virtual void toNASM(FILE *output) {
+        fprintf(output, "    push dword %d\n", value);
+    }
+
+    virtual void toBytecode(Bytecode &buf) {
+        if (fitsInByte(value)) {
+            buf.append_byte(0x6a); // Sign-extended imm8
+            buf.append(static_cast<char>(value));
+        } else {
+            buf.append_byte(0x68);
+            buf.append(value);
+        }
+    }
+
+    virtual int getSize() {
+        return fitsInByte(value) ? 2 : 5;
+    }
+};
+
+class push_rm_off8 : public Operation {
+private:
+    REGISTER ptr;
+    char offset;
+public:
+    push_rm_off8(REGISTER ptr, char offset) : ptr(ptr), offset(offset) {}
+
+    virtual void toNASM(FILE *output) {
+        fprintf(output, "    push dword [%s%+d]\n", regToText(ptr), offset);
+    }
+
+    virtual void toBytecode(Bytecode &buf) {
+        if (ptr <= EDI) {
+            buf.append_byte(0xff);
+            regMemBytecode(buf, 6, ptr, offset, true);
+        } else {
+            throw_exception("Non-32-bit register adressing is not supported");
+        }
+    }
+
+    virtual int getSize() {
+        return 1 + regMemSize(ptr, true);
+    }
+};
+
+class push_rm_off32 : public Operation {
+private:
+    REGISTER ptr;
+    int offset;
+public:
+    push_rm_off32(REGISTER ptr, int offset) : ptr(ptr), offset(offset) {}
+
+    virtual void toNASM(FILE *output) {
+        fprintf(output, "    push dword [%s%+d]\n", regToText(ptr), offset);
+    }
+
+    virtual void toBytecode(Bytecode &buf) {
+        if (ptr <= EDI) {
+            buf.append_byte(0xff);
+            regMemBytecode(buf, 6, ptr, offset, false);
+        } else {
+            throw_exception("Non-32-bit register adressing is not supported");
+        }
+    }
+
+    virtual int getSize() {
+        return 1 + regMemSize(ptr, false);
+    }
+};
+
+class sub_reg_reg : public Operation {
+private:
+    REGISTER to;
+    REGISTER what;
+public:
+    sub_reg_reg(REGISTER to, REGISTER what) : to(to), what(what) {}
+
+    virtual void toNASM(FILE *output) {
+        fprintf(output, "    sub %s, %s\n", regToText(to), regToText(what));
+    }
+
+    virtual void toBytecode(Bytecode &buf) {
+        if (to <= EDI && what <= EDI) {
+            buf.append_byte(0x29);
+            buf.append_byte(0b11000000 | (what << 3) | to);
+        } else {
+            throw_exception("Non-32-bit exceptions are not yet supported");
+        }
+    }
+
+    virtual int getSize() {
+        return 2;
+    }
+};
+
+class sub_reg_imm : public Operation {
+private:
+    REGISTER to;
+    int value;
+public:
+    sub_reg_imm(REGISTER to, int value) : to(to), value(value) {}
+
+    virtual void toNASM(FILE *output) {
+        fprintf(output, "    sub %s, %d\n", regToText(to), value);
+    }
+
+    virtual void toBytecode(Bytecode &buf) {
+        if (to <= EDI) {
+            regImmBytecode(buf, 5, to, value);
+        } else {
+            throw_exception("Subtraction from non-32-bit registers is not supported");
+        }
+    }
+
+    virtual int getSize() {
+        return regImmSize(to, value);
+    }
+};
+
+class sub_reg_rm_off8 : public Operation {
+private:
+    REGISTER to;
+    REGISTER ptr;
+    char offset;
+public:
+    sub_reg_rm_off8(REGISTER to, REGISTER ptr, char offset) : to(to), ptr(ptr), offset(offset) {}
+
+    virtual void toNASM(FILE *output) {
+        fprintf(output, "    sub %s, [%s%+d]\n", regToText(to), regToText(ptr), offset);
+    }
+
+    virtual void toBytecode(Bytecode &buf) {
+        if (to <= EDI && ptr <= EDI) {
+            buf.append_byte(0x2b);
+            regMemBytecode(buf, to, ptr, offset, true);
+        } else {
+            throw_exception("Only 32-bit registers support subtraction from memory");
+        }
+    }
+
+    virtual int getSize() {
+        return 1 + regMemSize(ptr, true);
+    }
+};
+
+class sub_reg_rm_off32 : public Operation {
+private:
+    REGISTER to;
+    REGISTER ptr;
+    int offset;
+public:
+    sub_reg_rm_off32(REGISTER to, REGISTER ptr, int offset) : to(to), ptr(ptr), offset(offset) {}
+
+    virtual void toNASM(FILE *output) {
+        fprintf(output, "    sub %s, [%s%+d]\n", regToText(to), regToText(ptr), offset);
+    }
+
+    virtual void toBytecode(Bytecode &buf) {
+        if (to <= EDI && ptr <= EDI) {
+            buf.append_byte(0x2b);
+            regMemBytecode(buf, to, ptr, offset, false);
+        } else {
+            throw_exception("Only 32-bit registers support subtraction from memory");
+        }
+    }
+
+    virtual int getSize() {
+        return 1 + regMemSize(ptr, false);
+    }
+};
+
+class sub_rm_imm_off8 : public Operation {
+private:
+    REGISTER ptr;
+    char offset;
+    int value;
+public:
+    sub_rm_imm_off8(REGISTER ptr, char offset, int value) : ptr(ptr), offset(offset), value(value) {}
+
+    virtual void toNASM(FILE *output) {
+        fprintf(output, "    sub dword [%s%+d], %d\n", regToText(ptr), offset, value);
+    };
+
+    virtual void toBytecode(Bytecode &buf) {
+        if(ptr <= EDI) {
+            memImmBytecode(buf, 5, ptr, offset, true, value);
+        } else {
+            throw_exception("Non-32-bit register adressing is not supported");
+        }
+    }
+
+    virtual int getSize() {
+        return memImmSize(ptr, true, value);
+    }
+};
+
+class sub_rm_imm_off32 : public Operation {
+private:
+    REGISTER ptr;
+    int offset;
+    int value;
+public:
+    sub_rm_imm_off32(REGISTER ptr, int offset, int value) : ptr(ptr), offset(offset), value(value) {}
+
+    virtual void toNASM(FILE *output) {
+        fprintf(output, "    sub dword [%s%+d], %d\n", regToText(ptr), offset, value);
+    };
+
+    virtual void toBytecode(Bytecode &buf) {
+        if(ptr <= EDI) {
+            memImmBytecode(buf, 5, ptr, offset, false, value);
+        } else {
+            throw_exception("Non-32-bit register adressing is not supported");
+        }
+    }
+
+    virtual int getSize() {
+        return memImmSize(ptr, false, value);
+    }
+};
+
+class cmp_reg_reg : public Operation {
+private:
+    REGISTER first;
+    REGISTER second;
+public:
+    cmp_reg_reg(REGISTER first, REGISTER second) : first(first), second(second) {}
+
+    virtual void toNASM(FILE *output) {
+        fprintf(output, "    cmp %s, %s\n", regToText(first), regToText(second));
+    }
+
+    virtual void toBytecode(Bytecode &buf) {
+        if(first <= EDI && second <= EDI) {
+            buf.append_byte(0x39);
+            buf.append_byte(0b11000000 | (second << 3) | first);
+        } else {
+            throw_exception("Can only compare 32-bit integers");
         }
     }
 
@@ -768,334 +1972,356 @@ public:
     }
 };
 
-class imul_reg : public Operation {
+class cmp_reg_imm : public Operation {
 private:
-    REGISTER multiplier;
+    REGISTER first;
+    int second;
 public:
-    imul_reg(REGISTER multiplier) : multiplier(multiplier) {}
+    cmp_reg_imm(REGISTER first, int second) : first(first), second(second) {}
 
     virtual void toNASM(FILE *output) {
-        fprintf(output, "    imul %s\n", regToText(multiplier));
+        fprintf(output, "    cmp %s, %d\n", regToText(first), second);
     }
 
     virtual void toBytecode(Bytecode &buf) {
-        if (multiplier <= EDI) {
-            buf.append_byte(0xf7);
-            buf.append_byte(0b11101000 | multiplier);
+        if (first <= EDI) {
+            regImmBytecode(buf, 7, first, second);
         } else {
-            throw_exception("Non-32 bit IMUL is not yet supported");
+            throw_exception("Only 32-bit registers support comparison yet");
         }
     }
 
     virtual int getSize() {
-        return 2;
+        return regImmSize(first, second);
     }
 };
 
-class add_reg_reg : public Operation {
+class cmp_reg_rm_off8 : public Operation {
 private:
-    REGISTER to;
-    REGISTER what;
+    REGISTER first;
+    REGISTER ptr;
+    char offset;
 public:
-    add_reg_reg(REGISTER to, REGISTER what) : to(to), what(what) {}
+    cmp_reg_rm_off8(REGISTER first, REGISTER ptr, char offset) : first(first), ptr(ptr), offset(offset) {}
 
     virtual void toNASM(FILE *output) {
-        fprintf(output, "    add %s, %s\n", regToText(to), regToText(what));
+        fprintf(output, "    cmp %s, [%s%+d]\n", regToText(first), regToText(ptr), offset);
     }
 
     virtual void toBytecode(Bytecode &buf) {
-        if (to <= EDI && what <= EDI) {
-            buf.append_byte(0x01);
-            buf.append_byte(0b11000000 | (what << 3) | to);
+        if(first <= EDI && ptr <= EDI) {
+            buf.append_byte(0x3b);
+            buf.append_byte(0b01000000 | (first << 3) | ptr);
+            if(ptr == ESP)
+                buf.append_byte(0x24);
+
+            buf.append(offset);
         } else {
-            throw_exception("Non-32-bit exceptions are not yet supported");
+            throw_exception("Can only compare 32-bit integers");
         }
     }
 
     virtual int getSize() {
-        return 2;
+        if(ptr == ESP)
+            return 4;
+
+        return 3;
     }
 };
 
-class add_reg_imm : public Operation {
+class cmp_reg_rm_off32 : public Operation {
 private:
-    REGISTER to;
-    int value;
+    REGISTER first;
+    REGISTER ptr;
+    int offset;
 public:
-    add_reg_imm(REGISTER to, int value) : to(to), value(value) {}
+    cmp_reg_rm_off32(REGISTER first, REGISTER ptr, int offset) : first(first), ptr(ptr), offset(offset) {}
 
     virtual void toNASM(FILE *output) {
-        fprintf(output, "    add %s, %d\n", regToText(to), value);
-    };
+        fprintf(output, "    cmp %s, [%s%+d]\n", regToText(first), regToText(ptr), offset);
+    }
 
     virtual void toBytecode(Bytecode &buf) {
-        if (to <= EDI) {
-            buf.append_byte(0x81);
-            buf.append_byte(0b11000000 | to);
-            buf.append(value);
+        if(first <= EDI && ptr <= EDI) {
+            buf.append_byte(0x3b);
+            buf.append_byte(0b10000000 | (first << 3) | ptr);
+            if(ptr == ESP)
+                buf.append_byte(0x24);
+
+            buf.append(offset);
         } else {
-            throw_exception("Addition to non-32-bit registers is not supported");
+            throw_exception("Can only compare 32-bit integers");
         }
     }
 
     virtual int getSize() {
+        if(ptr == ESP)
+            return 7;
+
         return 6;
     }
 };
 
-class add_rm_imm_off8 : public Operation {
+class cmp_rm_imm_off8 : public Operation {
 private:
     REGISTER ptr;
     char offset;
     int value;
 public:
-    add_rm_imm_off8(REGISTER ptr, char offset, int value) : ptr(ptr), offset(offset), value(value) {}
+    cmp_rm_imm_off8(REGISTER ptr, char offset, int value) : ptr(ptr), offset(offset), value(value) {}
 
     virtual void toNASM(FILE *output) {
-        fprintf(output, "    add [%s%+d], %d\n", regToText(ptr), offset, value);
+        fprintf(output, "    cmp dword [%s%+d], %d\n", regToText(ptr), offset, value);
     };
 
     virtual void toBytecode(Bytecode &buf) {
         if(ptr <= EDI) {
-            buf.append_byte(0x81);
-            buf.append_byte(0x01000000 | ptr);
-            if(ptr == ESP)
-                buf.append_byte(0x24);
-
-            buf.append(offset);
-            buf.append(value);
+            memImmBytecode(buf, 7, ptr, offset, true, value);
         } else {
             throw_exception("Non-32-bit register adressing is not supported");
         }
     }
 
     virtual int getSize() {
-        if(ptr == ESP)
-            return 8;
-
-        return 7;
+        return memImmSize(ptr, true, value);
     }
 };
 
-class add_rm_imm_off32 : public Operation {
+class cmp_rm_imm_off32 : public Operation {
 private:
     REGISTER ptr;
     int offset;
     int value;
 public:
-    add_rm_imm_off32(REGISTER ptr, int offset, int value) : ptr(ptr), offset(offset), value(value) {}
+    cmp_rm_imm_off32(REGISTER ptr, int offset, int value) : ptr(ptr), offset(offset), value(value) {}
 
     virtual void toNASM(FILE *output) {
-        fprintf(output, "    add [%s%+d], %d\n", regToText(ptr), offset, value);
+        fprintf(output, "    cmp dword [%s%+d], %d\n", regToText(ptr), offset, value);
     };
 
     virtual void toBytecode(Bytecode &buf) {
         if(ptr <= EDI) {
-            buf.append_byte(0x81);
-            buf.append_byte(0x10000000 | ptr);
-            if(ptr == ESP) {
-                buf.append_byte(0x24);
-            }
-            buf.append(offset);
-            buf.append(value);
+            memImmBytecode(buf, 7, ptr, offset, false, value);
         } else {
             throw_exception("Non-32-bit register adressing is not supported");
         }
     }
 
     virtual int getSize() {
-        if(ptr == ESP)
-            return 11;
-
-        return 10;
+        return memImmSize(ptr, false, value);
     }
 };
 
-class pop_reg : public Operation {
+class neg_reg : public Operation {
 private:
-    REGISTER reg;
+    REGISTER what;
 public:
-    pop_reg(REGISTER reg) : reg(reg) {}
+    neg_reg(REGISTER what) : what(what) {}
 
     virtual void toNASM(FILE *output) {
-        fprintf(output, "    pop %s\n", regToText(reg));
+        fprintf(output, "    neg %s\n", regToText(what));
     }
 
     virtual void toBytecode(Bytecode &buf) {
-        if(reg <= EDI) {
-            buf.append_byte(0x58 | reg);
+        if (what <= EDI) {
+            buf.append_byte(0xf7);
+            buf.append_byte(0b11011000 | what);
         } else {
-            throw_exception("Popping non-32-bit register is not yet supported");
+            throw_exception("Non-32 bit NEG is not yet supported");
         }
     }
 
     virtual int getSize() {
-        return 1;
+        return 2;
     }
 };
 
-class push_reg : public Operation {
+class shl_reg_imm : public Operation {
 private:
-    REGISTER reg;
+    REGISTER what;
+    unsigned char count;
 public:
-    push_reg(REGISTER reg) : reg(reg) {}
+    shl_reg_imm(REGISTER what, unsigned char count) : what(what), count(count) {}
 
     virtual void toNASM(FILE *output) {
-        fprintf(output, "    push %s\n", regToText(reg));
+        fprintf(output, "    shl %s, %d\n", regToText(what), count);
     }
 
     virtual void toBytecode(Bytecode &buf) {
-        if(reg <= EDI) {
-            buf.append_byte(0x50 | reg);
+        if (what <= EDI) {
+            shiftImmBytecode(buf, 4, what, count);
         } else {
-            throw_exception("Pushing non-32-bit register is not yet supported");
+            throw_exception("Non-32 bit SHL is not yet supported");
         }
     }
 
     virtual int getSize() {
-        return 1;
+        return shiftImmSize(count);
     }
 };
 
-class sub_reg_reg : public Operation {
+class shr_reg_imm : public Operation {
 private:
-    REGISTER to;
     REGISTER what;
+    unsigned char count;
 public:
-    sub_reg_reg(REGISTER to, REGISTER what) : to(to), what(what) {}
+    shr_reg_imm(REGISTER what, unsigned char count) : what(what), count(count) {}
 
     virtual void toNASM(FILE *output) {
-        fprintf(output, "    sub %s, %s\n", regToText(to), regToText(what));
+        fprintf(output, "    shr %s, %d\n", regToText(what), count);
     }
 
     virtual void toBytecode(Bytecode &buf) {
-        if (to <= EDI && what <= EDI) {
-            buf.append_byte(0x29);
-            buf.append_byte(0b11000000 | (what << 3) | to);
+        if (what <= EDI) {
+            shiftImmBytecode(buf, 5, what, count);
         } else {
-            throw_exception("Non-32-bit exceptions are not yet supported");
+            throw_exception("Non-32 bit SHR is not yet supported");
         }
     }
 
     virtual int getSize() {
-        return 2;
+        return shiftImmSize(count);
     }
 };
 
-class sub_reg_imm : public Operation {
+class sar_reg_imm : public Operation {
 private:
-    REGISTER to;
-    int value;
+    REGISTER what;
+    unsigned char count;
 public:
-    sub_reg_imm(REGISTER to, int value) : to(to), value(value) {}
+    sar_reg_imm(REGISTER what, unsigned char count) : what(what), count(count) {}
 
     virtual void toNASM(FILE *output) {
-        fprintf(output, "    sub %s, %d\n", regToText(to), value);
-    };
+        fprintf(output, "    sar %s, %d\n", regToText(what), count);
+    }
 
     virtual void toBytecode(Bytecode &buf) {
-        if (to <= EDI) {
-            buf.append_byte(0x81);
-            buf.append_byte(0b11101000 | to);
-            buf.append(value);
+        if (what <= EDI) {
+            shiftImmBytecode(buf, 7, what, count);
         } else {
-            throw_exception("Addition to non-32-bit registers is not supported");
+            throw_exception("Non-32 bit SAR is not yet supported");
         }
     }
 
     virtual int getSize() {
-        return 6;
+        return shiftImmSize(count);
     }
 };
 
-class sub_rm_imm_off8 : public Operation {
+class lea_reg_sib : public Operation {
 private:
-    REGISTER ptr;
-    char offset;
-    int value;
+    REGISTER to;
+    REGISTER base;
+    REGISTER index;
+    unsigned char scale;
+    int offset;
+
+    unsigned char scaleBits() {
+        switch (scale) {
+            case 1:
+                return 0;
+            case 2:
+                return 1;
+            case 4:
+                return 2;
+            case 8:
+                return 3;
+            default:
+                throw_exception("LEA scale must be 1, 2, 4 or 8");
+        }
+        return 0;
+    }
+
+    bool needsOffset() {
+        return offset != 0 || base == EBP; // [EBP + index] has no disp-free encoding
+    }
+
 public:
-    sub_rm_imm_off8(REGISTER ptr, char offset, int value) : ptr(ptr), offset(offset), value(value) {}
+    lea_reg_sib(REGISTER to, REGISTER base, REGISTER index, unsigned char scale, int offset) : to(to), base(base),
+                                                                                               index(index),
+                                                                                               scale(scale),
+                                                                                               offset(offset) {}
 
     virtual void toNASM(FILE *output) {
-        fprintf(output, "    sub [%s%+d], %d\n", regToText(ptr), offset, value);
-    };
+        if (offset != 0) {
+            fprintf(output, "    lea %s, [%s+%s*%d%+d]\n", regToText(to), regToText(base), regToText(index), scale,
+                    offset);
+        } else {
+            fprintf(output, "    lea %s, [%s+%s*%d]\n", regToText(to), regToText(base), regToText(index), scale);
+        }
+    }
 
     virtual void toBytecode(Bytecode &buf) {
-        if(ptr <= EDI) {
-            buf.append_byte(0x81);
-            buf.append_byte(0x01101000 | ptr);
-
-            if(ptr == ESP) {
-                buf.append_byte(0x24);
+        if (to <= EDI && base <= EDI && index <= EDI && index != ESP) {
+            unsigned char mod = 0b00000000;
+            if (needsOffset())
+                mod = fitsInByte(offset) ? 0b01000000 : 0b10000000;
+
+            buf.append_byte(0x8d);
+            buf.append_byte(mod | (to << 3) | 0b100);
+            buf.append_byte((scaleBits() << 6) | (index << 3) | base);
+
+            if (needsOffset()) {
+                if (fitsInByte(offset)) {
+                    buf.append(static_cast<char>(offset));
+                } else {
+                    buf.append(offset);
+                }
             }
-
-            buf.append(offset);
-            buf.append(value);
         } else {
-            throw_exception("Non-32-bit register adressing is not supported");
+            throw_exception("LEA supports only 32-bit registers and non-ESP index");
         }
     }
 
     virtual int getSize() {
-        if(ptr == ESP)
-            return 8;
+        if (!needsOffset())
+            return 3;
 
-        return 7;
+        return fitsInByte(offset) ? 4 : 7;
     }
 };
 
-class sub_rm_imm_off32 : public Operation {
+class not_reg : public Operation {
 private:
-    REGISTER ptr;
-    int offset;
-    int value;
+    REGISTER what;
 public:
-    sub_rm_imm_off32(REGISTER ptr, int offset, int value) : ptr(ptr), offset(offset), value(value) {}
+    not_reg(REGISTER what) : what(what) {}
 
     virtual void toNASM(FILE *output) {
-        fprintf(output, "    sub [%s%+d], %d\n", regToText(ptr), offset, value);
-    };
+        fprintf(output, "    not %s\n", regToText(what));
+    }
 
     virtual void toBytecode(Bytecode &buf) {
-        if(ptr <= EDI) {
-            buf.append_byte(0x81);
-            buf.append_byte(0x10101000 | ptr);
-
-            if(ptr == ESP)
-                buf.append_byte(0x24);
-
-            buf.append(offset);
-            buf.append(value);
+        if (what <= EDI) {
+            buf.append_byte(0xf7);
+            buf.append_byte(0b11010000 | what);
         } else {
-            throw_exception("Non-32-bit register adressing is not supported");
+            throw_exception("Non-32 bit NOT is not yet supported");
         }
     }
 
     virtual int getSize() {
-        if(ptr == ESP)
-            return 11;
-
-        return 10;
+        return 2;
     }
 };
 
-class cmp_reg_reg : public Operation {
+class and_reg_reg : public Operation {
 private:
-    REGISTER first;
-    REGISTER second;
+    REGISTER to;
+    REGISTER what;
 public:
-    cmp_reg_reg(REGISTER first, REGISTER second) : first(first), second(second) {}
+    and_reg_reg(REGISTER to, REGISTER what) : to(to), what(what) {}
 
     virtual void toNASM(FILE *output) {
-        fprintf(output, "    cmp %s, %s\n", regToText(first), regToText(second));
+        fprintf(output, "    and %s, %s\n", regToText(to), regToText(what));
     }
 
     virtual void toBytecode(Bytecode &buf) {
-        if(first <= EDI && second <= EDI) {
-            buf.append_byte(0x39);
-            buf.append_byte(0b11000000 | (second << 3) | first);
+        if (to <= EDI && what <= EDI) {
+            buf.append_byte(0x21);
+            buf.append_byte(0b11000000 | (what << 3) | to);
         } else {
-            throw_exception("Can only compare 32-bit integers");
+            throw_exception("Only 32-bit registers support AND yet");
         }
     }
 
@@ -1104,73 +2330,103 @@ public:
     }
 };
 
-class cmp_reg_imm : public Operation {
+class and_reg_imm : public Operation {
 private:
-    REGISTER first;
-    int second;
+    REGISTER what;
+    unsigned int imm;
 public:
-    cmp_reg_imm(REGISTER first, int second) : first(first), second(second) {}
+    and_reg_imm(REGISTER what, unsigned int imm) : what(what), imm(imm) {}
 
     virtual void toNASM(FILE *output) {
-        fprintf(output, "    cmp %s, %d\n", regToText(first), second);
+        fprintf(output, "    and %s, %u\n", regToText(what), imm);
     }
 
     virtual void toBytecode(Bytecode &buf) {
-        if(first <= EDI) {
-            buf.append_byte(0x81);
-            buf.append_byte(0b11111000 | first);
-            buf.append(second);
+        if (what <= EDI) {
+            regImmBytecode(buf, 4, what, static_cast<int>(imm));
         } else {
-            throw_exception("Only 32-bit registers support comparison yet");
+            throw_exception("Only 32-bit registers support AND yet");
         }
     }
 
     virtual int getSize() {
-        return 6;
+        return regImmSize(what, static_cast<int>(imm));
     }
 };
 
-class neg_reg : public Operation {
+// Scalar double SSE2 operation F2 0F opcode with register operands
+inline void sse2RegBytecode(Bytecode &buf, unsigned char opcode, int reg, int rm) {
+    buf.append_byte(0xf2);
+    buf.append_byte(0x0f);
+    buf.append_byte(opcode);
+    buf.append_byte(0b11000000 | (reg << 3) | rm);
+}
+
+class cvtsi2sd_xmm_reg : public Operation {
 private:
-    REGISTER what;
+    XMM_REGISTER to;
+    REGISTER from;
 public:
-    neg_reg(REGISTER what) : what(what) {}
+    cvtsi2sd_xmm_reg(XMM_REGISTER to, REGISTER from) : to(to), from(from) {}
 
     virtual void toNASM(FILE *output) {
-        fprintf(output, "    neg %s\n", regToText(what));
+        fprintf(output, "    cvtsi2sd XMM%d, %s\n", to, regToText(from));
     }
 
     virtual void toBytecode(Bytecode &buf) {
-        if (what <= EDI) {
-            buf.append_byte(0xf7);
-            buf.append_byte(0b11011000 | what);
+        if (from <= EDI) {
+            sse2RegBytecode(buf, 0x2a, to, from);
         } else {
-            throw_exception("Non-32 bit NEG is not yet supported");
+            throw_exception("CVTSI2SD supports only 32-bit registers");
         }
     }
 
     virtual int getSize() {
-        return 2;
+        return 4;
     }
 };
 
-class and_reg_imm : public Operation {
+class sqrtsd_xmm_xmm : public Operation {
 private:
-    REGISTER what;
-    unsigned int imm;
+    XMM_REGISTER to;
+    XMM_REGISTER from;
 public:
-    and_reg_imm(REGISTER what, unsigned int imm) : what(what), imm(imm) {}
+    sqrtsd_xmm_xmm(XMM_REGISTER to, XMM_REGISTER from) : to(to), from(from) {}
 
     virtual void toNASM(FILE *output) {
-        fprintf(output, "    and %s, %u\n", regToText(what), imm);
+        fprintf(output, "    sqrtsd XMM%d, XMM%d\n", to, from);
     }
 
     virtual void toBytecode(Bytecode &buf) {
+        sse2RegBytecode(buf, 0x51, to, from);
+    }
+
+    virtual int getSize() {
+        return 4;
+    }
+};
+
+class cvttsd2si_reg_xmm : public Operation {
+private:
+    REGISTER to;
+    XMM_REGISTER from;
+public:
+    cvttsd2si_reg_xmm(REGISTER to, XMM_REGISTER from) : to(to), from(from) {}
+
+    virtual void toNASM(FILE *output) {
+        fprintf(output, "    cvttsd2si %s, XMM%d\n", regToText(to), from);
+    }
 
+    virtual void toBytecode(Bytecode &buf) {
+        if (to <= EDI) {
+            sse2RegBytecode(buf, 0x2c, to, from);
+        } else {
+            throw_exception("CVTTSD2SI supports only 32-bit registers");
+        }
     }
 
     virtual int getSize() {
-        return 6;
+        return 4;
     }
 };
 
@@ -1181,6 +2437,10 @@ private:
 public:
     label(int num) : num(num) {}
 
+    int getNum() {
+        return num;
+    }
+
     virtual void toNASM(FILE *output) {
         fprintf(output, ".label%d:\n", num);
     }
@@ -1190,8 +2450,14 @@ public:
     virtual int getSize() {
         return 0;
     }
+
+    virtual OP_TYPE getType() {
+        return LABEL_OP;
+    }
 };
 
+class PeepholeOptimizer;
+
 class AssemblyListing {
 private:
     vector<Operation *> ops;                                        // Vector of operations i. e. part of the program
@@ -1200,6 +2466,7 @@ private:
     unsigned int pos;                                               // Current position of the end of the listing
 
     void addOperation(Operation *op);
+    void layout();                                                  // Recalculate label positions and listing size
 
 public:
     AssemblyListing();                                              // Default constructor
@@ -1212,7 +2479,8 @@ public:
     bool markRequiredFunctions(int *listingPositions);              // Mark unmarked functions for compilation
     int getSize();                                                  // Return size of listing
     int placeCallOffsets(const int *listingPositions, int pos);     // Place offsets in call functions
-    void placeLocalLabelJumpOffsets();                              // Place offsets in local label jumps
+    void placeLocalLabelJumpOffsets();                              // Choose jump forms and place offsets in local label jumps
+    void optimize(PeepholeOptimizer &optimizer);                    // Run peephole optimizer over the listing
 
     void toNASM(FILE *output);                                      // Translate listing into NASM file
     void toBytecode(Bytecode &buf);                                 // Translate listing into bytecode
@@ -1222,21 +2490,27 @@ public:
     void nop();                                                     // Good ol' nop
 
     void mov(REGISTER ptr, char offset, char byte);                 // move byte ptr [ptr+offset], byte
-    void mov(REGISTER to, int imm);                                 // mov to, immediate
+    void mov(REGISTER to, int imm);                                 // mov to, immediate, leaves flags intact
+    void zero(REGISTER to);                                         // xor to, to, only where flags are dead
     void mov(REGISTER to, REGISTER from);                           // mov to, from
     void mov(REGISTER to, REGISTER ptr, char offset);               // mov to, size(to) ptr [from + offset]
-    void mov(REGISTER to, REGISTER ptr, int offset);                // mov to, size(to) ptr [from + offset]
+    void mov(REGISTER to, REGISTER ptr, int offset);                // mov to, size(to) ptr [from + offset], disp8 if fits
     void mov(REGISTER to, size_t addr);                             // mov to, size(to) ptr [addr]
     void mov(size_t addr, REGISTER from);                           // mov size(from) ptr [addr], from
     void mov(REGISTER ptr, char offset, REGISTER from);             // mov size(from) [ptr + offset], from
-    void mov(REGISTER ptr, int offset, REGISTER from);              // mov size(from) [ptr + offset], from
+    void mov(REGISTER ptr, int offset, REGISTER from);              // mov size(from) [ptr + offset], from, disp8 if fits
+    void mov_dword(REGISTER ptr, int offset, int imm);              // mov dword [ptr + offset], imm
 
     int addLocalLabel();                                            // Inserts local label at current position
+    int reserveLocalLabel();                                        // Get number for label that is placed later
+    void placeLocalLabel(int labelId);                              // Insert reserved label at current position
     int getLabelCount();                                            // Get number of local labels in current listing
     void comment(const char *msg);                                  // Insert comment
 
     void cmp(REGISTER fst, REGISTER snd);                           // cmp fst, snd
-    void cmp(REGISTER fst, int snd);                           // cmp fst, snd
+    void cmp(REGISTER fst, int snd);                                // cmp fst, snd
+    void cmp(REGISTER fst, REGISTER ptr, int offset);               // cmp fst, [ptr + offset]
+    void cmp(REGISTER ptr, int offset, int imm);                    // cmp dword [ptr + offset], imm
 
     void jmp(int labelId);                                          // jmp labelId
     void jg(int labelId);                                           // jg labelId
@@ -1246,13 +2520,33 @@ public:
     void je(int labelId);                                           // je labelId
     void jne(int labelId);                                          // jne labelId
 
+    void cmov(CONDITION_CODE cc, REGISTER to, REGISTER what);       // cmovcc to, what
+    void cmov(CONDITION_CODE cc, REGISTER to, REGISTER ptr, int offset); // cmovcc to, [ptr+offset]
+    void setcc(CONDITION_CODE cc, REGISTER what);                   // setcc what, 8-bit register only
+    void movzx(REGISTER to, REGISTER what);                         // movzx to, 8-bit what
+
     void ret();                                                     // ret, yeah
-    void ret(unsigned short to_pop);                                // ret that pops value
+    void ret(unsigned short to_pop);                                // ret that pops value, plain ret if it is zero
     void call(int functionId);                                      // call functionId
+    void jmp_listing(int functionId);                               // jmp functionId
 
     void idiv(REGISTER divisor);
+    void cdq();                                                     // Sign-extend EAX into EDX
 
     void imul(REGISTER multiplier);
+    void imul(REGISTER to, REGISTER what, int imm);                 // imul to, what, imm
+    void imul(REGISTER to, REGISTER ptr, int offset, int imm);      // imul to, [ptr+offset], imm
+    void imul(REGISTER to, REGISTER what);                          // imul to, what
+    void imul_rm(REGISTER to, REGISTER ptr, int offset);            // imul to, [ptr+offset]
+
+    void multiply(REGISTER what, int imm);                          // what *= imm using shifts and lea where possible
+    void divide(int divisor);                                       // EAX /= divisor, clobbers EBX and EDX
+
+    void shl(REGISTER what, unsigned char count);                   // shl what, count
+    void shr(REGISTER what, unsigned char count);                   // shr what, count
+    void sar(REGISTER what, unsigned char count);                   // sar what, count
+    void lea(REGISTER to, REGISTER base, REGISTER index, unsigned char scale,
+             int offset);                                           // lea to, [base + index * scale + offset]
 
     void inc(REGISTER what);                                        // inc register
     void inc(REGISTER ptr, char offset);                            // inc [ptr+off]
@@ -1265,16 +2559,26 @@ public:
     void add(REGISTER to, int imm);                                 // add to, imm
     void add(REGISTER ptr, char offset, int imm);                   // add to, [ptr+offset]
     void add(REGISTER ptr, int offset, int imm);                    // add to, [ptr+offset]
+    void add(REGISTER to, REGISTER ptr, int offset);                // add to, [ptr+offset]
 
     void sub(REGISTER to, REGISTER what);                           // add to, what
     void sub(REGISTER to, int imm);                                 // sub to, imm
     void sub(REGISTER ptr, char offset, int imm);                   // sub to, [ptr+offset]
     void sub(REGISTER ptr, int offset, int imm);                    // sub to, [ptr+offset]
+    void sub(REGISTER to, REGISTER ptr, int offset);                // sub to, [ptr+offset]
 
     void neg(REGISTER what);                                        // neg what
     void logical_and(REGISTER what, unsigned int imm);              // and what, imm
+    void logical_and(REGISTER to, REGISTER what);                   // and to, what
+    void logical_not(REGISTER what);                                // not what
+
+    void cvtsi2sd(XMM_REGISTER to, REGISTER from);                  // Convert integer to scalar double
+    void sqrtsd(XMM_REGISTER to, XMM_REGISTER from);                // Scalar double square root
+    void cvttsd2si(REGISTER to, XMM_REGISTER from);                 // Convert scalar double to integer with truncation
 
     void push(REGISTER reg);                                        // push reg
+    void push(int imm);                                             // push dword imm
+    void push(REGISTER ptr, int offset);                            // push dword [ptr+offset]
     void pop(REGISTER reg);                                         // pop reg
 };
 
@@ -1322,6 +2626,7 @@ private:
 
     vector<AssemblyListing> listings;                               // Vector of assembly listings
     unsigned int main;                                              // Position of main listing
+    unsigned int bssSize;                                           // Bytes of zero-initialized data at BSS_ADDRESS
 
     int *
     prepare();                                                 // Do required routines i. e. mark functions, place local and global offsets in jumps and calls
@@ -1336,7 +2641,9 @@ public:
     size_t appendBytesToData(const char *bytes,
                              int len);           // Appends bytes to data, returns offset from the beginning of .data section
 
+    unsigned int reserveData(unsigned int size);                    // Reserve zeroed bytes in .bss, return their address
     void setMainListing(int pos);                                   // Set listing for main function
+    void optimize(PeepholeOptimizer &optimizer);                    // Run peephole optimizer over every listing
 
     void toNASM(const char *filename);                              // Translate program to Netwide Assembly
     Bytecode toBytecode();                                          // Translate program to plain bytecode
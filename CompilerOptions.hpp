@@ -0,0 +1,15 @@
+#ifndef X86COMPILERBACKEND_COMPILEROPTIONS_HPP
+#define X86COMPILERBACKEND_COMPILEROPTIONS_HPP
+
+struct CompilerOptions {
+    bool sse2 = true;                                                           // Compile SQRT with SSE2 instead of Newton iteration
+    bool optimize = false;                                                      // Compile functions through IR with register allocation
+    int inlineThreshold = 8;                                                    // Largest cost model estimate of call that gets inlined
+    int unrollFactor = 1;                                                       // Copies of counted loop body per iteration, 1 disables
+    bool omitFramePointer = false;                                              // Address frames through ESP in every function, not only in leaves
+    bool memoize = false;                                                       // Cache results of pure recursive functions in .bss tables
+    bool schedule = false;                                                      // Reorder instructions inside blocks to hide latency
+    bool dumpIR = false;                                                        // Print IR of every function before lowering
+};
+
+#endif //X86COMPILERBACKEND_COMPILEROPTIONS_HPP
@@ -0,0 +1,98 @@
+#include "IROptimizer.hpp"
+
+static bool hasSideEffects(IRInstruction &instr) {
+    switch (instr.opcode) {
+        case IR_INPUT:
+        case IR_OUTPUT:
+        case IR_CALL:
+            return true;
+
+        case IR_DIV: // Division that may trap has to stay even if quotient is not needed
+            return !instr.b.isConstant || instr.b.value == 0 || instr.b.value == -1;
+
+        default:
+            return false;
+    }
+}
+
+int irEliminateDeadCode(IRFunction &func, const CompilerOptions &options) {
+    int blockCount = func.blocks.getSize();
+    int *defBlock = new int[func.registerCount];                    // Block that defines register, -1 if none
+    int *defIndex = new int[func.registerCount];                    // Position of definition in its block
+    bool *live = new bool[func.registerCount]();                    // Whether value can reach a side effect
+    int *worklist = new int[func.registerCount];                    // Live registers with unvisited definitions
+    int pending = 0;
+
+    for (int i = 0; i < func.registerCount; i++) {
+        defBlock[i] = -1;
+    }
+
+    for (int i = 0; i < blockCount; i++) {
+        IRBlock *block = func.blocks[i];
+        for (int j = 0; j < block->instructions.getSize(); j++) {
+            IRInstruction &instr = block->instructions[j];
+            if (instr.opcode != IR_NOP && instr.dst >= 0) {
+                defBlock[instr.dst] = i;
+                defIndex[instr.dst] = j;
+            }
+        }
+    }
+
+    for (int i = 0; i < blockCount; i++) { // Side effects and terminators are the roots
+        IRBlock *block = func.blocks[i];
+        for (int j = 0; j < block->instructions.getSize(); j++) {
+            IRInstruction &instr = block->instructions[j];
+            if (instr.opcode == IR_NOP || !hasSideEffects(instr))
+                continue;
+
+            for (int k = 0; k < func.getUseCount(instr); k++) {
+                IROperand op = func.getUse(instr, k);
+                if (!op.isConstant && !live[op.value]) {
+                    live[op.value] = true;
+                    worklist[pending++] = op.value;
+                }
+            }
+        }
+
+        for (int k = 0; k < func.getUseCount(block); k++) {
+            IROperand op = func.getUse(block, k);
+            if (!op.isConstant && !live[op.value]) {
+                live[op.value] = true;
+                worklist[pending++] = op.value;
+            }
+        }
+    }
+
+    while (pending > 0) {
+        int reg = worklist[--pending];
+        if (defBlock[reg] < 0)
+            continue;
+
+        IRInstruction &instr = func.blocks[defBlock[reg]]->instructions[defIndex[reg]];
+        for (int k = 0; k < func.getUseCount(instr); k++) {
+            IROperand op = func.getUse(instr, k);
+            if (!op.isConstant && !live[op.value]) {
+                live[op.value] = true;
+                worklist[pending++] = op.value;
+            }
+        }
+    }
+
+    int removed = 0;
+    for (int i = 0; i < blockCount; i++) {
+        IRBlock *block = func.blocks[i];
+        for (int j = 0; j < block->instructions.getSize(); j++) {
+            IRInstruction &instr = block->instructions[j];
+            if (instr.opcode != IR_NOP && instr.dst >= 0 && !live[instr.dst] && !hasSideEffects(instr)) {
+                instr.opcode = IR_NOP; // Value never reaches output, call or branch
+                removed++;
+            }
+        }
+    }
+
+    delete[] defBlock;
+    delete[] defIndex;
+    delete[] live;
+    delete[] worklist;
+    return removed;
+}
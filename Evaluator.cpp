@@ -0,0 +1,180 @@
+#include "Evaluator.hpp"
+#include "utilities.hpp"
+
+static int getValue(const int *values, IROperand op) {
+    return op.isConstant ? op.value : values[op.value];
+}
+
+IREvaluator::IREvaluator() : functions(nullptr), functionCount(0), listings(nullptr), steps(0), report() {}
+
+bool IREvaluator::execute(int function, const int *arguments, int depth, int &result) {
+    if (depth > EVALUATOR_MAX_DEPTH)
+        return false;
+
+    IRFunction &func = functions[function];
+    auto *values = new int[func.registerCount]();
+    int current = 0;
+    bool ok = true;
+
+    while (ok) {
+        IRBlock *block = func.blocks[current];
+        for (int j = 0; ok && j < block->instructions.getSize(); j++) {
+            IRInstruction &instr = block->instructions[j];
+            if (--steps < 0) {
+                ok = false;
+                break;
+            }
+
+            switch (instr.opcode) {
+                case IR_NOP:
+                    break;
+
+                case IR_ARG:
+                    values[instr.dst] = arguments[instr.a.value];
+                    break;
+
+                case IR_COPY:
+                case IR_ADD:
+                case IR_SUB:
+                case IR_MUL:
+                case IR_DIV:
+                case IR_SQRT: // Division that traps is left to run time
+                    ok = irFold(instr.opcode, getValue(values, instr.a), getValue(values, instr.b), values[instr.dst]);
+                    break;
+
+                case IR_SELECT: {
+                    IROperand *ops = &func.pool[instr.poolStart];
+                    bool holds = irEvaluate(static_cast<IR_CONDITION>(instr.a.value), getValue(values, ops[0]),
+                                            getValue(values, ops[1]));
+                    values[instr.dst] = getValue(values, holds ? ops[2] : ops[3]);
+                    break;
+                }
+
+                case IR_CALL: {
+                    int callee = listings->indexOf(instr.a.value);
+                    if (callee < 0 || instr.poolCount != functions[callee].argumentCount) {
+                        ok = false;
+                        break;
+                    }
+
+                    auto *args = new int[instr.poolCount + 1];
+                    for (int k = 0; k < instr.poolCount; k++) {
+                        args[k] = getValue(values, func.pool[instr.poolStart + k]);
+                    }
+                    ok = execute(callee, args, depth + 1, values[instr.dst]);
+                    delete[] args;
+                    break;
+                }
+
+                default: // INPUT and OUTPUT talk to the world, PHI does not appear before SSA
+                    ok = false;
+                    break;
+            }
+        }
+
+        if (!ok || --steps < 0)
+            break;
+
+        switch (block->terminator) {
+            case IR_JUMP:
+                current = block->targets[0];
+                break;
+
+            case IR_BRANCH:
+                current = irEvaluate(block->condition, getValue(values, block->a), getValue(values, block->b)) ?
+                          block->targets[0] : block->targets[1];
+                break;
+
+            case IR_RETURN:
+                result = getValue(values, block->a);
+                delete[] values;
+                return true;
+        }
+    }
+
+    delete[] values;
+    return false;
+}
+
+// Constant operand holds at current point of block, false if it is not known
+static bool getKnown(IRFunction &func, const bool *known, const int *values, IROperand op, int &value) {
+    if (!op.isConstant && known[op.value]) {
+        value = values[op.value];
+        return true;
+    }
+
+    return func.getConstant(op, value);
+}
+
+int IREvaluator::fold(int function) {
+    IRFunction &func = functions[function];
+    auto *known = new bool[func.registerCount];                     // Register holds a constant at current point
+    auto *values = new int[func.registerCount];
+
+    int folded = 0;
+    for (int b = 0; b < func.blocks.getSize(); b++) {
+        IRBlock *block = func.blocks[b];
+        for (int r = 0; r < func.registerCount; r++) {
+            known[r] = false;
+        }
+
+        for (int j = 0; j < block->instructions.getSize(); j++) {
+            IRInstruction &instr = block->instructions[j];
+            int callee = instr.opcode == IR_CALL ? listings->indexOf(instr.a.value) : -1;
+
+            if (callee >= 0 && instr.poolCount == functions[callee].argumentCount) {
+                bool constant = true;
+                auto *args = new int[instr.poolCount + 1];
+                for (int k = 0; constant && k < instr.poolCount; k++) {
+                    constant = getKnown(func, known, values, func.pool[instr.poolStart + k], args[k]);
+                }
+
+                int result;
+                steps = EVALUATOR_MAX_STEPS;
+                if (constant && execute(callee, args, 0, result)) {
+                    report.push_back({func.name, functions[callee].name, result, EVALUATOR_MAX_STEPS - steps});
+                    instr = {IR_COPY, instr.dst, irConstant(result), irConstant(0), 0, 0};
+                    folded++;
+                }
+                delete[] args;
+            }
+
+            if (instr.opcode != IR_NOP && instr.dst >= 0) { // Follow constants through straight-line copies
+                int value = 0;
+                known[instr.dst] = instr.opcode == IR_COPY && getKnown(func, known, values, instr.a, value);
+                values[instr.dst] = value;
+            }
+        }
+    }
+
+    delete[] known;
+    delete[] values;
+    return folded;
+}
+
+int IREvaluator::run(IRFunction *functions, int count, IRListingMap &listings, const CompilerOptions &options) {
+    if (!functions)
+        throw_exception("Invalid pointer to functions provided");
+
+    this->functions = functions;
+    functionCount = count;
+    this->listings = &listings;
+
+    int folded = 0;
+    for (int i = 0; i < count; i++) {
+        folded += fold(i);
+    }
+
+    return folded;
+}
+
+void IREvaluator::dump(FILE *out) {
+    if (!out)
+        throw_exception("Invalid pointer to output file");
+
+    for (int i = 0; i < report.getSize(); i++) {
+        fprintf(out, "Evaluate: %-16s in %-16s = %d, %d steps\n", report[i].callee ? report[i].callee : "?",
+                report[i].caller ? report[i].caller : "?", report[i].result, report[i].steps);
+    }
+    fprintf(out, "Evaluate: %d calls\n", static_cast<int>(report.getSize()));
+}
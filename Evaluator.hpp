@@ -0,0 +1,41 @@
+#ifndef X86COMPILERBACKEND_EVALUATOR_HPP
+#define X86COMPILERBACKEND_EVALUATOR_HPP
+
+#include <cstdio>
+#include "IR.hpp"
+#include "Vector.hpp"
+#include "CompilerOptions.hpp"
+
+const int EVALUATOR_MAX_STEPS = 1000000;                            // Instructions interpreted for one call site
+const int EVALUATOR_MAX_DEPTH = 512;                                // Nested calls interpreted at once
+
+struct EvaluatedCall {
+    const char *caller;                                             // Function that contained the call
+    const char *callee;                                             // Function that was interpreted
+    int result;                                                     // Value the call was replaced with
+    int steps;                                                      // Instructions interpreted to get it
+};
+
+class IREvaluator {
+private:
+    IRFunction *functions;                                          // All functions of the program
+    int functionCount;                                              // Number of functions
+    IRListingMap *listings;                                         // Function index by listing number
+    int steps;                                                      // Budget left for the current call site
+    vector<EvaluatedCall> report;                                   // Calls folded so far
+
+    bool execute(int function, const int *arguments, int depth, int &result); // Interpret call, false if it cannot be folded
+    int fold(int function);                                         // Replace calls with constant arguments, return their number
+
+public:
+    IREvaluator();                                                  // Default constructor
+    IREvaluator(const IREvaluator &other) = delete;                 // Prohibit copy constructor
+    IREvaluator &operator=(const IREvaluator &other) = delete;      // Prohibit copy assignment
+    ~IREvaluator() = default;                                       // Destructor
+
+    int run(IRFunction *functions, int count, IRListingMap &listings,
+            const CompilerOptions &options);                        // Fold calls, return their number
+    void dump(FILE *out);                                           // Print folded calls
+};
+
+#endif //X86COMPILERBACKEND_EVALUATOR_HPP
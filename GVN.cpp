@@ -0,0 +1,242 @@
+#include "IROptimizer.hpp"
+#include "SSA.hpp"
+
+struct ValueEntry {
+    IR_OPCODE opcode;                                               // Operation
+    IROperand a;                                                    // First operand after numbering
+    IROperand b;                                                    // Second operand after numbering
+    int reg;                                                        // Register that holds the value
+    int next;                                                       // Next entry in bucket chain
+    int bucket;                                                     // Bucket the entry was inserted into
+};
+
+class ValueNumbering {
+private:
+    IRFunction &func;                                               // Function in SSA form
+    DominatorTree dom;                                              // Scope of available values
+    IROperand *leader;                                              // Operand that replaces register
+    int *buckets;                                                   // Head of chain for every hash value
+    int bucketMask;                                                 // Number of buckets minus one
+    ValueEntry *entries;                                            // Available expressions, newest last
+    int entryCount;                                                 // Number of available expressions
+    int eliminated;                                                 // Number of removed computations
+
+    IROperand resolve(IROperand op);                                // Leader of operand
+    int lookup(IR_OPCODE opcode, IROperand a, IROperand b);         // Register holding expression, -1 if none
+    void insert(IR_OPCODE opcode, IROperand a, IROperand b, int reg); // Make expression available
+    void number(IRInstruction &instr);                              // Value number one instruction
+
+public:
+    explicit ValueNumbering(IRFunction &func);                      // Prepare tables for function
+    ValueNumbering(const ValueNumbering &other) = delete;           // Prohibit copy constructor
+    ValueNumbering &operator=(const ValueNumbering &other) = delete; // Prohibit copy assignment
+    ~ValueNumbering();                                              // Destructor
+
+    int run();                                                      // Walk dominator tree, return eliminated count
+};
+
+static unsigned int hashOperand(IROperand op) {
+    return static_cast<unsigned int>(op.value) * 2654435761u + (op.isConstant ? 0x9e3779b9u : 0u);
+}
+
+static bool sameOperand(IROperand x, IROperand y) {
+    return x.isConstant == y.isConstant && x.value == y.value;
+}
+
+static bool isPureExpression(IR_OPCODE opcode) {
+    switch (opcode) {
+        case IR_ADD:
+        case IR_SUB:
+        case IR_MUL:
+        case IR_DIV: // Repeated division traps only where the first one already did
+        case IR_SQRT:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+ValueNumbering::ValueNumbering(IRFunction &func) : func(func), dom(func), entryCount(0), eliminated(0) {
+    leader = new IROperand[func.registerCount];
+    for (int i = 0; i < func.registerCount; i++) {
+        leader[i] = irRegister(i);
+    }
+
+    int size = 1;
+    while (size < 2 * func.countInstructions())
+        size *= 2;
+    bucketMask = size - 1;
+    buckets = new int[size];
+    for (int i = 0; i < size; i++) {
+        buckets[i] = -1;
+    }
+
+    entries = new ValueEntry[func.countInstructions() + 1];
+}
+
+ValueNumbering::~ValueNumbering() {
+    delete[] leader;
+    delete[] buckets;
+    delete[] entries;
+}
+
+IROperand ValueNumbering::resolve(IROperand op) {
+    return op.isConstant ? op : leader[op.value];
+}
+
+int ValueNumbering::lookup(IR_OPCODE opcode, IROperand a, IROperand b) {
+    unsigned int hash = (hashOperand(a) * 31 + hashOperand(b)) * 31 + opcode;
+
+    for (int e = buckets[hash & bucketMask]; e >= 0; e = entries[e].next) {
+        ValueEntry &entry = entries[e];
+        if (entry.opcode == opcode && sameOperand(entry.a, a) && sameOperand(entry.b, b))
+            return entry.reg;
+    }
+
+    return -1;
+}
+
+void ValueNumbering::insert(IR_OPCODE opcode, IROperand a, IROperand b, int reg) {
+    unsigned int hash = (hashOperand(a) * 31 + hashOperand(b)) * 31 + opcode;
+    int bucket = static_cast<int>(hash & bucketMask);
+
+    entries[entryCount] = {opcode, a, b, reg, buckets[bucket], bucket};
+    buckets[bucket] = entryCount++;
+}
+
+void ValueNumbering::number(IRInstruction &instr) {
+    if (instr.opcode == IR_PHI) {
+        IROperand same = resolve(func.pool[instr.poolStart]);
+        for (int i = 0; i < instr.poolCount; i++) {
+            IROperand op = func.pool[instr.poolStart + i];
+            if (!sameOperand(resolve(op), same) && !irIsRegister(op, instr.dst))
+                return;
+        }
+
+        if (instr.poolCount > 0 && !irIsRegister(same, instr.dst)) { // Every edge brings the same value
+            leader[instr.dst] = same;
+            instr.opcode = IR_NOP;
+        }
+        return;
+    }
+
+    for (int k = 0; k < func.getUseCount(instr); k++) {
+        IROperand &op = func.getUse(instr, k);
+        op = resolve(op);
+    }
+
+    if (instr.opcode == IR_COPY) { // Copies are propagated into their uses
+        leader[instr.dst] = instr.a;
+        instr.opcode = IR_NOP;
+        return;
+    }
+
+    if (instr.opcode == IR_SELECT) { // Selection between equal values or on known condition is a copy
+        IROperand left = func.pool[instr.poolStart];
+        IROperand right = func.pool[instr.poolStart + 1];
+        IROperand onTrue = func.pool[instr.poolStart + 2];
+        IROperand onFalse = func.pool[instr.poolStart + 3];
+
+        if (sameOperand(onTrue, onFalse)) {
+            leader[instr.dst] = onTrue;
+        } else if (left.isConstant && right.isConstant) {
+            leader[instr.dst] = irEvaluate(static_cast<IR_CONDITION>(instr.a.value), left.value, right.value) ? onTrue
+                                                                                                               : onFalse;
+        } else {
+            return;
+        }
+
+        instr.opcode = IR_NOP;
+        eliminated++;
+        return;
+    }
+
+    if (!isPureExpression(instr.opcode))
+        return;
+
+    IROperand a = instr.a;
+    IROperand b = instr.opcode == IR_SQRT ? irConstant(0) : instr.b;
+    if ((instr.opcode == IR_ADD || instr.opcode == IR_MUL) &&
+        (a.isConstant > b.isConstant || (a.isConstant == b.isConstant && a.value > b.value))) {
+        IROperand tmp = a; // Commutative operations get one canonical operand order
+        a = b;
+        b = tmp;
+    }
+
+    int result = 0;
+    if (a.isConstant && b.isConstant && irFold(instr.opcode, a.value, b.value, result)) {
+        leader[instr.dst] = irConstant(result);
+        instr.opcode = IR_NOP;
+        eliminated++;
+        return;
+    }
+
+    int available = lookup(instr.opcode, a, b);
+    if (available >= 0) {
+        leader[instr.dst] = irRegister(available);
+        instr.opcode = IR_NOP;
+        eliminated++;
+        return;
+    }
+
+    insert(instr.opcode, a, b, instr.dst);
+}
+
+int ValueNumbering::run() {
+    int blockCount = func.blocks.getSize();
+    int *stack = new int[2 * blockCount];
+    int *marks = new int[blockCount];
+    int depth = 0;
+
+    stack[depth++] = 0;
+    while (depth > 0) {
+        int item = stack[--depth];
+        if (item < 0) { // Expressions of the subtree are no longer available
+            while (entryCount > marks[~item]) {
+                entryCount--;
+                buckets[entries[entryCount].bucket] = entries[entryCount].next;
+            }
+            continue;
+        }
+
+        IRBlock *block = func.blocks[item];
+        marks[item] = entryCount;
+
+        for (int i = 0; i < block->instructions.getSize(); i++) {
+            if (block->instructions[i].opcode != IR_NOP)
+                number(block->instructions[i]);
+        }
+
+        for (int k = 0; k < func.getUseCount(block); k++) {
+            IROperand &op = func.getUse(block, k);
+            op = resolve(op);
+        }
+
+        for (int j = 0; j < block->getSuccessorCount(); j++) { // Operands flowing along outgoing edges
+            int successor = block->targets[j];
+            int index = func.getPredecessorIndex(successor, item);
+            vector<IRInstruction> &instructions = func.blocks[successor]->instructions;
+
+            for (int k = 0; k < instructions.getSize(); k++) {
+                IRInstruction &instr = instructions[k];
+                if (instr.opcode == IR_PHI)
+                    func.pool[instr.poolStart + index] = resolve(func.pool[instr.poolStart + index]);
+            }
+        }
+
+        stack[depth++] = ~item;
+        for (int j = 0; j < dom.getChildCount(item); j++) {
+            stack[depth++] = dom.getChild(item, j);
+        }
+    }
+
+    delete[] stack;
+    delete[] marks;
+    return eliminated;
+}
+
+int irNumberValues(IRFunction &func, const CompilerOptions &options) {
+    ValueNumbering numbering(func);
+    return numbering.run();
+}
@@ -0,0 +1,762 @@
+#include <climits>
+#include <cmath>
+#include "IR.hpp"
+#include "utilities.hpp"
+
+IR_CONDITION irNegate(IR_CONDITION condition) {
+    switch (condition) {
+        case IR_EQ:
+            return IR_NE;
+        case IR_NE:
+            return IR_EQ;
+        case IR_LT:
+            return IR_GE;
+        case IR_LE:
+            return IR_GT;
+        case IR_GT:
+            return IR_LE;
+        case IR_GE:
+            return IR_LT;
+    }
+    throw_exception("Invalid IR condition");
+}
+
+IR_CONDITION irMirror(IR_CONDITION condition) {
+    switch (condition) {
+        case IR_EQ:
+            return IR_EQ;
+        case IR_NE:
+            return IR_NE;
+        case IR_LT:
+            return IR_GT;
+        case IR_LE:
+            return IR_GE;
+        case IR_GT:
+            return IR_LT;
+        case IR_GE:
+            return IR_LE;
+    }
+    throw_exception("Invalid IR condition");
+}
+
+bool irEvaluate(IR_CONDITION condition, int a, int b) {
+    switch (condition) {
+        case IR_EQ:
+            return a == b;
+        case IR_NE:
+            return a != b;
+        case IR_LT:
+            return a < b;
+        case IR_LE:
+            return a <= b;
+        case IR_GT:
+            return a > b;
+        case IR_GE:
+            return a >= b;
+    }
+    throw_exception("Invalid IR condition");
+}
+
+bool irFold(IR_OPCODE opcode, int a, int b, int &result) {
+    auto x = static_cast<unsigned int>(a);
+    auto y = static_cast<unsigned int>(b);
+
+    switch (opcode) {
+        case IR_COPY:
+            result = a;
+            return true;
+
+        case IR_ADD: // Wrap around like the hardware does
+            result = static_cast<int>(x + y);
+            return true;
+
+        case IR_SUB:
+            result = static_cast<int>(x - y);
+            return true;
+
+        case IR_MUL:
+            result = static_cast<int>(x * y);
+            return true;
+
+        case IR_DIV:
+            if (b == 0 || (a == INT_MIN && b == -1))
+                return false; // idiv raises an exception, keep it at run time
+
+            result = a / b;
+            return true;
+
+        case IR_SQRT: {
+            if (a <= 0) { // Negative radicands are cleared
+                result = 0;
+                return true;
+            }
+
+            auto root = static_cast<long long>(sqrt(static_cast<double>(a)));
+            while (root * root > a)
+                root--;
+            while ((root + 1) * (root + 1) <= a)
+                root++;
+
+            result = static_cast<int>(root);
+            return true;
+        }
+
+        default:
+            return false;
+    }
+}
+
+IRBlock::IRBlock() : instructions(), terminator(IR_RETURN), condition(IR_EQ), a(irConstant(0)), b(irConstant(0)),
+                     targets{-1, -1}, predecessors(), loopDepth(0) {}
+
+int IRBlock::getSuccessorCount() {
+    switch (terminator) {
+        case IR_JUMP:
+            return 1;
+        case IR_BRANCH:
+            return 2;
+        default:
+            return 0;
+    }
+}
+
+IRFunction::IRFunction() : blocks(), pool(), registerCount(0), argumentCount(0), number(0),
+                           name(nullptr) {}
+
+IRFunction::IRFunction(IRFunction &&other) noexcept : blocks(std::move(other.blocks)), pool(std::move(other.pool)),
+                                                      registerCount(other.registerCount),
+                                                      argumentCount(other.argumentCount), number(other.number),
+                                                      name(other.name) {}
+
+IRFunction &IRFunction::operator=(IRFunction &&other) noexcept {
+    for (int i = 0; i < blocks.getSize(); i++) {
+        delete blocks[i];
+    }
+
+    blocks = std::move(other.blocks);
+    pool = std::move(other.pool);
+    registerCount = other.registerCount;
+    argumentCount = other.argumentCount;
+    number = other.number;
+    name = other.name;
+
+    return *this;
+}
+
+IRFunction::~IRFunction() {
+    for (int i = 0; i < blocks.getSize(); i++) {
+        delete blocks[i];
+    }
+}
+
+int IRFunction::addBlock(int loopDepth) {
+    auto *block = new IRBlock();
+    block->loopDepth = loopDepth;
+    blocks.push_back(block);
+    return blocks.getSize() - 1;
+}
+
+int IRFunction::addRegister() {
+    return registerCount++;
+}
+
+int IRFunction::addPool(int count) {
+    int start = pool.getSize();
+    for (int i = 0; i < count; i++) {
+        pool.push_back(irConstant(0));
+    }
+    return start;
+}
+
+int IRFunction::emit(int block, IR_OPCODE opcode, IROperand a, IROperand b) {
+    int dst = addRegister();
+    emit(block, opcode, dst, a, b);
+    return dst;
+}
+
+void IRFunction::emit(int block, IR_OPCODE opcode, int dst, IROperand a, IROperand b) {
+    blocks[block]->instructions.push_back({opcode, dst, a, b, 0, 0});
+}
+
+int IRFunction::emitPooled(int block, IR_OPCODE opcode, IROperand a, int poolStart, int poolCount) {
+    int dst = addRegister();
+    blocks[block]->instructions.push_back({opcode, dst, a, irConstant(0), poolStart, poolCount});
+    return dst;
+}
+
+void IRFunction::jump(int block, int target) {
+    IRBlock *current = blocks[block];
+    current->terminator = IR_JUMP;
+    current->targets[0] = target;
+    current->targets[1] = -1;
+}
+
+void IRFunction::branch(int block, IR_CONDITION condition, IROperand a, IROperand b, int onTrue, int onFalse) {
+    IRBlock *current = blocks[block];
+    current->terminator = IR_BRANCH;
+    current->condition = condition;
+    current->a = a;
+    current->b = b;
+    current->targets[0] = onTrue;
+    current->targets[1] = onFalse;
+}
+
+void IRFunction::ret(int block, IROperand value) {
+    IRBlock *current = blocks[block];
+    current->terminator = IR_RETURN;
+    current->a = value;
+    current->targets[0] = -1;
+    current->targets[1] = -1;
+}
+
+int IRFunction::getUseCount(IRInstruction &instr) {
+    switch (instr.opcode) {
+        case IR_COPY:
+        case IR_SQRT:
+        case IR_OUTPUT:
+            return 1;
+
+        case IR_ADD:
+        case IR_SUB:
+        case IR_MUL:
+        case IR_DIV:
+            return 2;
+
+        case IR_CALL:
+        case IR_PHI:
+        case IR_SELECT:
+            return instr.poolCount;
+
+        default:
+            return 0;
+    }
+}
+
+IROperand &IRFunction::getUse(IRInstruction &instr, int use) {
+    if (instr.opcode == IR_CALL || instr.opcode == IR_PHI || instr.opcode == IR_SELECT)
+        return pool[instr.poolStart + use];
+
+    return use == 0 ? instr.a : instr.b;
+}
+
+int IRFunction::getUseCount(IRBlock *block) {
+    switch (block->terminator) {
+        case IR_BRANCH:
+            return 2;
+
+        case IR_RETURN:
+            return 1;
+
+        default:
+            return 0;
+    }
+}
+
+IROperand &IRFunction::getUse(IRBlock *block, int use) {
+    return use == 0 ? block->a : block->b;
+}
+
+void IRFunction::computePredecessors() {
+    for (int i = 0; i < blocks.getSize(); i++) {
+        blocks[i]->predecessors.clear();
+    }
+
+    for (int i = 0; i < blocks.getSize(); i++) {
+        IRBlock *block = blocks[i];
+        for (int j = 0; j < block->getSuccessorCount(); j++) {
+            if (j == 1 && block->targets[1] == block->targets[0])
+                break; // Both ways lead to the same block, count the edge once
+
+            blocks[block->targets[j]]->predecessors.push_back(i);
+        }
+    }
+}
+
+int IRFunction::getPredecessorIndex(int block, int predecessor) {
+    vector<int> &predecessors = blocks[block]->predecessors;
+    for (int i = 0; i < predecessors.getSize(); i++) {
+        if (predecessors[i] == predecessor)
+            return i;
+    }
+
+    return -1;
+}
+
+void IRFunction::removePredecessor(int block, int index) {
+    IRBlock *current = blocks[block];
+
+    for (int i = 0; i < current->instructions.getSize(); i++) {
+        IRInstruction &instr = current->instructions[i];
+        if (instr.opcode != IR_PHI)
+            continue;
+
+        for (int j = index; j < instr.poolCount - 1; j++) { // Operands follow the order of predecessors
+            pool[instr.poolStart + j] = pool[instr.poolStart + j + 1];
+        }
+        instr.poolCount--;
+    }
+
+    vector<int> predecessors;
+    for (int i = 0; i < current->predecessors.getSize(); i++) {
+        if (i != index)
+            predecessors.push_back(current->predecessors[i]);
+    }
+    current->predecessors = std::move(predecessors);
+}
+
+int IRFunction::removeUnreachableBlocks() {
+    int count = blocks.getSize();
+    bool *reachable = new bool[count]();
+    int *stack = new int[count];
+    int depth = 0;
+
+    reachable[0] = true;
+    stack[depth++] = 0;
+    while (depth > 0) {
+        IRBlock *block = blocks[stack[--depth]];
+        for (int i = 0; i < block->getSuccessorCount(); i++) {
+            if (!reachable[block->targets[i]]) {
+                reachable[block->targets[i]] = true;
+                stack[depth++] = block->targets[i];
+            }
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (!reachable[i])
+            continue;
+
+        for (int j = blocks[i]->predecessors.getSize() - 1; j >= 0; j--) {
+            if (!reachable[blocks[i]->predecessors[j]])
+                removePredecessor(i, j);
+        }
+    }
+
+    int *numbers = stack; // New number of every block
+    vector<IRBlock *> kept;
+    for (int i = 0; i < count; i++) {
+        if (reachable[i]) {
+            numbers[i] = kept.getSize();
+            kept.push_back(blocks[i]);
+        } else {
+            numbers[i] = -1;
+            delete blocks[i];
+        }
+    }
+
+    for (int i = 0; i < kept.getSize(); i++) {
+        IRBlock *block = kept[i];
+        for (int j = 0; j < block->getSuccessorCount(); j++) {
+            block->targets[j] = numbers[block->targets[j]];
+        }
+        for (int j = 0; j < block->predecessors.getSize(); j++) {
+            block->predecessors[j] = numbers[block->predecessors[j]];
+        }
+    }
+
+    int removed = count - kept.getSize();
+    blocks = std::move(kept);
+
+    delete[] reachable;
+    delete[] stack;
+    return removed;
+}
+
+void IRFunction::threadJumps() {
+    int count = blocks.getSize();
+    int *forward = new int[count];
+
+    for (int i = 0; i < count; i++) {
+        IRBlock *block = blocks[i];
+        forward[i] = i;
+        if (i == 0 || block->terminator != IR_JUMP)
+            continue; // Entry stays where it is
+
+        bool empty = true;
+        for (int j = 0; j < block->instructions.getSize() && empty; j++) {
+            empty = block->instructions[j].opcode == IR_NOP;
+        }
+        if (empty)
+            forward[i] = block->targets[0];
+    }
+
+    for (int i = 0; i < count; i++) {
+        IRBlock *block = blocks[i];
+        for (int j = 0; j < block->getSuccessorCount(); j++) {
+            int target = block->targets[j];
+            for (int steps = 0; forward[target] != target && steps < count; steps++) { // Bounded for empty cycles
+                target = forward[target];
+            }
+            block->targets[j] = target;
+        }
+
+        if (block->terminator == IR_BRANCH && block->targets[0] == block->targets[1])
+            jump(i, block->targets[0]);
+    }
+
+    delete[] forward;
+}
+
+void IRFunction::reversePostorder(vector<int> &order) {
+    int count = blocks.getSize();
+    order.clear();
+    if (count == 0)
+        return;
+
+    bool *visited = new bool[count]();
+    int *stack = new int[count]; // Blocks on the current DFS path
+    int *next = new int[count]; // Next successor to visit, false target of BRANCH goes first
+    int *post = new int[count];
+    int depth = 0, visitedCount = 0;
+
+    stack[depth++] = 0;
+    next[0] = 0;
+    visited[0] = true;
+
+    while (depth > 0) {
+        int current = stack[depth - 1];
+        IRBlock *block = blocks[current];
+        int successors = block->getSuccessorCount();
+
+        if (next[current] < successors) {
+            int target = block->targets[successors - 1 - next[current]];
+            next[current]++;
+
+            if (!visited[target]) {
+                visited[target] = true;
+                next[target] = 0;
+                stack[depth++] = target;
+            }
+        } else {
+            post[visitedCount++] = current;
+            depth--;
+        }
+    }
+
+    for (int i = visitedCount - 1; i >= 0; i--) {
+        order.push_back(post[i]);
+    }
+
+    delete[] visited;
+    delete[] stack;
+    delete[] next;
+    delete[] post;
+}
+
+int IRFunction::countInstructions() {
+    int count = 0;
+    for (int i = 0; i < blocks.getSize(); i++) {
+        IRBlock *block = blocks[i];
+        for (int j = 0; j < block->instructions.getSize(); j++) {
+            if (block->instructions[j].opcode != IR_NOP)
+                count++;
+        }
+        count++; // Terminator
+    }
+    return count;
+}
+
+IRInstruction *IRFunction::findDefinition(int reg) {
+    IRInstruction *def = nullptr;
+    for (int i = 0; i < blocks.getSize(); i++) {
+        IRBlock *block = blocks[i];
+        for (int j = 0; j < block->instructions.getSize(); j++) {
+            IRInstruction &instr = block->instructions[j];
+            if (instr.opcode == IR_NOP || instr.dst != reg)
+                continue;
+
+            if (def)
+                return nullptr;
+            def = &instr;
+        }
+    }
+
+    return def;
+}
+
+bool IRFunction::getConstant(IROperand op, int &value) {
+    if (op.isConstant) {
+        value = op.value;
+        return true;
+    }
+
+    // Locals are zeroed on entry, so a register with one definition is never read before it
+    IRInstruction *def = findDefinition(op.value);
+    if (!def || def->opcode != IR_COPY || !def->a.isConstant)
+        return false;
+
+    value = def->a.value;
+    return true;
+}
+
+IRListingMap::IRListingMap() : indices(nullptr), size(0) {}
+
+IRListingMap::~IRListingMap() {
+    delete[] indices;
+}
+
+void IRListingMap::build(IRFunction *functions, int count) {
+    if (!functions)
+        throw_exception("Invalid pointer to functions provided");
+
+    delete[] indices;
+    size = 0;
+    for (int i = 0; i < count; i++) {
+        if (functions[i].number >= size)
+            size = functions[i].number + 1;
+    }
+
+    indices = new int[size + 1];
+    for (int i = 0; i < size; i++) {
+        indices[i] = -1;
+    }
+    for (int i = 0; i < count; i++) {
+        indices[functions[i].number] = i;
+    }
+}
+
+int IRListingMap::indexOf(int listing) {
+    if (listing < 0 || listing >= size)
+        return -1;
+
+    return indices[listing];
+}
+
+IRLiveness::IRLiveness(IRFunction &func, vector<int> &order) : words(irBitsetWords(func.registerCount)),
+                                                                liveIn(nullptr), liveOut(nullptr) {
+    int blockCount = func.blocks.getSize();
+    liveIn = new unsigned int[blockCount * words]();
+    liveOut = new unsigned int[blockCount * words]();
+
+    // Upward exposed uses and definitions of every block
+    auto *use = new unsigned int[blockCount * words]();
+    auto *def = new unsigned int[blockCount * words]();
+
+    for (int i = 0; i < order.getSize(); i++) {
+        IRBlock *block = func.blocks[order[i]];
+        unsigned int *blockUse = use + order[i] * words;
+        unsigned int *blockDef = def + order[i] * words;
+
+        for (int j = 0; j < block->instructions.getSize(); j++) {
+            IRInstruction &instr = block->instructions[j];
+            if (instr.opcode == IR_NOP)
+                continue;
+
+            if (instr.opcode != IR_PHI) { // PHI operands are read at the end of predecessors
+                for (int k = 0; k < func.getUseCount(instr); k++) {
+                    IROperand op = func.getUse(instr, k);
+                    if (!op.isConstant && !irTestBit(blockDef, op.value))
+                        irSetBit(blockUse, op.value);
+                }
+            }
+
+            if (instr.dst >= 0)
+                irSetBit(blockDef, instr.dst);
+        }
+
+        for (int k = 0; k < func.getUseCount(block); k++) {
+            IROperand op = func.getUse(block, k);
+            if (!op.isConstant && !irTestBit(blockDef, op.value))
+                irSetBit(blockUse, op.value);
+        }
+    }
+
+    bool changed = true;
+    while (changed) { // Backward dataflow until fixed point
+        changed = false;
+        for (int i = order.getSize() - 1; i >= 0; i--) {
+            int current = order[i];
+            IRBlock *block = func.blocks[current];
+            unsigned int *out = liveOut + current * words;
+            unsigned int *in = liveIn + current * words;
+
+            for (int j = 0; j < block->getSuccessorCount(); j++) {
+                int successor = block->targets[j];
+                unsigned int *successorIn = liveIn + successor * words;
+                for (int w = 0; w < words; w++) {
+                    out[w] |= successorIn[w];
+                }
+
+                int index = func.getPredecessorIndex(successor, current);
+                vector<IRInstruction> &instructions = func.blocks[successor]->instructions;
+                for (int k = 0; k < instructions.getSize() && index >= 0; k++) {
+                    IRInstruction &instr = instructions[k];
+                    if (instr.opcode == IR_PHI && !func.pool[instr.poolStart + index].isConstant)
+                        irSetBit(out, func.pool[instr.poolStart + index].value);
+                }
+            }
+
+            for (int w = 0; w < words; w++) {
+                unsigned int updated = use[current * words + w] | (out[w] & ~def[current * words + w]);
+                if (updated != in[w]) {
+                    in[w] = updated;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    delete[] use;
+    delete[] def;
+}
+
+IRLiveness::~IRLiveness() {
+    delete[] liveIn;
+    delete[] liveOut;
+}
+
+unsigned int *IRLiveness::getLiveIn(int block) {
+    return liveIn + block * words;
+}
+
+unsigned int *IRLiveness::getLiveOut(int block) {
+    return liveOut + block * words;
+}
+
+int IRLiveness::getWords() {
+    return words;
+}
+
+static void dumpOperand(FILE *output, IROperand op) {
+    if (op.isConstant) {
+        fprintf(output, "%d", op.value);
+    } else {
+        fprintf(output, "r%d", op.value);
+    }
+}
+
+static const char *irOpcodeToText(IR_OPCODE opcode) {
+    switch (opcode) {
+        case IR_ADD:
+            return "+";
+        case IR_SUB:
+            return "-";
+        case IR_MUL:
+            return "*";
+        case IR_DIV:
+            return "/";
+        default:
+            return "?";
+    }
+}
+
+static const char *irConditionToText(IR_CONDITION condition) {
+    switch (condition) {
+        case IR_EQ:
+            return "==";
+        case IR_NE:
+            return "!=";
+        case IR_LT:
+            return "<";
+        case IR_LE:
+            return "<=";
+        case IR_GT:
+            return ">";
+        case IR_GE:
+            return ">=";
+    }
+    return "?";
+}
+
+void IRFunction::dump(FILE *output) {
+    fprintf(output, "function %d %s(%d arguments, %d registers)\n", number, name ? name : "", argumentCount,
+            registerCount);
+
+    for (int i = 0; i < blocks.getSize(); i++) {
+        IRBlock *block = blocks[i];
+        fprintf(output, "block%d: ; depth %d, predecessors", i, block->loopDepth);
+        for (int j = 0; j < block->predecessors.getSize(); j++) {
+            fprintf(output, " %d", block->predecessors[j]);
+        }
+        fprintf(output, "\n");
+
+        for (int j = 0; j < block->instructions.getSize(); j++) {
+            IRInstruction &instr = block->instructions[j];
+            if (instr.opcode == IR_NOP)
+                continue;
+
+            fprintf(output, "    ");
+            if (instr.dst >= 0)
+                fprintf(output, "r%d = ", instr.dst);
+
+            switch (instr.opcode) {
+                case IR_COPY:
+                    dumpOperand(output, instr.a);
+                    break;
+
+                case IR_ADD:
+                case IR_SUB:
+                case IR_MUL:
+                case IR_DIV:
+                    dumpOperand(output, instr.a);
+                    fprintf(output, " %s ", irOpcodeToText(instr.opcode));
+                    dumpOperand(output, instr.b);
+                    break;
+
+                case IR_SQRT:
+                    fprintf(output, "sqrt ");
+                    dumpOperand(output, instr.a);
+                    break;
+
+                case IR_ARG:
+                    fprintf(output, "arg %d", instr.a.value);
+                    break;
+
+                case IR_INPUT:
+                    fprintf(output, "input");
+                    break;
+
+                case IR_OUTPUT:
+                    fprintf(output, "output ");
+                    dumpOperand(output, instr.a);
+                    break;
+
+                case IR_CALL:
+                case IR_PHI:
+                    fprintf(output, instr.opcode == IR_CALL ? "call %d (" : "phi (", instr.a.value);
+                    for (int k = 0; k < instr.poolCount; k++) {
+                        if (k)
+                            fprintf(output, ", ");
+                        dumpOperand(output, pool[instr.poolStart + k]);
+                    }
+                    fprintf(output, ")");
+                    break;
+
+                case IR_SELECT:
+                    fprintf(output, "select ");
+                    dumpOperand(output, pool[instr.poolStart]);
+                    fprintf(output, " %s ", irConditionToText(static_cast<IR_CONDITION>(instr.a.value)));
+                    dumpOperand(output, pool[instr.poolStart + 1]);
+                    fprintf(output, " ? ");
+                    dumpOperand(output, pool[instr.poolStart + 2]);
+                    fprintf(output, " : ");
+                    dumpOperand(output, pool[instr.poolStart + 3]);
+                    break;
+
+                default:
+                    break;
+            }
+            fprintf(output, "\n");
+        }
+
+        switch (block->terminator) {
+            case IR_JUMP:
+                fprintf(output, "    jump block%d\n", block->targets[0]);
+                break;
+
+            case IR_BRANCH:
+                fprintf(output, "    if ");
+                dumpOperand(output, block->a);
+                fprintf(output, " %s ", irConditionToText(block->condition));
+                dumpOperand(output, block->b);
+                fprintf(output, " block%d else block%d\n", block->targets[0], block->targets[1]);
+                break;
+
+            case IR_RETURN:
+                fprintf(output, "    return ");
+                dumpOperand(output, block->a);
+                fprintf(output, "\n");
+                break;
+        }
+    }
+}
@@ -0,0 +1,177 @@
+#ifndef X86COMPILERBACKEND_IR_HPP
+#define X86COMPILERBACKEND_IR_HPP
+
+#include <cstdio>
+#include "Vector.hpp"
+
+enum IR_OPCODE {
+    IR_NOP,                                                         // Removed instruction
+    IR_COPY,                                                        // dst = a
+    IR_ADD,                                                         // dst = a + b
+    IR_SUB,                                                         // dst = a - b
+    IR_MUL,                                                         // dst = a * b
+    IR_DIV,                                                         // dst = a / b
+    IR_SQRT,                                                        // dst = sqrt(a)
+    IR_ARG,                                                         // dst = argument number a
+    IR_INPUT,                                                       // dst = number read from stdin
+    IR_OUTPUT,                                                      // Print a
+    IR_CALL,                                                        // dst = listing a called with pooled arguments
+    IR_PHI,                                                         // dst = pooled operand of the predecessor control came from
+    IR_SELECT                                                       // dst = pooled third operand if first two satisfy condition a, else fourth
+};
+
+enum IR_TERMINATOR {
+    IR_JUMP,                                                        // Go to first target
+    IR_BRANCH,                                                      // Go to first target if a condition b holds, to second otherwise
+    IR_RETURN                                                       // Return a
+};
+
+enum IR_CONDITION {
+    IR_EQ,
+    IR_NE,
+    IR_LT,
+    IR_LE,
+    IR_GT,
+    IR_GE
+};
+
+struct IROperand {
+    bool isConstant;                                                // Whether value is a constant or a virtual register
+    int value;                                                      // Constant or virtual register number
+};
+
+inline IROperand irRegister(int reg) {
+    return {false, reg};
+}
+
+inline IROperand irConstant(int value) {
+    return {true, value};
+}
+
+inline bool irIsRegister(IROperand op, int reg) {
+    return !op.isConstant && op.value == reg;
+}
+
+inline int irBitsetWords(int bits) {
+    return (bits + 31) / 32;
+}
+
+inline void irSetBit(unsigned int *set, int bit) {
+    set[bit / 32] |= 1u << (bit % 32);
+}
+
+inline void irClearBit(unsigned int *set, int bit) {
+    set[bit / 32] &= ~(1u << (bit % 32));
+}
+
+inline bool irTestBit(const unsigned int *set, int bit) {
+    return (set[bit / 32] >> (bit % 32)) & 1u;
+}
+
+IR_CONDITION irNegate(IR_CONDITION condition);                      // Condition that holds when the given one does not
+IR_CONDITION irMirror(IR_CONDITION condition);                      // Condition with swapped operands
+bool irEvaluate(IR_CONDITION condition, int a, int b);              // Compare two constants
+bool irFold(IR_OPCODE opcode, int a, int b, int &result);           // Compute arithmetic on constants, false if it traps
+
+struct IRInstruction {
+    IR_OPCODE opcode;                                               // Operation
+    int dst;                                                        // Destination register, -1 if there is none
+    IROperand a;                                                    // First operand
+    IROperand b;                                                    // Second operand
+    int poolStart;                                                  // First pooled operand of CALL or PHI
+    int poolCount;                                                  // Number of pooled operands of CALL or PHI
+};
+
+struct IRBlock {
+    vector<IRInstruction> instructions;                             // Straight-line code of the block
+    IR_TERMINATOR terminator;                                       // How the block is left
+    IR_CONDITION condition;                                         // Condition of BRANCH
+    IROperand a;                                                    // Left operand of BRANCH or value of RETURN
+    IROperand b;                                                    // Right operand of BRANCH
+    int targets[2];                                                 // JUMP uses the first, BRANCH both
+    vector<int> predecessors;                                       // Blocks that jump to this one
+    int loopDepth;                                                  // Number of loops the block is nested in
+
+    IRBlock();                                                      // Block that returns zero
+    int getSuccessorCount();                                        // Number of used targets
+};
+
+struct IRFunction {
+    vector<IRBlock *> blocks;                                       // Basic blocks, entry is the first one
+    vector<IROperand> pool;                                         // Arguments of CALL and operands of PHI instructions
+    int registerCount;                                              // Number of virtual registers
+    int argumentCount;                                              // Number of function arguments
+    int number;                                                     // Listing number of the function
+    const char *name;                                               // Function name for reports, may be null
+
+    IRFunction();                                                   // Default constructor
+    IRFunction(IRFunction &&other) noexcept;                        // Move constructor
+    IRFunction &operator=(IRFunction &&other) noexcept;             // Move assignment
+    IRFunction(const IRFunction &other) = delete;                   // Prohibit copy constructor
+    IRFunction &operator=(const IRFunction &other) = delete;        // Prohibit copy assignment
+    ~IRFunction();                                                  // Destructor
+
+    int addBlock(int loopDepth);                                    // Append empty block, return its number
+    int addRegister();                                              // Allocate virtual register
+    int addPool(int count);                                         // Allocate pooled operands, return first of them
+    int emit(int block, IR_OPCODE opcode, IROperand a, IROperand b);// Append instruction with fresh destination
+    void emit(int block, IR_OPCODE opcode, int dst, IROperand a,
+              IROperand b);                                         // Append instruction with given destination
+    int emitPooled(int block, IR_OPCODE opcode, IROperand a, int poolStart,
+                   int poolCount);                                  // Append CALL or PHI with fresh destination
+    void jump(int block, int target);                               // Terminate block with JUMP
+    void branch(int block, IR_CONDITION condition, IROperand a, IROperand b, int onTrue,
+                int onFalse);                                       // Terminate block with BRANCH
+    void ret(int block, IROperand value);                           // Terminate block with RETURN
+
+    int getUseCount(IRInstruction &instr);                          // Number of operands instruction reads
+    IROperand &getUse(IRInstruction &instr, int use);               // Operand instruction reads
+    int getUseCount(IRBlock *block);                                // Number of operands terminator reads
+    IROperand &getUse(IRBlock *block, int use);                     // Operand terminator reads
+
+    void computePredecessors();                                     // Rebuild predecessor lists from targets, drops PHI order
+    int getPredecessorIndex(int block, int predecessor);            // Position of predecessor in block list, -1 if absent
+    void removePredecessor(int block, int index);                   // Drop incoming edge along with its PHI operands
+    int removeUnreachableBlocks();                                  // Drop blocks entry cannot reach, return their number
+    void threadJumps();                                             // Retarget edges around blocks that only jump, needs no PHI
+    void reversePostorder(vector<int> &order);                      // Reachable blocks, BRANCH true target right after it
+    int countInstructions();                                        // Number of instructions and terminators
+    IRInstruction *findDefinition(int reg);                         // Only instruction that writes reg, null if several
+    bool getConstant(IROperand op, int &value);                     // Literal or register whose only definition copies one
+
+    void dump(FILE *output);                                        // Print function in readable form
+};
+
+class IRListingMap {
+private:
+    int *indices;                                                   // Function index by listing number, -1 for runtime
+    int size;                                                       // Number of listings covered
+
+public:
+    IRListingMap();                                                 // Default constructor
+    IRListingMap(const IRListingMap &other) = delete;               // Prohibit copy constructor
+    IRListingMap &operator=(const IRListingMap &other) = delete;    // Prohibit copy assignment
+    ~IRListingMap();                                                // Destructor
+
+    void build(IRFunction *functions, int count);                   // Index functions, again once copies are added
+    int indexOf(int listing);                                       // Function index of listing, -1 for runtime
+};
+
+class IRLiveness {
+private:
+    int words;                                                      // Size of one register set in words
+    unsigned int *liveIn;                                           // Registers live at block entry, PHI results excluded
+    unsigned int *liveOut;                                          // Registers live at block exit, PHI operands included
+
+public:
+    IRLiveness(IRFunction &func, vector<int> &order);               // Solve dataflow over blocks in given order
+    IRLiveness(const IRLiveness &other) = delete;                   // Prohibit copy constructor
+    IRLiveness &operator=(const IRLiveness &other) = delete;        // Prohibit copy assignment
+    ~IRLiveness();                                                  // Destructor
+
+    unsigned int *getLiveIn(int block);                             // Set of registers live at block entry
+    unsigned int *getLiveOut(int block);                            // Set of registers live at block exit
+    int getWords();                                                 // Size of register set in words
+};
+
+#endif //X86COMPILERBACKEND_IR_HPP
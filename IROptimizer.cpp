@@ -0,0 +1,75 @@
+#include "IROptimizer.hpp"
+#include "SSA.hpp"
+#include "utilities.hpp"
+
+static const IRPass DEFAULT_PASSES[] = {
+        {"tailrec", irEliminateTailRecursion, false},
+        {"sccp",    irPropagateConstants,     true},
+        {"gvn",     irNumberValues,           true},
+        {"ifconv",  irConvertBranches,        true},
+        {"licm",    irHoistInvariants,        true},
+        {"unroll",  irUnrollLoops,            false},
+        {"sccp",    irPropagateConstants,     true},
+        {"gvn",     irNumberValues,           true},
+        {"ivsr",    irReduceInductions,       true},
+        {"dce",     irEliminateDeadCode,      true},
+        {"sched",   irScheduleInstructions,   false}
+};
+
+IROptimizer::IROptimizer() : IROptimizer(DEFAULT_PASSES, sizeof(DEFAULT_PASSES) / sizeof(DEFAULT_PASSES[0])) {}
+
+IROptimizer::IROptimizer(const IRPass *passes, int passCount) : passes(passes), passCount(passCount) {
+    if (!passes)
+        throw_exception("Invalid pointer to IR passes");
+
+    hits = new int[passCount]();
+}
+
+IROptimizer::~IROptimizer() {
+    delete[] hits;
+}
+
+void IROptimizer::run(IRFunction &func, const CompilerOptions &options) {
+    bool ssa = false;
+
+    for (int i = 0; i < passCount; i++) {
+        if (passes[i].ssa && !ssa) {
+            irConstructSSA(func);
+        } else if (!passes[i].ssa && ssa) {
+            irDestructSSA(func);
+        }
+        ssa = passes[i].ssa;
+
+        hits[i] += passes[i].run(func, options);
+    }
+
+    if (ssa)
+        irDestructSSA(func);
+}
+
+int IROptimizer::getPassCount() {
+    return passCount;
+}
+
+const char *IROptimizer::getPassName(int pass) {
+    if (pass < 0 || pass >= passCount)
+        throw_exception("IR pass index is out of range");
+
+    return passes[pass].name;
+}
+
+int IROptimizer::getPassHits(int pass) {
+    if (pass < 0 || pass >= passCount)
+        throw_exception("IR pass index is out of range");
+
+    return hits[pass];
+}
+
+void IROptimizer::dump(FILE *out) {
+    if (!out)
+        throw_exception("Invalid pointer to output file");
+
+    for (int i = 0; i < passCount; i++) {
+        fprintf(out, "IR: %-16s %d\n", passes[i].name, hits[i]);
+    }
+}
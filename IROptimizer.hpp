@@ -0,0 +1,47 @@
+#ifndef X86COMPILERBACKEND_IROPTIMIZER_HPP
+#define X86COMPILERBACKEND_IROPTIMIZER_HPP
+
+#include <cstdio>
+#include "IR.hpp"
+#include "CompilerOptions.hpp"
+
+struct IRPass {
+    const char *name;                                               // Pass name for statistics
+    int (*run)(IRFunction &func, const CompilerOptions &options);   // Transform function, return number of changes
+    bool ssa;                                                       // Whether pass expects SSA form
+};
+
+int irEliminateTailRecursion(IRFunction &func, const CompilerOptions &options); // Turn self calls in RETURN into jumps
+int irUnrollLoops(IRFunction &func, const CompilerOptions &options);             // Copy bodies of innermost counted loops
+
+int irPropagateConstants(IRFunction &func, const CompilerOptions &options); // Sparse conditional constant propagation
+int irNumberValues(IRFunction &func, const CompilerOptions &options);       // Dominator based value numbering with copy propagation
+int irConvertBranches(IRFunction &func, const CompilerOptions &options);    // Replace short IF diamonds with SELECT
+int irHoistInvariants(IRFunction &func, const CompilerOptions &options);    // Move loop invariant computations into preheaders
+int irReduceInductions(IRFunction &func, const CompilerOptions &options);   // Replace products with induction variables by sums
+int irEliminateDeadCode(IRFunction &func, const CompilerOptions &options);  // Remove computations whose values are never used
+
+int irScheduleInstructions(IRFunction &func, const CompilerOptions &options); // Reorder instructions inside blocks to hide latency
+
+class IROptimizer {
+private:
+    const IRPass *passes;                                           // Pass table
+    int passCount;                                                  // Number of passes in the table
+    int *hits;                                                      // Number of changes made by each pass
+
+public:
+    IROptimizer();                                                  // Optimizer with the default pass pipeline
+    IROptimizer(const IRPass *passes, int passCount);               // Optimizer with custom pipeline
+    IROptimizer(const IROptimizer &other) = delete;                 // Prohibit copy constructor
+    IROptimizer &operator=(const IROptimizer &other) = delete;      // Prohibit copy assignment
+    ~IROptimizer();                                                 // Destructor
+
+    void run(IRFunction &func, const CompilerOptions &options);     // Run passes in order, entering SSA where they need it
+
+    int getPassCount();                                             // Number of passes
+    const char *getPassName(int pass);                              // Name of pass
+    int getPassHits(int pass);                                      // Number of changes made by pass
+    void dump(FILE *out);                                           // Print change counters
+};
+
+#endif //X86COMPILERBACKEND_IROPTIMIZER_HPP
@@ -0,0 +1,186 @@
+#include "IROptimizer.hpp"
+
+const int IFCONV_BRANCH_COST = 4;                                   // Expected cost of conditional branch, mispredictions included
+const int IFCONV_SELECT_COST = 2;                                   // Compare and conditional move of every merged value
+
+// Cost of executing instruction on both paths, -1 if it must not run speculatively
+static int getSpeculationCost(IRInstruction &instr) {
+    switch (instr.opcode) {
+        case IR_NOP:
+            return 0;
+
+        case IR_COPY:
+        case IR_ADD:
+        case IR_SUB:
+            return 1;
+
+        case IR_MUL:
+            return 3;
+
+        default: // Division may trap, square root and calls are too expensive
+            return -1;
+    }
+}
+
+class IfConverter {
+private:
+    IRFunction &func;                                               // Function in SSA form
+    bool *removed;                                                  // Blocks merged into others
+
+    int getArmCost(int block, int head);                            // Cost of arm only head enters, -1 if it is no arm
+    bool convert(int head);                                         // Replace diamond or triangle below head with SELECTs
+    void replacePredecessor(int block, int from, int to);           // Edge from block now comes from another block
+
+public:
+    explicit IfConverter(IRFunction &func);                         // Converter for function
+    IfConverter(const IfConverter &other) = delete;                 // Prohibit copy constructor
+    IfConverter &operator=(const IfConverter &other) = delete;      // Prohibit copy assignment
+    ~IfConverter();                                                 // Destructor
+
+    int run();                                                      // Convert branches inner first, return their number
+};
+
+IfConverter::IfConverter(IRFunction &func) : func(func) {
+    removed = new bool[func.blocks.getSize()]();
+}
+
+IfConverter::~IfConverter() {
+    delete[] removed;
+}
+
+int IfConverter::getArmCost(int block, int head) {
+    IRBlock *arm = func.blocks[block];
+    if (block == head || arm->terminator != IR_JUMP || arm->predecessors.getSize() != 1 ||
+        arm->predecessors[0] != head)
+        return -1;
+
+    int cost = 0;
+    for (int j = 0; j < arm->instructions.getSize(); j++) {
+        int instrCost = getSpeculationCost(arm->instructions[j]);
+        if (instrCost < 0)
+            return -1;
+        cost += instrCost;
+    }
+
+    return cost;
+}
+
+void IfConverter::replacePredecessor(int block, int from, int to) {
+    IRBlock *current = func.blocks[block];
+    for (int i = 0; i < current->predecessors.getSize(); i++) {
+        if (current->predecessors[i] == from)
+            current->predecessors[i] = to;
+    }
+}
+
+bool IfConverter::convert(int head) {
+    IRBlock *top = func.blocks[head];
+    if (top->terminator != IR_BRANCH || top->targets[0] == top->targets[1])
+        return false;
+
+    // Either side is an arm that jumps to the join block or a direct edge to it
+    int arms[2];
+    int sources[2];
+    int join = -1;
+    int cost[2] = {0, 0};
+    for (int k = 0; k < 2; k++) {
+        int target = top->targets[k];
+        cost[k] = getArmCost(target, head);
+        arms[k] = cost[k] >= 0 ? target : -1;
+        sources[k] = cost[k] >= 0 ? target : head;
+
+        int next = cost[k] >= 0 ? func.blocks[target]->targets[0] : target;
+        if (k == 0) {
+            join = next;
+        } else if (join != next) {
+            return false;
+        }
+        cost[k] = cost[k] < 0 ? 0 : cost[k];
+    }
+
+    IRBlock *bottom = func.blocks[join];
+    if ((arms[0] < 0 && arms[1] < 0) || join == head || join == 0 || bottom->predecessors.getSize() != 2)
+        return false;
+
+    int selects = 0;
+    int indices[2] = {func.getPredecessorIndex(join, sources[0]), func.getPredecessorIndex(join, sources[1])};
+    for (int j = 0; j < bottom->instructions.getSize(); j++) {
+        IRInstruction &instr = bottom->instructions[j];
+        if (instr.opcode != IR_PHI)
+            continue;
+
+        IROperand onTrue = func.pool[instr.poolStart + indices[0]];
+        IROperand onFalse = func.pool[instr.poolStart + indices[1]];
+        if (onTrue.isConstant != onFalse.isConstant || onTrue.value != onFalse.value)
+            selects++;
+    }
+
+    // Both arms always run and every merged value costs a compare, the branch and the longer arm go away
+    int longer = cost[0] > cost[1] ? cost[0] : cost[1];
+    if (cost[0] + cost[1] + selects * IFCONV_SELECT_COST > longer + IFCONV_BRANCH_COST)
+        return false;
+
+    for (int k = 0; k < 2; k++) {
+        if (arms[k] < 0)
+            continue;
+
+        IRBlock *arm = func.blocks[arms[k]];
+        for (int j = 0; j < arm->instructions.getSize(); j++) {
+            if (arm->instructions[j].opcode != IR_NOP)
+                top->instructions.push_back(arm->instructions[j]);
+        }
+        removed[arms[k]] = true;
+    }
+
+    for (int j = 0; j < bottom->instructions.getSize(); j++) {
+        IRInstruction instr = bottom->instructions[j];
+        if (instr.opcode == IR_PHI) {
+            IROperand onTrue = func.pool[instr.poolStart + indices[0]];
+            IROperand onFalse = func.pool[instr.poolStart + indices[1]];
+            int poolStart = func.addPool(4);
+            func.pool[poolStart] = top->a;
+            func.pool[poolStart + 1] = top->b;
+            func.pool[poolStart + 2] = onTrue;
+            func.pool[poolStart + 3] = onFalse;
+            instr = {IR_SELECT, instr.dst, irConstant(top->condition), irConstant(0), poolStart, 4};
+        }
+
+        if (instr.opcode != IR_NOP)
+            top->instructions.push_back(instr);
+    }
+
+    // Join block is merged into the head, its successors see the head as predecessor
+    for (int k = 0; k < bottom->getSuccessorCount(); k++) {
+        replacePredecessor(bottom->targets[k], join, head);
+    }
+
+    top->terminator = bottom->terminator;
+    top->condition = bottom->condition;
+    top->a = bottom->a;
+    top->b = bottom->b;
+    top->targets[0] = bottom->targets[0];
+    top->targets[1] = bottom->targets[1];
+    removed[join] = true;
+    return true;
+}
+
+int IfConverter::run() {
+    vector<int> order;
+    func.reversePostorder(order);
+
+    int converted = 0;
+    for (int i = order.getSize() - 1; i >= 0; i--) { // Inner branches first, so that outer ones become diamonds
+        if (!removed[order[i]] && convert(order[i]))
+            converted++;
+    }
+
+    if (converted)
+        func.removeUnreachableBlocks();
+
+    return converted;
+}
+
+int irConvertBranches(IRFunction &func, const CompilerOptions &options) {
+    IfConverter converter(func);
+    return converter.run();
+}
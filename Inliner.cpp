@@ -0,0 +1,256 @@
+#include "Inliner.hpp"
+#include "utilities.hpp"
+
+IRInliner::IRInliner() : functions(nullptr), functionCount(0), listings(nullptr), recursive(nullptr),
+                         callSites(nullptr), report() {}
+
+IRInliner::~IRInliner() {
+    delete[] recursive;
+    delete[] callSites;
+}
+
+int IRInliner::getCallee(IRInstruction &instr) {
+    return listings->indexOf(instr.a.value);
+}
+
+void IRInliner::analyzeCalls() {
+    for (int i = 0; i < functionCount; i++) {
+        IRFunction &func = functions[i];
+        for (int b = 0; b < func.blocks.getSize(); b++) {
+            IRBlock *block = func.blocks[b];
+            for (int j = 0; j < block->instructions.getSize(); j++) {
+                IRInstruction &instr = block->instructions[j];
+                if (instr.opcode == IR_CALL && getCallee(instr) >= 0)
+                    callSites[getCallee(instr)]++;
+            }
+        }
+    }
+
+    bool *reached = new bool[functionCount];
+    int *stack = new int[functionCount];
+    for (int i = 0; i < functionCount; i++) { // Function is recursive if some chain of calls leads back to it
+        int depth = 0;
+        for (int k = 0; k < functionCount; k++) {
+            reached[k] = false;
+        }
+
+        stack[depth++] = i;
+        while (depth > 0 && !recursive[i]) {
+            IRFunction &func = functions[stack[--depth]];
+            for (int b = 0; b < func.blocks.getSize(); b++) {
+                IRBlock *block = func.blocks[b];
+                for (int j = 0; j < block->instructions.getSize(); j++) {
+                    IRInstruction &instr = block->instructions[j];
+                    int callee = instr.opcode == IR_CALL ? getCallee(instr) : -1;
+                    if (callee < 0 || reached[callee])
+                        continue;
+
+                    if (callee == i)
+                        recursive[i] = true;
+
+                    reached[callee] = true;
+                    stack[depth++] = callee;
+                }
+            }
+        }
+    }
+
+    delete[] reached;
+    delete[] stack;
+}
+
+void IRInliner::visit(int function, bool *visited, int *order, int &count) {
+    visited[function] = true;
+
+    IRFunction &func = functions[function];
+    for (int b = 0; b < func.blocks.getSize(); b++) {
+        IRBlock *block = func.blocks[b];
+        for (int j = 0; j < block->instructions.getSize(); j++) {
+            IRInstruction &instr = block->instructions[j];
+            int callee = instr.opcode == IR_CALL ? getCallee(instr) : -1;
+            if (callee >= 0 && !visited[callee])
+                visit(callee, visited, order, count);
+        }
+    }
+
+    order[count++] = function;
+}
+
+int IRInliner::getCost(IRFunction &caller, IRInstruction &call, int callee) {
+    // Body of a function with a single call site is not emitted once it is inlined
+    int cost = callSites[callee] == 1 ? 0 : functions[callee].countInstructions();
+
+    cost -= INLINER_CALL_OVERHEAD + call.poolCount; // Argument pushes disappear as well
+    for (int i = 0; i < call.poolCount; i++) {
+        if (caller.pool[call.poolStart + i].isConstant)
+            cost -= INLINER_CONSTANT_BONUS;
+    }
+
+    return cost;
+}
+
+void IRInliner::substitute(IRFunction &caller, int block, int index, int callee) {
+    IRFunction &body = functions[callee];
+    IRBlock *site = caller.blocks[block];
+    IRInstruction call = site->instructions[index];
+
+    auto *args = new IROperand[call.poolCount + 1];
+    for (int i = 0; i < call.poolCount; i++) {
+        args[i] = caller.pool[call.poolStart + i];
+    }
+
+    int registerBase = caller.registerCount;
+    int blockBase = caller.blocks.getSize();
+    caller.registerCount += body.registerCount;
+    for (int i = 0; i < body.blocks.getSize(); i++) {
+        caller.addBlock(site->loopDepth + body.blocks[i]->loopDepth);
+    }
+    int rest = caller.addBlock(site->loopDepth); // Code after the call
+
+    // Split the block: instructions after the call and terminator move to the continuation
+    int count = site->instructions.getSize();
+    auto *instructions = new IRInstruction[count];
+    for (int i = 0; i < count; i++) {
+        instructions[i] = site->instructions[i];
+    }
+
+    IRBlock *after = caller.blocks[rest];
+    site->instructions.clear();
+    for (int i = 0; i < count; i++) {
+        if (i < index) {
+            site->instructions.push_back(instructions[i]);
+        } else if (i > index) {
+            after->instructions.push_back(instructions[i]);
+        }
+    }
+    delete[] instructions;
+
+    after->terminator = site->terminator;
+    after->condition = site->condition;
+    after->a = site->a;
+    after->b = site->b;
+    after->targets[0] = site->targets[0];
+    after->targets[1] = site->targets[1];
+    caller.jump(block, blockBase);
+
+    for (int i = 0; i < body.blocks.getSize(); i++) {
+        IRBlock *from = body.blocks[i];
+        int to = blockBase + i;
+
+        for (int j = 0; j < from->instructions.getSize(); j++) {
+            IRInstruction instr = from->instructions[j];
+            if (instr.opcode == IR_NOP)
+                continue;
+
+            if (instr.dst >= 0)
+                instr.dst += registerBase;
+
+            if (instr.opcode == IR_ARG) { // Parameters become copies of actual arguments
+                IROperand value = instr.a.value < call.poolCount ? args[instr.a.value] : irConstant(0);
+                caller.emit(to, IR_COPY, instr.dst, value, irConstant(0));
+                continue;
+            }
+
+            if (instr.opcode == IR_CALL || instr.opcode == IR_PHI || instr.opcode == IR_SELECT) {
+                int poolStart = caller.addPool(instr.poolCount);
+                for (int k = 0; k < instr.poolCount; k++) {
+                    IROperand op = body.pool[instr.poolStart + k];
+                    caller.pool[poolStart + k] = op.isConstant ? op : irRegister(op.value + registerBase);
+                }
+                instr.poolStart = poolStart;
+            } else {
+                for (int k = 0; k < caller.getUseCount(instr); k++) {
+                    IROperand &op = caller.getUse(instr, k);
+                    if (!op.isConstant)
+                        op.value += registerBase;
+                }
+            }
+
+            caller.blocks[to]->instructions.push_back(instr);
+        }
+
+        IROperand a = from->a.isConstant ? from->a : irRegister(from->a.value + registerBase);
+        IROperand b = from->b.isConstant ? from->b : irRegister(from->b.value + registerBase);
+        switch (from->terminator) {
+            case IR_JUMP:
+                caller.jump(to, from->targets[0] + blockBase);
+                break;
+
+            case IR_BRANCH:
+                caller.branch(to, from->condition, a, b, from->targets[0] + blockBase, from->targets[1] + blockBase);
+                break;
+
+            case IR_RETURN: // Returned value goes to result of the call
+                if (call.dst >= 0)
+                    caller.emit(to, IR_COPY, call.dst, a, irConstant(0));
+                caller.jump(to, rest);
+                break;
+        }
+    }
+
+    delete[] args;
+}
+
+int IRInliner::run(IRFunction *functions, int count, IRListingMap &listings, const CompilerOptions &options) {
+    if (!functions)
+        throw_exception("Invalid pointer to functions provided");
+
+    this->functions = functions;
+    functionCount = count;
+    this->listings = &listings;
+
+    delete[] recursive;
+    delete[] callSites;
+
+    recursive = new bool[count]();
+    callSites = new int[count]();
+    analyzeCalls();
+
+    bool *visited = new bool[count]();
+    int *order = new int[count];
+    int ordered = 0;
+    for (int i = 0; i < count; i++) {
+        if (!visited[i])
+            visit(i, visited, order, ordered);
+    }
+
+    int inlined = 0;
+    for (int i = 0; i < count; i++) { // Callees are finished before their callers
+        IRFunction &caller = functions[order[i]];
+
+        for (int b = 0; b < caller.blocks.getSize(); b++) {
+            IRBlock *block = caller.blocks[b];
+            for (int j = 0; j < block->instructions.getSize(); j++) {
+                IRInstruction &instr = block->instructions[j];
+                int callee = instr.opcode == IR_CALL ? getCallee(instr) : -1;
+                if (callee < 0 || recursive[callee])
+                    continue;
+
+                int cost = getCost(caller, instr, callee);
+                if (cost > options.inlineThreshold ||
+                    caller.countInstructions() + functions[callee].countInstructions() > INLINER_MAX_CALLER_SIZE)
+                    continue;
+
+                report.push_back({caller.name, functions[callee].name, cost});
+                substitute(caller, b, j, callee); // Rest of the block moves to a new block visited later
+                inlined++;
+                break;
+            }
+        }
+    }
+
+    delete[] visited;
+    delete[] order;
+    return inlined;
+}
+
+void IRInliner::dump(FILE *out) {
+    if (!out)
+        throw_exception("Invalid pointer to output file");
+
+    for (int i = 0; i < report.getSize(); i++) {
+        fprintf(out, "Inline: %-16s into %-16s cost %d\n", report[i].callee ? report[i].callee : "?",
+                report[i].caller ? report[i].caller : "?", report[i].cost);
+    }
+    fprintf(out, "Inline: %d calls\n", static_cast<int>(report.getSize()));
+}
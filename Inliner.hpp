@@ -0,0 +1,45 @@
+#ifndef X86COMPILERBACKEND_INLINER_HPP
+#define X86COMPILERBACKEND_INLINER_HPP
+
+#include <cstdio>
+#include "IR.hpp"
+#include "Vector.hpp"
+#include "CompilerOptions.hpp"
+
+const int INLINER_CALL_OVERHEAD = 6;                                // call, prologue, epilogue and stack cleanup
+const int INLINER_CONSTANT_BONUS = 4;                               // Expected folding enabled by one constant argument
+const int INLINER_MAX_CALLER_SIZE = 2000;                           // Callers are not grown beyond this size
+
+struct InlinedCall {
+    const char *caller;                                             // Function that received the body
+    const char *callee;                                             // Function whose body was copied
+    int cost;                                                       // Cost model estimate of the call site
+};
+
+class IRInliner {
+private:
+    IRFunction *functions;                                          // All functions of the program
+    int functionCount;                                              // Number of functions
+    IRListingMap *listings;                                         // Function index by listing number
+    bool *recursive;                                                // Whether function can reach itself through calls
+    int *callSites;                                                 // Number of calls of every function
+    vector<InlinedCall> report;                                     // Calls substituted so far
+
+    int getCallee(IRInstruction &instr);                            // Function index of CALL target, -1 for runtime
+    void analyzeCalls();                                            // Fill call site counters and recursion flags
+    void visit(int function, bool *visited, int *order, int &count);// Callees before callers
+    int getCost(IRFunction &caller, IRInstruction &call, int callee); // Size increase minus expected savings
+    void substitute(IRFunction &caller, int block, int index, int callee); // Replace CALL with copy of callee
+
+public:
+    IRInliner();                                                    // Default constructor
+    IRInliner(const IRInliner &other) = delete;                     // Prohibit copy constructor
+    IRInliner &operator=(const IRInliner &other) = delete;          // Prohibit copy assignment
+    ~IRInliner();                                                   // Destructor
+
+    int run(IRFunction *functions, int count, IRListingMap &listings,
+            const CompilerOptions &options);                        // Inline calls, return their number
+    void dump(FILE *out);                                           // Print inlined calls
+};
+
+#endif //X86COMPILERBACKEND_INLINER_HPP
@@ -0,0 +1,125 @@
+#include "IROptimizer.hpp"
+#include "SSA.hpp"
+
+// Whether instruction may run on iterations where it was not reached
+static bool isSpeculatable(IRInstruction &instr) {
+    switch (instr.opcode) {
+        case IR_COPY:
+        case IR_ADD:
+        case IR_SUB:
+        case IR_MUL:
+        case IR_SQRT:
+        case IR_SELECT:
+            return true;
+
+        case IR_DIV: // Division that may trap stays where the program put it
+            return instr.b.isConstant && instr.b.value != 0 && instr.b.value != -1;
+
+        default:
+            return false;
+    }
+}
+
+class InvariantMotion {
+private:
+    IRFunction &func;                                               // Function in SSA form
+    DominatorTree dom;                                              // Finds back edges
+    int *defBlock;                                                  // Block that defines register, -1 for none
+    bool *inLoop;                                                   // Blocks of loop being processed
+    int *worklist;                                                  // Blocks to add to loop
+
+    bool isInvariant(IRInstruction &instr);                         // Every operand is defined outside of loop
+    int hoist(int header);                                          // Move invariants of loop into preheader
+
+public:
+    explicit InvariantMotion(IRFunction &func);                     // Record definitions
+    InvariantMotion(const InvariantMotion &other) = delete;         // Prohibit copy constructor
+    InvariantMotion &operator=(const InvariantMotion &other) = delete; // Prohibit copy assignment
+    ~InvariantMotion();                                             // Destructor
+
+    int run();                                                      // Process loops inner first, return moved count
+};
+
+InvariantMotion::InvariantMotion(IRFunction &func) : func(func), dom(func) {
+    int blockCount = func.blocks.getSize();
+    defBlock = new int[func.registerCount];
+    inLoop = new bool[blockCount];
+    worklist = new int[blockCount];
+
+    for (int i = 0; i < func.registerCount; i++) {
+        defBlock[i] = -1;
+    }
+
+    for (int i = 0; i < blockCount; i++) {
+        IRBlock *block = func.blocks[i];
+        for (int j = 0; j < block->instructions.getSize(); j++) {
+            IRInstruction &instr = block->instructions[j];
+            if (instr.opcode != IR_NOP && instr.dst >= 0)
+                defBlock[instr.dst] = i;
+        }
+    }
+}
+
+InvariantMotion::~InvariantMotion() {
+    delete[] defBlock;
+    delete[] inLoop;
+    delete[] worklist;
+}
+
+bool InvariantMotion::isInvariant(IRInstruction &instr) {
+    if (!isSpeculatable(instr))
+        return false;
+
+    for (int k = 0; k < func.getUseCount(instr); k++) {
+        IROperand op = func.getUse(instr, k);
+        if (!op.isConstant && defBlock[op.value] >= 0 && inLoop[defBlock[op.value]])
+            return false;
+    }
+
+    return true;
+}
+
+int InvariantMotion::hoist(int header) {
+    if (!irFindLoop(func, dom, header, inLoop, worklist))
+        return 0;
+
+    int preheader = irFindPreheader(func, header, inLoop);
+    if (preheader < 0)
+        return 0;
+
+    int moved = 0;
+    for (int i = 0; i < dom.order.getSize(); i++) { // Definitions are seen before their uses
+        int current = dom.order[i];
+        if (!inLoop[current])
+            continue;
+
+        IRBlock *block = func.blocks[current];
+        for (int j = 0; j < block->instructions.getSize(); j++) {
+            IRInstruction &instr = block->instructions[j];
+            if (instr.opcode == IR_NOP || !isInvariant(instr))
+                continue;
+
+            func.blocks[preheader]->instructions.push_back(instr);
+            defBlock[instr.dst] = preheader;
+            block->instructions[j].opcode = IR_NOP;
+            moved++;
+        }
+    }
+
+    return moved;
+}
+
+int InvariantMotion::run() {
+    int moved = 0;
+
+    for (int i = dom.order.getSize() - 1; i >= 0; i--) { // Inner loops come later in reverse postorder
+        moved += hoist(dom.order[i]);
+    }
+
+    return moved;
+}
+
+int irHoistInvariants(IRFunction &func, const CompilerOptions &options) {
+    InvariantMotion motion(func);
+    return motion.run();
+}
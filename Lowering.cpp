@@ -0,0 +1,844 @@
+#include <cstdlib>
+#include "Lowering.hpp"
+#include "utilities.hpp"
+
+const int LOWERING_MAX_DEPTH_WEIGHT = 4;                            // Loop depth above which uses are not weighted more
+
+struct Interval {
+    int reg;                                                        // Virtual register
+    int from;                                                       // First position where register is live
+    int to;                                                         // Last position where register is live
+    int weight;                                                     // Loop depth weighted number of occurrences
+};
+
+static int compareIntervals(const void *a, const void *b) {
+    const auto *first = static_cast<const Interval *>(a);
+    const auto *second = static_cast<const Interval *>(b);
+
+    if (first->from != second->from)
+        return first->from < second->from ? -1 : 1;
+
+    return first->reg - second->reg;
+}
+
+static CONDITION_CODE toConditionCode(IR_CONDITION condition) {
+    switch (condition) {
+        case IR_EQ:
+            return CC_E;
+        case IR_NE:
+            return CC_NE;
+        case IR_LT:
+            return CC_L;
+        case IR_LE:
+            return CC_LE;
+        case IR_GT:
+            return CC_G;
+        case IR_GE:
+            return CC_GE;
+    }
+    return CC_E;
+}
+
+// Function that calls nobody never pushes after prologue, so its frame is addressed through ESP by default
+static bool isLeaf(IRFunction &func) {
+    for (int i = 0; i < func.blocks.getSize(); i++) {
+        IRBlock *block = func.blocks[i];
+        for (int j = 0; j < block->instructions.getSize(); j++) {
+            if (block->instructions[j].opcode == IR_CALL)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+IRLowering::IRLowering(const CompilerOptions &options) : options(options), func(nullptr), listing(nullptr), order(),
+                                                         labels(nullptr), inRegister(nullptr), registers(nullptr),
+                                                         offsets(nullptr), frameSize(0), framePointer(true),
+                                                         savesEBP(false), base(EBP), depth(0) {}
+
+bool IRLowering::clobbersRegisters(IRInstruction &instr) {
+    switch (instr.opcode) {
+        case IR_CALL: // Compiled functions and runtime routines preserve only EBP and ESP
+        case IR_INPUT:
+        case IR_OUTPUT:
+            return true;
+
+        case IR_SQRT:
+            return !options.sse2;
+
+        default:
+            return false;
+    }
+}
+
+void IRLowering::allocate() {
+    int regCount = func->registerCount;
+    int blockCount = func->blocks.getSize();
+    int words = irBitsetWords(regCount);
+
+    // Number positions: instruction i reads its operands at 2i and writes result at 2i + 1
+    int *blockFrom = new int[blockCount]();
+    int *blockTo = new int[blockCount]();
+    int position = 0;
+    for (int i = 0; i < order.getSize(); i++) {
+        IRBlock *block = func->blocks[order[i]];
+        blockFrom[order[i]] = position;
+        position += 2 * (block->instructions.getSize() + 1);
+        blockTo[order[i]] = position - 1;
+    }
+
+    IRLiveness liveness(*func, order);
+
+    // Build one conservative interval per register and find registers that live across calls
+    Interval *intervals = new Interval[regCount];
+    bool *crossesCall = new bool[regCount]();
+    bool *isArgument = new bool[regCount]();
+    int *argumentNumber = new int[regCount]();
+    for (int i = 0; i < regCount; i++) {
+        intervals[i] = {i, -1, -1, 0};
+    }
+
+    auto *live = new unsigned int[words];
+    for (int i = 0; i < order.getSize(); i++) {
+        int current = order[i];
+        IRBlock *block = func->blocks[current];
+        int weight = 1;
+        for (int d = 0; d < block->loopDepth && d < LOWERING_MAX_DEPTH_WEIGHT; d++) {
+            weight *= 10;
+        }
+
+        for (int w = 0; w < words; w++) {
+            live[w] = liveness.getLiveOut(current)[w];
+        }
+
+        for (int reg = 0; reg < regCount; reg++) {
+            Interval &interval = intervals[reg];
+            if (irTestBit(liveness.getLiveIn(current), reg) && (interval.from < 0 || blockFrom[current] < interval.from))
+                interval.from = blockFrom[current];
+
+            if (irTestBit(live, reg) && blockTo[current] > interval.to) {
+                interval.to = blockTo[current];
+                if (interval.from < 0)
+                    interval.from = blockFrom[current];
+            }
+        }
+
+        int pos = blockTo[current] - 1;
+        for (int k = 0; k < func->getUseCount(block); k++) {
+            IROperand op = func->getUse(block, k);
+            if (op.isConstant)
+                continue;
+
+            irSetBit(live, op.value);
+            Interval &interval = intervals[op.value];
+            interval.weight += weight;
+            if (interval.to < pos)
+                interval.to = pos;
+            if (interval.from < 0 || interval.from > pos)
+                interval.from = pos;
+        }
+
+        for (int j = block->instructions.getSize() - 1; j >= 0; j--) {
+            IRInstruction &instr = block->instructions[j];
+            if (instr.opcode == IR_NOP)
+                continue;
+
+            pos = blockFrom[current] + 2 * j;
+
+            if (clobbersRegisters(instr)) {
+                for (int reg = 0; reg < regCount; reg++) {
+                    if (reg != instr.dst && irTestBit(live, reg))
+                        crossesCall[reg] = true;
+                }
+            }
+
+            if (instr.dst >= 0) {
+                irClearBit(live, instr.dst);
+                Interval &interval = intervals[instr.dst];
+                interval.weight += weight;
+                if (interval.from < 0 || interval.from > pos + 1)
+                    interval.from = pos + 1;
+                if (interval.to < pos + 1)
+                    interval.to = pos + 1;
+
+                if (instr.opcode == IR_ARG) {
+                    isArgument[instr.dst] = true;
+                    argumentNumber[instr.dst] = instr.a.value;
+                }
+            }
+
+            for (int k = 0; k < func->getUseCount(instr); k++) {
+                IROperand op = func->getUse(instr, k);
+                if (op.isConstant)
+                    continue;
+
+                irSetBit(live, op.value);
+                Interval &interval = intervals[op.value];
+                interval.weight += weight;
+                if (interval.to < pos)
+                    interval.to = pos;
+                if (interval.from < 0 || interval.from > pos)
+                    interval.from = pos;
+            }
+        }
+    }
+
+    // Linear scan over intervals sorted by start, spilling the cheapest one when registers run out. EBP is the last
+    // register, it is given out only without frame pointer and, as every callee preserves it, may live across calls
+    int available = framePointer ? LOWERING_REGISTER_COUNT - 1 : LOWERING_REGISTER_COUNT;
+    Interval *sorted = new Interval[regCount];
+    int candidates = 0;
+    for (int i = 0; i < regCount; i++) {
+        if (intervals[i].from >= 0 && (!crossesCall[i] || !framePointer))
+            sorted[candidates++] = intervals[i];
+    }
+    qsort(sorted, candidates, sizeof(Interval), compareIntervals);
+
+    int active[LOWERING_REGISTER_COUNT];
+    for (int i = 0; i < LOWERING_REGISTER_COUNT; i++) {
+        active[i] = -1;
+    }
+
+    for (int i = 0; i < regCount; i++) {
+        inRegister[i] = false;
+    }
+
+    for (int i = 0; i < candidates; i++) {
+        Interval &current = sorted[i];
+        int first = crossesCall[current.reg] ? available - 1 : 0; // First register that survives the interval
+        int freeSlot = -1;
+
+        for (int r = 0; r < available; r++) {
+            if (active[r] >= 0 && intervals[active[r]].to < current.from)
+                active[r] = -1; // Interval expired
+
+            if (active[r] < 0 && freeSlot < 0 && r >= first)
+                freeSlot = r;
+        }
+
+        if (freeSlot < 0) {
+            int victim = -1;
+            for (int r = first; r < available; r++) {
+                Interval &candidate = intervals[active[r]];
+                if (victim < 0 || candidate.weight < intervals[active[victim]].weight ||
+                    (candidate.weight == intervals[active[victim]].weight &&
+                     candidate.to > intervals[active[victim]].to))
+                    victim = r;
+            }
+
+            Interval &spilled = intervals[active[victim]];
+            if (spilled.weight > current.weight || (spilled.weight == current.weight && spilled.to <= current.to))
+                continue; // Current interval is the cheapest one, it stays in memory
+
+            inRegister[spilled.reg] = false;
+            freeSlot = victim;
+        }
+
+        active[freeSlot] = current.reg;
+        inRegister[current.reg] = true;
+        registers[current.reg] = LOWERING_REGISTERS[freeSlot];
+    }
+
+    savesEBP = false;
+    for (int i = 0; i < regCount; i++) {
+        if (inRegister[i] && registers[i] == EBP)
+            savesEBP = true;
+    }
+
+    // Everything else lives in the stack frame, stack arguments stay where caller put them
+    int spilled = 0;
+    for (int i = 0; i < regCount; i++) {
+        if (inRegister[i] || intervals[i].from < 0)
+            continue;
+
+        if (isArgument[i] && argumentNumber[i] >= FASTCALL_REGISTER_COUNT) {
+            offsets[i] = argumentOffset(argumentNumber[i]);
+        } else {
+            sorted[spilled++] = intervals[i];
+        }
+    }
+    qsort(sorted, spilled, sizeof(Interval), compareIntervals);
+
+    // Registers whose intervals do not overlap share one slot
+    int *slotEnd = new int[spilled + 1];
+    frameSize = 0;
+    for (int i = 0; i < spilled; i++) {
+        int slot = 0;
+        while (slot < frameSize && slotEnd[slot] >= sorted[i].from)
+            slot++;
+
+        if (slot == frameSize)
+            frameSize++;
+
+        slotEnd[slot] = sorted[i].to;
+        offsets[sorted[i].reg] = -4 * (slot + 1 + savesEBP); // Saved EBP is pushed right below return address
+    }
+    delete[] slotEnd;
+
+    delete[] blockFrom;
+    delete[] blockTo;
+    delete[] intervals;
+    delete[] crossesCall;
+    delete[] isArgument;
+    delete[] argumentNumber;
+    delete[] live;
+    delete[] sorted;
+}
+
+int IRLowering::argumentOffset(int number) {
+    // Return address and, with frame pointer, saved EBP are below arguments, leading arguments come in registers
+    return (framePointer ? 8 : 4) + 4 * (number - FASTCALL_REGISTER_COUNT);
+}
+
+int IRLowering::address(int offset) {
+    if (framePointer)
+        return offset;
+
+    return offset + 4 * (frameSize + savesEBP) + depth; // ESP moves with every push
+}
+
+void IRLowering::leave() {
+    if (framePointer) {
+        listing->mov(ESP, EBP); // Restore old stack pointer i. e. deallocate everything
+        listing->pop(EBP); // Restore old stack frame
+        return;
+    }
+
+    if (frameSize)
+        listing->add(ESP, 4 * frameSize);
+    if (savesEBP)
+        listing->pop(EBP);
+}
+
+bool IRLowering::isRegister(IROperand op) {
+    return !op.isConstant && inRegister[op.value];
+}
+
+bool IRLowering::isMemory(IROperand op) {
+    return !op.isConstant && !inRegister[op.value];
+}
+
+void IRLowering::load(REGISTER to, IROperand op) {
+    if (op.isConstant && op.value == 0) { // Loads never go between cmp and the instruction that reads flags
+        listing->zero(to);
+    } else if (op.isConstant) {
+        listing->mov(to, op.value);
+    } else if (inRegister[op.value]) {
+        if (registers[op.value] != to)
+            listing->mov(to, registers[op.value]);
+    } else {
+        listing->mov(to, base, address(offsets[op.value]));
+    }
+}
+
+void IRLowering::store(int reg, REGISTER from) {
+    if (inRegister[reg]) {
+        if (registers[reg] != from)
+            listing->mov(registers[reg], from);
+    } else {
+        listing->mov(base, address(offsets[reg]), from);
+    }
+}
+
+void IRLowering::copy(int dst, IROperand src) {
+    if (inRegister[dst]) {
+        load(registers[dst], src);
+    } else if (src.isConstant) {
+        listing->mov_dword(base, address(offsets[dst]), src.value);
+    } else if (inRegister[src.value]) {
+        listing->mov(base, address(offsets[dst]), registers[src.value]);
+    } else if (offsets[src.value] != offsets[dst]) {
+        listing->mov(EAX, base, address(offsets[src.value]));
+        listing->mov(base, address(offsets[dst]), EAX);
+    }
+}
+
+void IRLowering::lowerArithmetic(IRInstruction &instr) {
+    IROperand a = instr.a;
+    IROperand b = instr.b;
+    int dst = instr.dst;
+    bool commutative = instr.opcode == IR_ADD || instr.opcode == IR_MUL;
+
+    if (!inRegister[dst] && irIsRegister(a, dst) && b.isConstant && instr.opcode != IR_MUL) {
+        // x = x +- c straight in memory, negated through unsigned so that INT_MIN wraps to itself
+        int delta = instr.opcode == IR_ADD ? b.value : static_cast<int>(0u - static_cast<unsigned int>(b.value));
+        if (delta == 1) {
+            listing->inc(base, address(offsets[dst]));
+        } else if (delta == -1) {
+            listing->dec(base, address(offsets[dst]));
+        } else if (delta != 0) {
+            listing->add(base, address(offsets[dst]), delta);
+        }
+        return;
+    }
+
+    if (commutative && a.isConstant && !b.isConstant) { // Keep constant on the right
+        IROperand tmp = a;
+        a = b;
+        b = tmp;
+    }
+
+    REGISTER target = inRegister[dst] ? registers[dst] : EAX;
+    if (commutative && isRegister(b) && registers[b.value] == target) {
+        IROperand tmp = a;
+        a = b;
+        b = tmp;
+    }
+
+    if (isRegister(b) && registers[b.value] == target && !(isRegister(a) && registers[a.value] == target))
+        target = EAX; // Loading a would destroy b
+
+    if (instr.opcode == IR_MUL && b.isConstant) {
+        if (!isReducibleMultiplier(b.value) && isRegister(a)) {
+            listing->imul(target, registers[a.value], b.value);
+        } else if (!isReducibleMultiplier(b.value) && isMemory(a)) {
+            listing->imul(target, base, address(offsets[a.value]), b.value);
+        } else {
+            load(target, a);
+            listing->multiply(target, b.value);
+        }
+
+        store(dst, target);
+        return;
+    }
+
+    load(target, a);
+
+    switch (instr.opcode) {
+        case IR_ADD:
+            if (b.isConstant) {
+                if (b.value == 1) {
+                    listing->inc(target);
+                } else if (b.value == -1) {
+                    listing->dec(target);
+                } else if (b.value != 0) {
+                    listing->add(target, b.value);
+                }
+            } else if (isRegister(b)) {
+                listing->add(target, registers[b.value]);
+            } else {
+                listing->add(target, base, address(offsets[b.value]));
+            }
+            break;
+
+        case IR_SUB:
+            if (b.isConstant) {
+                if (b.value == 1) {
+                    listing->dec(target);
+                } else if (b.value == -1) {
+                    listing->inc(target);
+                } else if (b.value != 0) {
+                    listing->sub(target, b.value);
+                }
+            } else if (isRegister(b)) {
+                listing->sub(target, registers[b.value]);
+            } else {
+                listing->sub(target, base, address(offsets[b.value]));
+            }
+            break;
+
+        case IR_MUL:
+            if (isRegister(b)) {
+                listing->imul(target, registers[b.value]);
+            } else {
+                listing->imul_rm(target, base, address(offsets[b.value]));
+            }
+            break;
+
+        default:
+            throw_exception("Invalid arithmetic IR instruction");
+    }
+
+    store(dst, target);
+}
+
+void IRLowering::lowerInstruction(IRInstruction &instr) {
+    switch (instr.opcode) {
+        case IR_NOP:
+            break;
+
+        case IR_COPY:
+            copy(instr.dst, instr.a);
+            break;
+
+        case IR_ADD:
+        case IR_SUB:
+        case IR_MUL:
+            lowerArithmetic(instr);
+            break;
+
+        case IR_DIV:
+            load(EAX, instr.a);
+            if (instr.b.isConstant) {
+                listing->divide(instr.b.value);
+            } else if (isRegister(instr.b)) {
+                listing->cdq();
+                listing->idiv(registers[instr.b.value]);
+            } else {
+                load(EBX, instr.b);
+                listing->cdq();
+                listing->idiv(EBX);
+            }
+            store(instr.dst, EAX);
+            break;
+
+        case IR_SQRT:
+            load(EAX, instr.a);
+            if (options.sse2) {
+                listing->cdq();
+                listing->logical_not(EDX);
+                listing->logical_and(EAX, EDX); // Clear negative radicand
+                listing->cvtsi2sd(XMM0, EAX);
+                listing->sqrtsd(XMM0, XMM0);
+                listing->cvttsd2si(EAX, XMM0);
+            } else {
+                listing->call(2);
+            }
+            store(instr.dst, EAX);
+            break;
+
+        case IR_ARG:
+            if (instr.a.value < FASTCALL_REGISTER_COUNT) {
+                store(instr.dst, FASTCALL_REGISTERS[instr.a.value]);
+            } else if (inRegister[instr.dst]) {
+                listing->mov(registers[instr.dst], base, address(argumentOffset(instr.a.value)));
+            } else if (offsets[instr.dst] != argumentOffset(instr.a.value)) {
+                listing->mov(EAX, base, address(argumentOffset(instr.a.value)));
+                store(instr.dst, EAX);
+            }
+            break;
+
+        case IR_INPUT:
+            listing->call(0);
+            store(instr.dst, EAX);
+            break;
+
+        case IR_OUTPUT:
+            load(EAX, instr.a);
+            listing->call(1);
+            break;
+
+        case IR_CALL:
+            for (int i = instr.poolCount - 1; i >= FASTCALL_REGISTER_COUNT; i--) { // First argument is pushed last
+                IROperand arg = func->pool[instr.poolStart + i];
+                if (arg.isConstant) {
+                    listing->push(arg.value);
+                } else if (inRegister[arg.value]) {
+                    listing->push(registers[arg.value]);
+                } else {
+                    listing->push(base, address(offsets[arg.value])); // Address is taken before ESP moves
+                }
+                depth += 4;
+            }
+
+            for (int i = 0; i < instr.poolCount && i < FASTCALL_REGISTER_COUNT; i++) {
+                load(FASTCALL_REGISTERS[i], func->pool[instr.poolStart + i]);
+            }
+
+            listing->call(instr.a.value); // Callee pops stack arguments
+            depth -= getStackArgumentsSize(instr.poolCount);
+            store(instr.dst, EAX);
+            break;
+
+        case IR_SELECT:
+            lowerSelect(instr);
+            break;
+
+        case IR_PHI:
+            throw_exception("PHI instructions must be eliminated before lowering");
+    }
+}
+
+void IRLowering::jump(IR_CONDITION condition, int block) {
+    switch (condition) {
+        case IR_EQ:
+            listing->je(labels[block]);
+            break;
+        case IR_NE:
+            listing->jne(labels[block]);
+            break;
+        case IR_LT:
+            listing->jl(labels[block]);
+            break;
+        case IR_LE:
+            listing->jle(labels[block]);
+            break;
+        case IR_GT:
+            listing->jg(labels[block]);
+            break;
+        case IR_GE:
+            listing->jge(labels[block]);
+            break;
+    }
+}
+
+IR_CONDITION IRLowering::compare(IR_CONDITION condition, IROperand a, IROperand b, REGISTER scratch) {
+    if (a.isConstant || (isMemory(a) && isRegister(b))) { // cmp takes immediate and memory only on the right
+        IROperand tmp = a;
+        a = b;
+        b = tmp;
+        condition = irMirror(condition);
+    }
+
+    if (isRegister(a)) {
+        if (b.isConstant) {
+            listing->cmp(registers[a.value], b.value);
+        } else if (isRegister(b)) {
+            listing->cmp(registers[a.value], registers[b.value]);
+        } else {
+            listing->cmp(registers[a.value], base, address(offsets[b.value]));
+        }
+    } else if (b.isConstant) {
+        listing->cmp(base, address(offsets[a.value]), b.value);
+    } else {
+        listing->mov(scratch, base, address(offsets[a.value]));
+        listing->cmp(scratch, base, address(offsets[b.value]));
+    }
+
+    return condition;
+}
+
+void IRLowering::lowerSelect(IRInstruction &instr) {
+    IROperand left = func->pool[instr.poolStart];
+    IROperand right = func->pool[instr.poolStart + 1];
+    IROperand onTrue = func->pool[instr.poolStart + 2];
+    IROperand onFalse = func->pool[instr.poolStart + 3];
+    auto condition = static_cast<IR_CONDITION>(instr.a.value);
+    int dst = instr.dst;
+
+    if (left.isConstant && right.isConstant) { // Known at compile time
+        copy(dst, irEvaluate(condition, left.value, right.value) ? onTrue : onFalse);
+        return;
+    }
+
+    if (onTrue.isConstant && onFalse.isConstant && onTrue.value + onFalse.value == 1 &&
+        (onTrue.value == 0 || onTrue.value == 1)) { // Selection of 0 or 1 is the flag itself
+        if (onTrue.value == 0)
+            condition = irNegate(condition);
+
+        REGISTER target = inRegister[dst] ? registers[dst] : EAX;
+        condition = compare(condition, left, right, EAX);
+        listing->setcc(toConditionCode(condition), DL);
+        listing->movzx(target, DL);
+        store(dst, target);
+        return;
+    }
+
+    // Result starts as the false value and is overwritten by cmov, so it must not hold what cmp and cmov read
+    REGISTER target = inRegister[dst] ? registers[dst] : EAX;
+    IROperand reads[3] = {left, right, onTrue};
+    for (int i = 0; i < 3; i++) {
+        if (isRegister(reads[i]) && registers[reads[i].value] == target)
+            target = EAX;
+    }
+
+    load(target, onFalse); // Immediate loads go before cmp since zeroing with xor clobbers flags
+    if (onTrue.isConstant)
+        load(EDX, onTrue);
+
+    CONDITION_CODE cc = toConditionCode(compare(condition, left, right, EBX));
+    if (onTrue.isConstant) {
+        listing->cmov(cc, target, EDX);
+    } else if (isRegister(onTrue)) {
+        listing->cmov(cc, target, registers[onTrue.value]);
+    } else {
+        listing->cmov(cc, target, base, address(offsets[onTrue.value]));
+    }
+    store(dst, target);
+}
+
+void IRLowering::lowerTerminator(IRBlock *block, int next) {
+    switch (block->terminator) {
+        case IR_JUMP:
+            if (block->targets[0] != next)
+                listing->jmp(labels[block->targets[0]]);
+            break;
+
+        case IR_BRANCH: {
+            IROperand a = block->a;
+            IROperand b = block->b;
+            IR_CONDITION condition = block->condition;
+            int onTrue = block->targets[0];
+            int onFalse = block->targets[1];
+
+            if (a.isConstant && b.isConstant) { // Known at compile time
+                int target = irEvaluate(condition, a.value, b.value) ? onTrue : onFalse;
+                if (target != next)
+                    listing->jmp(labels[target]);
+                break;
+            }
+
+            condition = compare(condition, a, b, EAX);
+            if (onTrue == next) {
+                jump(irNegate(condition), onFalse);
+            } else {
+                jump(condition, onTrue);
+                if (onFalse != next)
+                    listing->jmp(labels[onFalse]);
+            }
+            break;
+        }
+
+        case IR_RETURN:
+            load(EAX, block->a);
+            leave();
+            listing->ret(getStackArgumentsSize(func->argumentCount));
+            break;
+    }
+}
+
+int IRLowering::findTailCall(IRBlock *block) {
+    if (block->terminator != IR_RETURN || block->a.isConstant)
+        return -1;
+
+    for (int j = block->instructions.getSize() - 1; j >= 0; j--) {
+        IRInstruction &instr = block->instructions[j];
+        if (instr.opcode == IR_NOP)
+            continue;
+
+        // Callee pops what our caller pushed, so both have to take the same number of stack arguments
+        if (instr.opcode == IR_CALL && instr.dst == block->a.value &&
+            getStackArgumentsSize(instr.poolCount) == getStackArgumentsSize(func->argumentCount))
+            return j;
+
+        return -1;
+    }
+
+    return -1;
+}
+
+void IRLowering::lowerTailCall(IRInstruction &call) {
+    bool overlaps = false; // Whether some argument reads a stack slot overwritten before it
+    for (int i = 0; i < call.poolCount; i++) {
+        IROperand arg = func->pool[call.poolStart + i];
+        int written = i < FASTCALL_REGISTER_COUNT ? call.poolCount : i; // Registers are loaded after the stack is ready
+        if (isMemory(arg) && offsets[arg.value] >= argumentOffset(FASTCALL_REGISTER_COUNT) &&
+            offsets[arg.value] < argumentOffset(written))
+            overlaps = true;
+    }
+
+    if (overlaps) {
+        for (int i = call.poolCount - 1; i >= 0; i--) { // Go through the stack like an ordinary call
+            IROperand arg = func->pool[call.poolStart + i];
+            if (arg.isConstant) {
+                listing->push(arg.value);
+            } else if (inRegister[arg.value]) {
+                listing->push(registers[arg.value]);
+            } else {
+                listing->push(base, address(offsets[arg.value]));
+            }
+            depth += 4;
+        }
+
+        for (int i = 0; i < call.poolCount; i++) {
+            if (i < FASTCALL_REGISTER_COUNT) {
+                listing->pop(FASTCALL_REGISTERS[i]);
+                depth -= 4;
+            } else {
+                listing->pop(ECX); // Every value is on the stack, so allocated registers are free
+                depth -= 4;
+                listing->mov(base, address(argumentOffset(i)), ECX);
+            }
+        }
+    } else {
+        for (int i = FASTCALL_REGISTER_COUNT; i < call.poolCount; i++) {
+            IROperand arg = func->pool[call.poolStart + i];
+            if (arg.isConstant) {
+                listing->mov_dword(base, address(argumentOffset(i)), arg.value);
+            } else if (inRegister[arg.value]) {
+                listing->mov(base, address(argumentOffset(i)), registers[arg.value]);
+            } else if (offsets[arg.value] != argumentOffset(i)) {
+                listing->mov(EAX, base, address(offsets[arg.value]));
+                listing->mov(base, address(argumentOffset(i)), EAX);
+            }
+        }
+
+        for (int i = 0; i < call.poolCount && i < FASTCALL_REGISTER_COUNT; i++) {
+            load(FASTCALL_REGISTERS[i], func->pool[call.poolStart + i]);
+        }
+    }
+
+    leave();
+    listing->jmp_listing(call.a.value); // Callee returns straight to our caller
+}
+
+AssemblyListing IRLowering::lower(IRFunction &function) {
+    AssemblyListing result;
+    func = &function;
+    listing = &result;
+
+    func->computePredecessors();
+    func->reversePostorder(order);
+
+    // Register arguments must be saved before the first instruction that uses EAX, EDX or EBX as scratch
+    IRBlock *entry = func->blocks[0];
+    int entrySize = entry->instructions.getSize();
+    auto *instructions = new IRInstruction[entrySize];
+    for (int j = 0; j < entrySize; j++) {
+        instructions[j] = entry->instructions[j];
+    }
+
+    entry->instructions.clear();
+    for (int pass = 0; pass < 2; pass++) {
+        for (int j = 0; j < entrySize; j++) {
+            if ((instructions[j].opcode == IR_ARG) == (pass == 0))
+                entry->instructions.push_back(instructions[j]);
+        }
+    }
+    delete[] instructions;
+
+    int regCount = func->registerCount;
+    labels = new int[func->blocks.getSize()];
+    inRegister = new bool[regCount]();
+    registers = new REGISTER[regCount];
+    offsets = new int[regCount]();
+
+    framePointer = !options.omitFramePointer && !isLeaf(*func);
+    base = framePointer ? EBP : ESP;
+    depth = 0;
+    allocate();
+
+    if (framePointer) {
+        result.push(EBP); // Preserve caller stack frame
+        result.mov(EBP, ESP); // Create stack frame
+    } else if (savesEBP) {
+        result.push(EBP); // EBP holds virtual register, caller expects it back
+    }
+    if (frameSize)
+        result.sub(ESP, 4 * frameSize); // Stack slots of spilled registers
+
+    for (int i = 0; i < order.getSize(); i++) {
+        labels[order[i]] = result.reserveLocalLabel();
+    }
+
+    for (int i = 0; i < order.getSize(); i++) {
+        IRBlock *block = func->blocks[order[i]];
+        result.placeLocalLabel(labels[order[i]]);
+
+        int tail = findTailCall(block);
+        for (int j = 0; j < block->instructions.getSize(); j++) {
+            if (j == tail) {
+                lowerTailCall(block->instructions[j]);
+            } else {
+                lowerInstruction(block->instructions[j]);
+            }
+        }
+
+        if (tail < 0)
+            lowerTerminator(block, i + 1 < order.getSize() ? order[i + 1] : -1);
+    }
+
+    delete[] labels;
+    delete[] inRegister;
+    delete[] registers;
+    delete[] offsets;
+    labels = nullptr;
+    inRegister = nullptr;
+    registers = nullptr;
+    offsets = nullptr;
+    func = nullptr;
+    listing = nullptr;
+
+    return result;
+}
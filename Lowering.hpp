@@ -0,0 +1,58 @@
+#ifndef X86COMPILERBACKEND_LOWERING_HPP
+#define X86COMPILERBACKEND_LOWERING_HPP
+
+#include "IR.hpp"
+#include "AssemblyTools.hpp"
+#include "CompilerOptions.hpp"
+
+const int LOWERING_REGISTER_COUNT = 4;                              // Machine registers given to virtual registers
+const REGISTER LOWERING_REGISTERS[LOWERING_REGISTER_COUNT] = {ECX, ESI, EDI, EBP}; // EAX, EBX and EDX are scratch
+
+class IRLowering {
+private:
+    const CompilerOptions &options;                                 // Target features
+    IRFunction *func;                                               // Function being lowered
+    AssemblyListing *listing;                                       // Listing being generated
+    vector<int> order;                                              // Block layout
+    int *labels;                                                    // Local label of every block
+    bool *inRegister;                                               // Whether virtual register lives in machine register
+    REGISTER *registers;                                            // Machine register of virtual register
+    int *offsets;                                                   // Stack slot of virtual register relative to frame base
+    int frameSize;                                                  // Number of allocated stack slots
+    bool framePointer;                                              // Whether EBP is frame base, otherwise ESP on entry is
+    bool savesEBP;                                                  // Whether EBP holds virtual register and is saved on entry
+    REGISTER base;                                                  // Register stack slots are addressed through
+    int depth;                                                      // Bytes pushed on top of frame at current point
+
+    void allocate();                                                // Liveness analysis and linear scan allocation
+    bool clobbersRegisters(IRInstruction &instr);                   // Whether instruction destroys allocated registers
+
+    int argumentOffset(int number);                                 // Offset of argument relative to frame base
+    int address(int offset);                                        // Displacement from base of frame offset
+    void leave();                                                   // Deallocate frame and restore EBP
+
+    bool isRegister(IROperand op);                                  // Operand is in machine register
+    bool isMemory(IROperand op);                                    // Operand is in stack slot
+    void load(REGISTER to, IROperand op);                           // to = op
+    void store(int reg, REGISTER from);                             // reg = from
+    void copy(int dst, IROperand src);                              // dst = src
+
+    void lowerInstruction(IRInstruction &instr);                    // Select instructions for IR instruction
+    void lowerArithmetic(IRInstruction &instr);                     // ADD, SUB and MUL
+    void lowerSelect(IRInstruction &instr);                         // SELECT with cmov or setcc
+    IR_CONDITION compare(IR_CONDITION condition, IROperand a, IROperand b,
+                         REGISTER scratch);                         // Emit cmp, return condition to test afterwards
+    void lowerTerminator(IRBlock *block, int next);                 // Jumps and return, next is the following block
+    int findTailCall(IRBlock *block);                               // CALL whose result block returns, -1 if none
+    void lowerTailCall(IRInstruction &call);                        // Reuse own argument slots and jump to callee
+    void jump(IR_CONDITION condition, int block);                   // Conditional jump to block
+
+public:
+    explicit IRLowering(const CompilerOptions &options);            // Lowering for target
+    IRLowering(const IRLowering &other) = delete;                   // Prohibit copy constructor
+    IRLowering &operator=(const IRLowering &other) = delete;        // Prohibit copy assignment
+
+    AssemblyListing lower(IRFunction &function);                    // Translate function into listing
+};
+
+#endif //X86COMPILERBACKEND_LOWERING_HPP
@@ -0,0 +1,121 @@
+#include "Memoizer.hpp"
+#include "utilities.hpp"
+
+IRMemoizer::IRMemoizer() : functions(nullptr), functionCount(0), listings(nullptr), pure(nullptr), report() {}
+
+IRMemoizer::~IRMemoizer() {
+    delete[] pure;
+}
+
+void IRMemoizer::analyze(IRFunction *functions, int count, IRListingMap &listings) {
+    if (!functions)
+        throw_exception("Invalid pointer to functions provided");
+
+    this->functions = functions;
+    functionCount = count;
+    this->listings = &listings;
+
+    delete[] pure;
+    pure = new bool[count];
+    for (int i = 0; i < count; i++) {
+        pure[i] = true;
+    }
+
+    bool changed = true;
+    while (changed) { // Impurity spreads from callees to callers until nothing changes
+        changed = false;
+        for (int i = 0; i < count; i++) {
+            IRFunction &func = functions[i];
+            for (int b = 0; pure[i] && b < func.blocks.getSize(); b++) {
+                IRBlock *block = func.blocks[b];
+                for (int j = 0; pure[i] && j < block->instructions.getSize(); j++) {
+                    IRInstruction &instr = block->instructions[j];
+                    int callee = instr.opcode == IR_CALL ? listings.indexOf(instr.a.value) : -1;
+                    if (instr.opcode == IR_INPUT || instr.opcode == IR_OUTPUT ||
+                        (instr.opcode == IR_CALL && (callee < 0 || !pure[callee]))) {
+                        pure[i] = false;
+                        changed = true;
+                    }
+                }
+            }
+        }
+    }
+}
+
+bool IRMemoizer::isMemoizable(IRFunction &func) {
+    int index = listings ? listings->indexOf(func.number) : -1;
+    if (index < 0 || !pure[index] || func.argumentCount < 1 || func.argumentCount > FASTCALL_REGISTER_COUNT)
+        return false;
+
+    // Recursion that tailrec turned into a loop gains nothing from the table
+    for (int b = 0; b < func.blocks.getSize(); b++) {
+        IRBlock *block = func.blocks[b];
+        for (int j = 0; j < block->instructions.getSize(); j++) {
+            IRInstruction &instr = block->instructions[j];
+            if (instr.opcode == IR_CALL && instr.a.value == func.number)
+                return true;
+        }
+    }
+
+    return false;
+}
+
+AssemblyListing IRMemoizer::wrap(IRFunction &func, int worker, AssemblyProgram &prog) {
+    // Entry holds valid flag, arguments and result, padded to a power of two
+    int arguments = func.argumentCount;
+    unsigned char scale = arguments + 2 > 4 ? 5 : 4;
+    auto table = static_cast<int>(prog.reserveData(1u << (MEMOIZER_TABLE_BITS + scale)));
+    int result = 4 * (arguments + 1);
+
+    AssemblyListing lookup;
+    int missLabel = lookup.reserveLocalLabel();
+
+    // Arguments stay in EAX, EDX and EBX, ECX is free to clobber by our convention
+    lookup.imul(ECX, EAX, MEMOIZER_HASH_FACTOR);
+    for (int k = 1; k < arguments; k++) {
+        lookup.add(ECX, FASTCALL_REGISTERS[k]);
+        lookup.imul(ECX, ECX, MEMOIZER_HASH_FACTOR);
+    }
+    lookup.shr(ECX, 32 - MEMOIZER_TABLE_BITS);
+    lookup.shl(ECX, scale);
+
+    lookup.cmp(ECX, table, 0);
+    lookup.je(missLabel);
+    for (int k = 0; k < arguments; k++) {
+        lookup.cmp(FASTCALL_REGISTERS[k], ECX, table + 4 * (k + 1));
+        lookup.jne(missLabel);
+    }
+    lookup.mov(EAX, ECX, table + result);
+    lookup.ret();
+
+    lookup.placeLocalLabel(missLabel);
+    for (int k = 0; k < arguments; k++) {
+        lookup.push(FASTCALL_REGISTERS[k]);
+    }
+    lookup.push(ECX);
+    lookup.call(worker);
+    lookup.pop(ECX);
+
+    // Entry is filled after the call, recursive calls may have reused it meanwhile
+    lookup.mov(ECX, table + result, EAX);
+    lookup.mov_dword(ECX, table, 1);
+    for (int k = arguments - 1; k >= 0; k--) {
+        lookup.pop(EDX);
+        lookup.mov(ECX, table + 4 * (k + 1), EDX);
+    }
+    lookup.ret();
+
+    report.push_back({func.name, func.number, worker, static_cast<unsigned int>(table)});
+    return lookup;
+}
+
+void IRMemoizer::dump(FILE *out) {
+    if (!out)
+        throw_exception("Invalid pointer to output file");
+
+    for (int i = 0; i < report.getSize(); i++) {
+        fprintf(out, "Memoize: %-16s listing %d, body %d, table at 0x%08x\n", report[i].name ? report[i].name : "?",
+                report[i].number, report[i].worker, report[i].table);
+    }
+    fprintf(out, "Memoize: %d functions\n", static_cast<int>(report.getSize()));
+}
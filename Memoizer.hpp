@@ -0,0 +1,40 @@
+#ifndef X86COMPILERBACKEND_MEMOIZER_HPP
+#define X86COMPILERBACKEND_MEMOIZER_HPP
+
+#include <cstdio>
+#include "IR.hpp"
+#include "Vector.hpp"
+#include "AssemblyTools.hpp"
+
+const int MEMOIZER_TABLE_BITS = 12;                                 // Table of every function has 2^bits entries
+const int MEMOIZER_HASH_FACTOR = static_cast<int>(0x9e3779b1u);     // Multiplier that spreads arguments over high bits
+
+struct MemoizedFunction {
+    const char *name;                                               // Function whose results are cached
+    int number;                                                     // Listing of the lookup, callers keep calling it
+    int worker;                                                     // Listing of the original body
+    unsigned int table;                                             // Address of the table in .bss
+};
+
+class IRMemoizer {
+private:
+    IRFunction *functions;                                          // All functions of the program
+    int functionCount;                                              // Number of functions
+    IRListingMap *listings;                                         // Function index by listing number
+    bool *pure;                                                     // Whether function has no side effects
+    vector<MemoizedFunction> report;                                // Functions wrapped so far
+
+public:
+    IRMemoizer();                                                   // Default constructor
+    IRMemoizer(const IRMemoizer &other) = delete;                   // Prohibit copy constructor
+    IRMemoizer &operator=(const IRMemoizer &other) = delete;        // Prohibit copy assignment
+    ~IRMemoizer();                                                  // Destructor
+
+    void analyze(IRFunction *functions, int count,
+                 IRListingMap &listings);                           // Find functions without INPUT, OUTPUT and impure calls
+    bool isMemoizable(IRFunction &func);                            // Pure, still calls itself and takes register arguments only
+    AssemblyListing wrap(IRFunction &func, int worker, AssemblyProgram &prog); // Table lookup that calls worker on miss
+    void dump(FILE *out);                                           // Print wrapped functions
+};
+
+#endif //X86COMPILERBACKEND_MEMOIZER_HPP
@@ -0,0 +1,267 @@
+#include "Peephole.hpp"
+#include "utilities.hpp"
+
+static void replace(Operation **slot, Operation *op) {
+    delete *slot;
+    *slot = op;
+}
+
+static void erase(Operation **slot) {
+    delete *slot;
+    *slot = nullptr;
+}
+
+// mov reg, reg
+static bool selfMove(Operation **window[]) {
+    if ((*window[0])->getType() != MOV_REG_REG_OP)
+        return false;
+
+    auto *mov = reinterpret_cast<mov_reg_reg *>(*window[0]);
+    if (mov->getDestination() != mov->getSource())
+        return false;
+
+    erase(window[0]);
+    return true;
+}
+
+// push a
+// pop b
+static bool pushPop(Operation **window[]) {
+    if ((*window[0])->getType() != PUSH_OP || (*window[1])->getType() != POP_OP)
+        return false;
+
+    REGISTER from = reinterpret_cast<push_reg *>(*window[0])->getRegister();
+    REGISTER to = reinterpret_cast<pop_reg *>(*window[1])->getRegister();
+
+    if (from == to) {
+        erase(window[0]);
+    } else {
+        replace(window[0], new mov_reg_reg(to, from));
+    }
+    erase(window[1]);
+    return true;
+}
+
+// push a
+// mov a, imm / mov a, [ptr+off]
+// pop b
+static bool pushMovPop(Operation **window[]) {
+    if ((*window[0])->getType() != PUSH_OP || (*window[2])->getType() != POP_OP)
+        return false;
+
+    REGISTER saved = reinterpret_cast<push_reg *>(*window[0])->getRegister();
+    REGISTER restored = reinterpret_cast<pop_reg *>(*window[2])->getRegister();
+
+    switch ((*window[1])->getType()) {
+        case MOV_REG_IMM_OP:
+            if (reinterpret_cast<mov_reg_imm *>(*window[1])->getRegister() != saved)
+                return false;
+            break;
+
+        case LOAD_OP: {
+            auto *load = reinterpret_cast<Load *>(*window[1]);
+            if (load->getDestination() != saved || load->getPointer() == ESP || load->getPointer() == restored)
+                return false;
+            break;
+        }
+
+        default:
+            return false;
+    }
+
+    if (saved == restored) { // Value is overwritten and restored right away
+        erase(window[0]);
+        erase(window[1]);
+    } else {
+        replace(window[0], new mov_reg_reg(restored, saved));
+    }
+    erase(window[2]);
+    return true;
+}
+
+// mov [ptr+off], a
+// mov b, [ptr+off]
+static bool storeLoad(Operation **window[]) {
+    if ((*window[0])->getType() != STORE_OP || (*window[1])->getType() != LOAD_OP)
+        return false;
+
+    auto *store = reinterpret_cast<Store *>(*window[0]);
+    auto *load = reinterpret_cast<Load *>(*window[1]);
+
+    if (store->getPointer() != load->getPointer() || store->getOffset() != load->getOffset() ||
+        store->getSource() > EDI || load->getDestination() > EDI)
+        return false;
+
+    if (store->getSource() == load->getDestination()) {
+        erase(window[1]);
+    } else {
+        replace(window[1], new mov_reg_reg(load->getDestination(), store->getSource()));
+    }
+    return true;
+}
+
+// mov a, b / mov a, [ptr+off]
+// mov b, a / mov [ptr+off], a
+static bool copyBack(Operation **window[]) {
+    if ((*window[0])->getType() == MOV_REG_REG_OP && (*window[1])->getType() == MOV_REG_REG_OP) {
+        auto *first = reinterpret_cast<mov_reg_reg *>(*window[0]);
+        auto *second = reinterpret_cast<mov_reg_reg *>(*window[1]);
+        if (first->getDestination() != second->getSource() || first->getSource() != second->getDestination())
+            return false;
+    } else if ((*window[0])->getType() == LOAD_OP && (*window[1])->getType() == STORE_OP) {
+        auto *load = reinterpret_cast<Load *>(*window[0]);
+        auto *store = reinterpret_cast<Store *>(*window[1]);
+        if (load->getPointer() != store->getPointer() || load->getOffset() != store->getOffset() ||
+            load->getDestination() != store->getSource() || load->getDestination() > EDI ||
+            load->getDestination() == load->getPointer())
+            return false;
+    } else {
+        return false;
+    }
+
+    erase(window[1]);
+    return true;
+}
+
+// Register written by plain mov, false for other operations
+static bool getMoveTarget(Operation *op, REGISTER &target) {
+    switch (op->getType()) {
+        case MOV_REG_REG_OP:
+            target = reinterpret_cast<mov_reg_reg *>(op)->getDestination();
+            return true;
+
+        case MOV_REG_IMM_OP:
+            target = reinterpret_cast<mov_reg_imm *>(op)->getRegister();
+            return true;
+
+        case LOAD_OP:
+            target = reinterpret_cast<Load *>(op)->getDestination();
+            return target <= EDI;
+
+        default:
+            return false;
+    }
+}
+
+// mov a, x
+// mov a, y where y does not read a
+static bool deadMove(Operation **window[]) {
+    REGISTER first;
+    REGISTER second;
+    if (!getMoveTarget(*window[0], first) || !getMoveTarget(*window[1], second) || first != second)
+        return false;
+
+    if ((*window[1])->getType() == MOV_REG_REG_OP && reinterpret_cast<mov_reg_reg *>(*window[1])->getSource() == first)
+        return false;
+
+    if ((*window[1])->getType() == LOAD_OP && reinterpret_cast<Load *>(*window[1])->getPointer() == first)
+        return false;
+
+    erase(window[0]);
+    return true;
+}
+
+// jmp .label
+// .label:
+static bool jumpToNext(Operation **window[]) {
+    if ((*window[0])->getType() != JUMP_OP || (*window[1])->getType() != LABEL_OP)
+        return false;
+
+    if (reinterpret_cast<Jump *>(*window[0])->getLabelId() != reinterpret_cast<label *>(*window[1])->getNum())
+        return false;
+
+    erase(window[0]);
+    return true;
+}
+
+static const PeepholeRule DEFAULT_RULES[] = {
+        {"self-move",    1, selfMove},
+        {"push-pop",     2, pushPop},
+        {"push-mov-pop", 3, pushMovPop},
+        {"store-load",   2, storeLoad},
+        {"copy-back",    2, copyBack},
+        {"dead-move",    2, deadMove},
+        {"jump-to-next", 2, jumpToNext}
+};
+
+PeepholeOptimizer::PeepholeOptimizer() : PeepholeOptimizer(DEFAULT_RULES,
+                                                           sizeof(DEFAULT_RULES) / sizeof(DEFAULT_RULES[0])) {}
+
+PeepholeOptimizer::PeepholeOptimizer(const PeepholeRule *rules, int ruleCount) : rules(rules), ruleCount(ruleCount) {
+    if (!rules)
+        throw_exception("Invalid pointer to peephole rules");
+
+    for (int i = 0; i < ruleCount; i++) {
+        if (rules[i].window < 1 || rules[i].window > PEEPHOLE_MAX_WINDOW)
+            throw_exception("Peephole rule window is out of range");
+    }
+
+    hits = new int[ruleCount]();
+}
+
+PeepholeOptimizer::~PeepholeOptimizer() {
+    delete[] hits;
+}
+
+void PeepholeOptimizer::run(vector<Operation *> &ops) {
+    bool changed = true;
+
+    while (changed) {
+        changed = false;
+
+        for (int i = 0; i < ops.getSize(); i++) {
+            if (!ops[i] || ops[i]->getType() == COMMENT_OP)
+                continue;
+
+            Operation **window[PEEPHOLE_MAX_WINDOW] = {}; // Comments and removed operations are skipped
+            int found = 0;
+            for (int j = i; j < ops.getSize() && found < PEEPHOLE_MAX_WINDOW; j++) {
+                if (ops[j] && ops[j]->getType() != COMMENT_OP)
+                    window[found++] = &ops[j];
+            }
+
+            for (int rule = 0; rule < ruleCount; rule++) {
+                if (rules[rule].window <= found && rules[rule].apply(window)) {
+                    hits[rule]++;
+                    changed = true;
+                    i--; // Try the same position once again
+                    break;
+                }
+            }
+        }
+    }
+
+    vector<Operation *> compacted(ops.getSize() + 1);
+    for (int i = 0; i < ops.getSize(); i++) {
+        if (ops[i])
+            compacted.push_back(ops[i]);
+    }
+    ops = std::move(compacted);
+}
+
+int PeepholeOptimizer::getRuleCount() {
+    return ruleCount;
+}
+
+const char *PeepholeOptimizer::getRuleName(int rule) {
+    if (rule < 0 || rule >= ruleCount)
+        throw_exception("Peephole rule index is out of range");
+
+    return rules[rule].name;
+}
+
+int PeepholeOptimizer::getRuleHits(int rule) {
+    if (rule < 0 || rule >= ruleCount)
+        throw_exception("Peephole rule index is out of range");
+
+    return hits[rule];
+}
+
+void PeepholeOptimizer::dump(FILE *out) {
+    if (!out)
+        throw_exception("Invalid pointer to output file");
+
+    for (int i = 0; i < ruleCount; i++) {
+        fprintf(out, "Peephole: %-16s %d\n", rules[i].name, hits[i]);
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef X86COMPILERBACKEND_PEEPHOLE_HPP
+#define X86COMPILERBACKEND_PEEPHOLE_HPP
+
+#include <cstdio>
+#include "Vector.hpp"
+#include "AssemblyTools.hpp"
+
+const int PEEPHOLE_MAX_WINDOW = 3;                                  // Longest sequence of operations a rule may inspect
+
+struct PeepholeRule {
+    const char *name;                                               // Rule name for statistics
+    int window;                                                     // Number of operations the rule looks at
+    bool (*apply)(Operation **window[]);                            // Rewrite operations in place, true if applied
+};
+
+class PeepholeOptimizer {
+private:
+    const PeepholeRule *rules;                                      // Rule table
+    int ruleCount;                                                  // Number of rules in the table
+    int *hits;                                                      // Number of times each rule was applied
+
+public:
+    PeepholeOptimizer();                                            // Optimizer with the default rule set
+    PeepholeOptimizer(const PeepholeRule *rules, int ruleCount);    // Optimizer with custom rule set
+    PeepholeOptimizer(const PeepholeOptimizer &other) = delete;     // Prohibit copy constructor
+    PeepholeOptimizer &operator=(const PeepholeOptimizer &other) = delete; // Prohibit copy assignment
+    ~PeepholeOptimizer();                                           // Destructor
+
+    void run(vector<Operation *> &ops);                             // Apply rules until none of them matches
+
+    int getRuleCount();                                             // Number of rules
+    const char *getRuleName(int rule);                              // Name of rule
+    int getRuleHits(int rule);                                      // Number of times rule was applied
+    void dump(FILE *out);                                           // Print hit counters
+};
+
+#endif //X86COMPILERBACKEND_PEEPHOLE_HPP
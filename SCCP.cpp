@@ -0,0 +1,283 @@
+#include "IROptimizer.hpp"
+
+enum SCCP_STATE {
+    SCCP_UNDEFINED,                                                 // No value reached the register yet
+    SCCP_CONSTANT,                                                  // Register always holds one known value
+    SCCP_VARYING                                                    // Register value is known only at run time
+};
+
+struct SCCPValue {
+    SCCP_STATE state;                                               // Position in lattice
+    int value;                                                      // Value of constant register
+};
+
+static SCCPValue meet(SCCPValue x, SCCPValue y) {
+    if (x.state == SCCP_UNDEFINED)
+        return y;
+
+    if (y.state == SCCP_UNDEFINED)
+        return x;
+
+    if (x.state == SCCP_CONSTANT && y.state == SCCP_CONSTANT && x.value == y.value)
+        return x;
+
+    return {SCCP_VARYING, 0};
+}
+
+class ConstantPropagator {
+private:
+    IRFunction &func;                                               // Function in SSA form
+    SCCPValue *values;                                              // Lattice value of every register
+    bool *executable;                                               // Whether block can be reached
+    int *edgeStart;                                                 // First incoming edge of every block in edgeExecutable
+    bool *edgeExecutable;                                           // Whether incoming edge can be taken
+    bool changed;                                                   // Whether last sweep changed anything
+
+    SCCPValue valueOf(IROperand op);                                // Lattice value of operand
+    void update(int reg, SCCPValue value);                          // Lower register value in lattice
+    void markEdge(int from, int to);                                // Edge can be taken
+    SCCPValue evaluate(int block, IRInstruction &instr);            // Lattice value of instruction result
+    void visit(int block);                                          // Evaluate instructions and terminator of block
+
+public:
+    explicit ConstantPropagator(IRFunction &func);                  // Start with only entry executable
+    ConstantPropagator(const ConstantPropagator &other) = delete;   // Prohibit copy constructor
+    ConstantPropagator &operator=(const ConstantPropagator &other) = delete; // Prohibit copy assignment
+    ~ConstantPropagator();                                          // Destructor
+
+    void solve();                                                   // Sweep blocks until values settle
+    int rewrite();                                                  // Substitute constants, drop dead branches
+};
+
+ConstantPropagator::ConstantPropagator(IRFunction &func) : func(func), changed(false) {
+    int blockCount = func.blocks.getSize();
+    values = new SCCPValue[func.registerCount];
+    for (int i = 0; i < func.registerCount; i++) {
+        values[i] = {SCCP_UNDEFINED, 0};
+    }
+
+    executable = new bool[blockCount]();
+    edgeStart = new int[blockCount + 1]();
+    for (int i = 0; i < blockCount; i++) {
+        edgeStart[i + 1] = edgeStart[i] + func.blocks[i]->predecessors.getSize();
+    }
+    edgeExecutable = new bool[edgeStart[blockCount] + 1]();
+
+    executable[0] = true;
+}
+
+ConstantPropagator::~ConstantPropagator() {
+    delete[] values;
+    delete[] executable;
+    delete[] edgeStart;
+    delete[] edgeExecutable;
+}
+
+SCCPValue ConstantPropagator::valueOf(IROperand op) {
+    if (op.isConstant)
+        return {SCCP_CONSTANT, op.value};
+
+    return values[op.value];
+}
+
+void ConstantPropagator::update(int reg, SCCPValue value) {
+    SCCPValue merged = meet(values[reg], value); // Values only move down the lattice
+    if (merged.state != values[reg].state || merged.value != values[reg].value) {
+        values[reg] = merged;
+        changed = true;
+    }
+}
+
+void ConstantPropagator::markEdge(int from, int to) {
+    int index = func.getPredecessorIndex(to, from);
+    if (!edgeExecutable[edgeStart[to] + index]) {
+        edgeExecutable[edgeStart[to] + index] = true;
+        executable[to] = true;
+        changed = true;
+    }
+}
+
+SCCPValue ConstantPropagator::evaluate(int block, IRInstruction &instr) {
+    switch (instr.opcode) {
+        case IR_PHI: {
+            SCCPValue result = {SCCP_UNDEFINED, 0};
+            for (int i = 0; i < instr.poolCount; i++) {
+                if (edgeExecutable[edgeStart[block] + i]) // Values flowing along dead edges do not matter
+                    result = meet(result, valueOf(func.pool[instr.poolStart + i]));
+            }
+            return result;
+        }
+
+        case IR_SELECT: {
+            SCCPValue left = valueOf(func.pool[instr.poolStart]);
+            SCCPValue right = valueOf(func.pool[instr.poolStart + 1]);
+            SCCPValue onTrue = valueOf(func.pool[instr.poolStart + 2]);
+            SCCPValue onFalse = valueOf(func.pool[instr.poolStart + 3]);
+
+            if (left.state == SCCP_UNDEFINED || right.state == SCCP_UNDEFINED)
+                return {SCCP_UNDEFINED, 0};
+
+            if (left.state == SCCP_CONSTANT && right.state == SCCP_CONSTANT)
+                return irEvaluate(static_cast<IR_CONDITION>(instr.a.value), left.value, right.value) ? onTrue : onFalse;
+
+            return meet(onTrue, onFalse);
+        }
+
+        case IR_COPY:
+        case IR_SQRT:
+        case IR_ADD:
+        case IR_SUB:
+        case IR_MUL:
+        case IR_DIV: {
+            SCCPValue a = valueOf(instr.a);
+            SCCPValue b = func.getUseCount(instr) > 1 ? valueOf(instr.b) : SCCPValue{SCCP_CONSTANT, 0};
+
+            if (instr.opcode == IR_MUL && ((a.state == SCCP_CONSTANT && a.value == 0) ||
+                                           (b.state == SCCP_CONSTANT && b.value == 0)))
+                return {SCCP_CONSTANT, 0};
+
+            if (a.state == SCCP_UNDEFINED || b.state == SCCP_UNDEFINED)
+                return {SCCP_UNDEFINED, 0};
+
+            int result = 0;
+            if (a.state == SCCP_CONSTANT && b.state == SCCP_CONSTANT && irFold(instr.opcode, a.value, b.value, result))
+                return {SCCP_CONSTANT, result};
+
+            return {SCCP_VARYING, 0};
+        }
+
+        default: // Arguments, input and calls
+            return {SCCP_VARYING, 0};
+    }
+}
+
+void ConstantPropagator::visit(int block) {
+    IRBlock *current = func.blocks[block];
+
+    for (int i = 0; i < current->instructions.getSize(); i++) {
+        IRInstruction &instr = current->instructions[i];
+        if (instr.opcode != IR_NOP && instr.dst >= 0)
+            update(instr.dst, evaluate(block, instr));
+    }
+
+    switch (current->terminator) {
+        case IR_JUMP:
+            markEdge(block, current->targets[0]);
+            break;
+
+        case IR_BRANCH: {
+            SCCPValue a = valueOf(current->a);
+            SCCPValue b = valueOf(current->b);
+
+            if (a.state == SCCP_UNDEFINED || b.state == SCCP_UNDEFINED)
+                break;
+
+            if (a.state == SCCP_CONSTANT && b.state == SCCP_CONSTANT) {
+                markEdge(block, current->targets[irEvaluate(current->condition, a.value, b.value) ? 0 : 1]);
+            } else {
+                markEdge(block, current->targets[0]);
+                markEdge(block, current->targets[1]);
+            }
+            break;
+        }
+
+        case IR_RETURN:
+            break;
+    }
+}
+
+void ConstantPropagator::solve() {
+    vector<int> order;
+    func.reversePostorder(order);
+
+    do {
+        changed = false;
+        for (int i = 0; i < order.getSize(); i++) {
+            if (executable[order[i]])
+                visit(order[i]);
+        }
+    } while (changed);
+}
+
+int ConstantPropagator::rewrite() {
+    int changes = 0;
+    int *taken = new int[func.blocks.getSize()]; // Only target of folded branch, -1 for other blocks
+    for (int i = 0; i < func.blocks.getSize(); i++) {
+        taken[i] = -1;
+    }
+
+    for (int i = 0; i < func.blocks.getSize(); i++) {
+        IRBlock *block = func.blocks[i];
+        if (!executable[i])
+            continue;
+
+        for (int j = 0; j < block->instructions.getSize(); j++) {
+            IRInstruction &instr = block->instructions[j];
+            if (instr.opcode == IR_NOP)
+                continue;
+
+            if (instr.dst >= 0 && values[instr.dst].state == SCCP_CONSTANT) {
+                instr.opcode = IR_NOP; // Every use gets the constant instead
+                changes++;
+                continue;
+            }
+
+            for (int k = 0; k < func.getUseCount(instr); k++) {
+                IROperand &op = func.getUse(instr, k);
+                if (!op.isConstant && values[op.value].state == SCCP_CONSTANT)
+                    op = irConstant(values[op.value].value);
+            }
+        }
+
+        for (int k = 0; k < func.getUseCount(block); k++) {
+            IROperand &op = func.getUse(block, k);
+            if (!op.isConstant && values[op.value].state == SCCP_CONSTANT)
+                op = irConstant(values[op.value].value);
+        }
+
+        if (block->terminator == IR_BRANCH) {
+            for (int j = 0; j < 2; j++) { // Branch with one live edge becomes a jump
+                int other = block->targets[j];
+                if (!edgeExecutable[edgeStart[other] + func.getPredecessorIndex(other, i)])
+                    taken[i] = block->targets[1 - j];
+            }
+        }
+    }
+
+    for (int i = 0; i < func.blocks.getSize(); i++) { // Edges are removed once all of them were looked up
+        if (taken[i] < 0)
+            continue;
+
+        IRBlock *block = func.blocks[i];
+        int other = block->targets[0] == taken[i] ? block->targets[1] : block->targets[0];
+        func.removePredecessor(other, func.getPredecessorIndex(other, i));
+        func.jump(i, taken[i]);
+        changes++;
+    }
+    delete[] taken;
+
+    func.removeUnreachableBlocks();
+
+    for (int i = 0; i < func.blocks.getSize(); i++) { // PHI with a single incoming edge is a copy
+        IRBlock *block = func.blocks[i];
+        if (block->predecessors.getSize() != 1)
+            continue;
+
+        for (int j = 0; j < block->instructions.getSize(); j++) {
+            IRInstruction &instr = block->instructions[j];
+            if (instr.opcode == IR_PHI) {
+                instr.opcode = IR_COPY;
+                instr.a = func.pool[instr.poolStart];
+                instr.poolCount = 0;
+            }
+        }
+    }
+
+    return changes;
+}
+
+int irPropagateConstants(IRFunction &func, const CompilerOptions &options) {
+    ConstantPropagator propagator(func);
+    propagator.solve();
+    return propagator.rewrite();
+}
@@ -0,0 +1,775 @@
+#include "SSA.hpp"
+#include "utilities.hpp"
+
+DominatorTree::DominatorTree(IRFunction &func) : blockCount(func.blocks.getSize()), idom(nullptr), childStart(nullptr),
+                                                 children(nullptr), enter(nullptr), leave(nullptr), order() {
+    func.reversePostorder(order);
+
+    idom = new int[blockCount];
+    int *position = new int[blockCount];
+    for (int i = 0; i < blockCount; i++) {
+        idom[i] = -1;
+        position[i] = -1;
+    }
+    for (int i = 0; i < order.getSize(); i++) {
+        position[order[i]] = i;
+    }
+
+    // Iterative algorithm of Cooper, Harvey and Kennedy over reverse postorder
+    idom[0] = 0;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int i = 1; i < order.getSize(); i++) {
+            int block = order[i];
+            int newIdom = -1;
+            vector<int> &predecessors = func.blocks[block]->predecessors;
+
+            for (int j = 0; j < predecessors.getSize(); j++) {
+                int other = predecessors[j];
+                if (idom[other] < 0)
+                    continue; // Not processed yet or unreachable
+
+                if (newIdom < 0) {
+                    newIdom = other;
+                    continue;
+                }
+
+                while (other != newIdom) { // Walk up to the nearest common dominator
+                    while (position[other] > position[newIdom])
+                        other = idom[other];
+                    while (position[newIdom] > position[other])
+                        newIdom = idom[newIdom];
+                }
+            }
+
+            if (newIdom != idom[block]) {
+                idom[block] = newIdom;
+                changed = true;
+            }
+        }
+    }
+    idom[0] = -1;
+
+    childStart = new int[blockCount + 1]();
+    children = new int[blockCount];
+    for (int i = 0; i < blockCount; i++) {
+        if (idom[i] >= 0)
+            childStart[idom[i] + 1]++;
+    }
+    for (int i = 0; i < blockCount; i++) {
+        childStart[i + 1] += childStart[i];
+    }
+    int *filled = new int[blockCount]();
+    for (int i = 0; i < order.getSize(); i++) { // Children are listed in reverse postorder
+        int block = order[i];
+        if (idom[block] >= 0)
+            children[childStart[idom[block]] + filled[idom[block]]++] = block;
+    }
+
+    // Number blocks in preorder of the tree, so that dominance is an interval check
+    enter = new int[blockCount];
+    leave = new int[blockCount];
+    for (int i = 0; i < blockCount; i++) {
+        enter[i] = -1;
+        leave[i] = -1;
+    }
+
+    int *stack = new int[2 * blockCount];
+    int depth = 0, counter = 0;
+    stack[depth++] = 0;
+    while (depth > 0) {
+        int item = stack[--depth];
+        if (item < 0) {
+            leave[~item] = counter - 1;
+            continue;
+        }
+
+        enter[item] = counter++;
+        stack[depth++] = ~item;
+        for (int i = childStart[item + 1] - 1; i >= childStart[item]; i--) {
+            stack[depth++] = children[i];
+        }
+    }
+
+    delete[] position;
+    delete[] filled;
+    delete[] stack;
+}
+
+DominatorTree::~DominatorTree() {
+    delete[] idom;
+    delete[] childStart;
+    delete[] children;
+    delete[] enter;
+    delete[] leave;
+}
+
+int DominatorTree::getIdom(int block) {
+    return idom[block];
+}
+
+bool DominatorTree::dominates(int dominator, int block) {
+    if (enter[dominator] < 0 || enter[block] < 0)
+        return false;
+
+    return enter[dominator] <= enter[block] && enter[block] <= leave[dominator];
+}
+
+int DominatorTree::getChildCount(int block) {
+    return childStart[block + 1] - childStart[block];
+}
+
+int DominatorTree::getChild(int block, int child) {
+    return children[childStart[block] + child];
+}
+
+bool irFindLoop(IRFunction &func, DominatorTree &dom, int header, bool *inLoop, int *worklist) {
+    for (int i = 0; i < func.blocks.getSize(); i++) {
+        inLoop[i] = false;
+    }
+
+    // Natural loop: header and blocks that reach a back edge without passing the header
+    inLoop[header] = true;
+    bool isLoop = false;
+    int pending = 0;
+    IRBlock *top = func.blocks[header];
+    for (int i = 0; i < top->predecessors.getSize(); i++) {
+        int latch = top->predecessors[i];
+        if (!dom.dominates(header, latch))
+            continue;
+
+        isLoop = true;
+        if (!inLoop[latch]) {
+            inLoop[latch] = true;
+            worklist[pending++] = latch;
+        }
+    }
+
+    while (pending > 0) {
+        IRBlock *block = func.blocks[worklist[--pending]];
+        for (int i = 0; i < block->predecessors.getSize(); i++) {
+            int predecessor = block->predecessors[i];
+            if (!inLoop[predecessor]) {
+                inLoop[predecessor] = true;
+                worklist[pending++] = predecessor;
+            }
+        }
+    }
+
+    return isLoop;
+}
+
+int irFindPreheader(IRFunction &func, int header, const bool *inLoop) {
+    IRBlock *block = func.blocks[header];
+    int preheader = -1;
+
+    for (int i = 0; i < block->predecessors.getSize(); i++) {
+        int predecessor = block->predecessors[i];
+        if (inLoop[predecessor])
+            continue;
+
+        if (preheader >= 0)
+            return -1;
+        preheader = predecessor;
+    }
+
+    if (preheader < 0 || func.blocks[preheader]->getSuccessorCount() != 1)
+        return -1;
+
+    return preheader;
+}
+
+static IROperand renameUse(IROperand op, const int *current) {
+    if (op.isConstant)
+        return op;
+
+    return current[op.value] >= 0 ? irRegister(current[op.value]) : irConstant(0); // Undefined registers read zero
+}
+
+void irConstructSSA(IRFunction &func) {
+    for (int i = 0; i < func.blocks.getSize(); i++) {
+        IRBlock *block = func.blocks[i];
+        if (block->terminator == IR_BRANCH && block->targets[0] == block->targets[1])
+            func.jump(i, block->targets[0]);
+    }
+
+    func.computePredecessors();
+    func.removeUnreachableBlocks();
+
+    DominatorTree dom(func);
+    int blockCount = func.blocks.getSize();
+    int regCount = func.registerCount;
+
+    // Dominance frontiers, every list is linked through frontierNext
+    vector<int> frontier, frontierNext;
+    int *frontierHead = new int[blockCount];
+    int *lastAdded = new int[blockCount];
+    for (int i = 0; i < blockCount; i++) {
+        frontierHead[i] = -1;
+        lastAdded[i] = -1;
+    }
+
+    for (int i = 0; i < blockCount; i++) {
+        vector<int> &predecessors = func.blocks[i]->predecessors;
+        if (predecessors.getSize() < 2)
+            continue;
+
+        for (int j = 0; j < predecessors.getSize(); j++) {
+            for (int runner = predecessors[j]; runner >= 0 && runner != dom.getIdom(i); runner = dom.getIdom(runner)) {
+                if (lastAdded[runner] == i)
+                    continue;
+
+                lastAdded[runner] = i;
+                frontier.push_back(i);
+                frontierNext.push_back(frontierHead[runner]);
+                frontierHead[runner] = frontier.getSize() - 1;
+            }
+        }
+    }
+
+    // Registers read in some block before being written there need PHI instructions
+    bool *global = new bool[regCount]();
+    int *stamp = new int[regCount];
+    int *defStart = new int[regCount + 1]();
+    for (int i = 0; i < regCount; i++) {
+        stamp[i] = -1;
+    }
+
+    for (int i = 0; i < blockCount; i++) {
+        IRBlock *block = func.blocks[i];
+        for (int j = 0; j < block->instructions.getSize(); j++) {
+            IRInstruction &instr = block->instructions[j];
+            if (instr.opcode == IR_NOP)
+                continue;
+
+            for (int k = 0; k < func.getUseCount(instr); k++) {
+                IROperand op = func.getUse(instr, k);
+                if (!op.isConstant && stamp[op.value] != i)
+                    global[op.value] = true;
+            }
+
+            if (instr.dst >= 0 && stamp[instr.dst] != i) {
+                stamp[instr.dst] = i;
+                defStart[instr.dst + 1]++;
+            }
+        }
+
+        for (int k = 0; k < func.getUseCount(block); k++) {
+            IROperand op = func.getUse(block, k);
+            if (!op.isConstant && stamp[op.value] != i)
+                global[op.value] = true;
+        }
+    }
+
+    for (int i = 0; i < regCount; i++) {
+        defStart[i + 1] += defStart[i];
+        stamp[i] = -1;
+    }
+
+    int *defBlocks = new int[defStart[regCount] + 1];
+    int *filled = new int[regCount]();
+    for (int i = 0; i < blockCount; i++) {
+        IRBlock *block = func.blocks[i];
+        for (int j = 0; j < block->instructions.getSize(); j++) {
+            IRInstruction &instr = block->instructions[j];
+            if (instr.opcode != IR_NOP && instr.dst >= 0 && stamp[instr.dst] != i) {
+                stamp[instr.dst] = i;
+                defBlocks[defStart[instr.dst] + filled[instr.dst]++] = i;
+            }
+        }
+    }
+
+    // Place PHI instructions on iterated dominance frontiers of definitions
+    vector<int> phiRegister, phiNext;
+    int *phiHead = new int[blockCount];
+    int *phiStamp = new int[blockCount];
+    int *workStamp = new int[blockCount];
+    int *work = new int[blockCount];
+    for (int i = 0; i < blockCount; i++) {
+        phiHead[i] = -1;
+        phiStamp[i] = -1;
+        workStamp[i] = -1;
+    }
+
+    for (int reg = 0; reg < regCount; reg++) {
+        if (!global[reg])
+            continue;
+
+        int top = 0;
+        for (int i = defStart[reg]; i < defStart[reg + 1]; i++) {
+            work[top++] = defBlocks[i];
+            workStamp[defBlocks[i]] = reg;
+        }
+
+        while (top > 0) {
+            int block = work[--top];
+            for (int e = frontierHead[block]; e >= 0; e = frontierNext[e]) {
+                int target = frontier[e];
+                if (phiStamp[target] == reg)
+                    continue;
+
+                phiStamp[target] = reg;
+                phiRegister.push_back(reg);
+                phiNext.push_back(phiHead[target]);
+                phiHead[target] = phiRegister.getSize() - 1;
+
+                if (workStamp[target] != reg) {
+                    workStamp[target] = reg;
+                    work[top++] = target;
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < blockCount; i++) {
+        if (phiHead[i] < 0)
+            continue;
+
+        IRBlock *block = func.blocks[i];
+        vector<IRInstruction> instructions;
+        for (int e = phiHead[i]; e >= 0; e = phiNext[e]) {
+            int count = block->predecessors.getSize();
+            int start = func.addPool(count);
+            // Until renaming is done, a holds the register the PHI merges
+            instructions.push_back({IR_PHI, phiRegister[e], irConstant(phiRegister[e]), irConstant(0), start, count});
+        }
+
+        for (int j = 0; j < block->instructions.getSize(); j++) {
+            instructions.push_back(block->instructions[j]);
+        }
+        block->instructions = std::move(instructions);
+    }
+
+    // Rename definitions walking the dominator tree, every definition gets a fresh register
+    int defCount = 0;
+    for (int i = 0; i < blockCount; i++) {
+        defCount += func.blocks[i]->instructions.getSize();
+    }
+
+    int *current = new int[regCount];
+    for (int i = 0; i < regCount; i++) {
+        current[i] = -1;
+    }
+    int *logRegister = new int[defCount + 1];
+    int *logName = new int[defCount + 1];
+    int *logMark = new int[blockCount];
+    int *stack = new int[2 * blockCount];
+    int logTop = 0, depth = 0;
+
+    stack[depth++] = 0;
+    while (depth > 0) {
+        int item = stack[--depth];
+        if (item < 0) { // Leaving subtree, restore names visible in the parent
+            while (logTop > logMark[~item]) {
+                logTop--;
+                current[logRegister[logTop]] = logName[logTop];
+            }
+            continue;
+        }
+
+        IRBlock *block = func.blocks[item];
+        logMark[item] = logTop;
+
+        for (int j = 0; j < block->instructions.getSize(); j++) {
+            IRInstruction &instr = block->instructions[j];
+            if (instr.opcode == IR_NOP)
+                continue;
+
+            if (instr.opcode != IR_PHI) {
+                for (int k = 0; k < func.getUseCount(instr); k++) {
+                    IROperand &op = func.getUse(instr, k);
+                    op = renameUse(op, current);
+                }
+            }
+
+            if (instr.dst >= 0) {
+                logRegister[logTop] = instr.dst;
+                logName[logTop++] = current[instr.dst];
+                current[instr.dst] = func.addRegister();
+                instr.dst = current[instr.dst];
+            }
+        }
+
+        for (int k = 0; k < func.getUseCount(block); k++) {
+            IROperand &op = func.getUse(block, k);
+            op = renameUse(op, current);
+        }
+
+        for (int j = 0; j < block->getSuccessorCount(); j++) {
+            int successor = block->targets[j];
+            int index = func.getPredecessorIndex(successor, item);
+            vector<IRInstruction> &instructions = func.blocks[successor]->instructions;
+
+            for (int k = 0; k < instructions.getSize(); k++) {
+                IRInstruction &instr = instructions[k];
+                if (instr.opcode == IR_PHI)
+                    func.pool[instr.poolStart + index] = renameUse(irRegister(instr.a.value), current);
+            }
+        }
+
+        stack[depth++] = ~item;
+        for (int j = 0; j < dom.getChildCount(item); j++) {
+            stack[depth++] = dom.getChild(item, j);
+        }
+    }
+
+    for (int i = 0; i < blockCount; i++) {
+        IRBlock *block = func.blocks[i];
+        for (int j = 0; j < block->instructions.getSize(); j++) {
+            if (block->instructions[j].opcode == IR_PHI)
+                block->instructions[j].a = irConstant(0);
+        }
+    }
+
+    delete[] frontierHead;
+    delete[] lastAdded;
+    delete[] global;
+    delete[] stamp;
+    delete[] defStart;
+    delete[] defBlocks;
+    delete[] filled;
+    delete[] phiHead;
+    delete[] phiStamp;
+    delete[] workStamp;
+    delete[] work;
+    delete[] current;
+    delete[] logRegister;
+    delete[] logName;
+    delete[] logMark;
+    delete[] stack;
+}
+
+static bool hasPhi(IRBlock *block) {
+    for (int i = 0; i < block->instructions.getSize(); i++) {
+        if (block->instructions[i].opcode == IR_PHI)
+            return true;
+    }
+
+    return false;
+}
+
+static void splitPhiEdges(IRFunction &func) {
+    int blockCount = func.blocks.getSize();
+
+    for (int i = 0; i < blockCount; i++) {
+        if (!hasPhi(func.blocks[i]))
+            continue;
+
+        for (int j = 0; j < func.blocks[i]->predecessors.getSize(); j++) {
+            int predecessor = func.blocks[i]->predecessors[j];
+            IRBlock *from = func.blocks[predecessor];
+            if (from->getSuccessorCount() < 2)
+                continue; // Copies can go to the end of predecessor
+
+            int depth = from->loopDepth < func.blocks[i]->loopDepth ? from->loopDepth : func.blocks[i]->loopDepth;
+            int middle = func.addBlock(depth);
+            func.jump(middle, i);
+            func.blocks[middle]->predecessors.push_back(predecessor);
+
+            for (int k = 0; k < from->getSuccessorCount(); k++) {
+                if (from->targets[k] == i)
+                    from->targets[k] = middle;
+            }
+            func.blocks[i]->predecessors[j] = middle;
+        }
+    }
+}
+
+class Coalescer {
+private:
+    IRFunction &func;                                               // Function in SSA form
+    IRLiveness &liveness;                                           // Liveness of its registers
+    int *defBlock;                                                  // Block that defines register, -1 if there is none
+    int *defPosition;                                               // Index of definition in block
+    int *parent;                                                    // Union-find forest of registers sharing a name
+    int *next;                                                      // Circular list of members of every class
+
+    bool usedAfter(int reg, int block, int position);               // Register is read in block after position
+    bool liveAt(int reg, int other);                                // Register is live where other is defined
+    bool interfere(int reg, int other);                             // Registers cannot share name
+
+public:
+    Coalescer(IRFunction &func, IRLiveness &liveness);              // Collect definitions
+    Coalescer(const Coalescer &other) = delete;                     // Prohibit copy constructor
+    Coalescer &operator=(const Coalescer &other) = delete;          // Prohibit copy assignment
+    ~Coalescer();                                                   // Destructor
+
+    int find(int reg);                                              // Representative of register class
+    bool join(int reg, int other);                                  // Merge classes unless they interfere
+};
+
+Coalescer::Coalescer(IRFunction &func, IRLiveness &liveness) : func(func), liveness(liveness) {
+    int regCount = func.registerCount;
+    defBlock = new int[regCount];
+    defPosition = new int[regCount];
+    parent = new int[regCount];
+    next = new int[regCount];
+
+    for (int i = 0; i < regCount; i++) {
+        defBlock[i] = -1;
+        defPosition[i] = -1;
+        parent[i] = i;
+        next[i] = i;
+    }
+
+    for (int i = 0; i < func.blocks.getSize(); i++) {
+        IRBlock *block = func.blocks[i];
+        for (int j = 0; j < block->instructions.getSize(); j++) {
+            IRInstruction &instr = block->instructions[j];
+            if (instr.opcode == IR_NOP || instr.dst < 0)
+                continue;
+
+            defBlock[instr.dst] = i;
+            defPosition[instr.dst] = instr.opcode == IR_PHI ? -1 : j; // PHI results appear at block entry
+        }
+    }
+}
+
+Coalescer::~Coalescer() {
+    delete[] defBlock;
+    delete[] defPosition;
+    delete[] parent;
+    delete[] next;
+}
+
+bool Coalescer::usedAfter(int reg, int block, int position) {
+    IRBlock *current = func.blocks[block];
+
+    for (int i = position + 1; i < current->instructions.getSize(); i++) {
+        IRInstruction &instr = current->instructions[i];
+        if (instr.opcode == IR_NOP || instr.opcode == IR_PHI)
+            continue;
+
+        for (int k = 0; k < func.getUseCount(instr); k++) {
+            if (irIsRegister(func.getUse(instr, k), reg))
+                return true;
+        }
+    }
+
+    for (int k = 0; k < func.getUseCount(current); k++) {
+        if (irIsRegister(func.getUse(current, k), reg))
+            return true;
+    }
+
+    return false;
+}
+
+bool Coalescer::liveAt(int reg, int other) {
+    int block = defBlock[other];
+    if (defBlock[reg] < 0 || block < 0)
+        return false;
+
+    bool available = defBlock[reg] == block ? defPosition[reg] <= defPosition[other]
+                                            : irTestBit(liveness.getLiveIn(block), reg);
+    if (!available)
+        return false;
+
+    return irTestBit(liveness.getLiveOut(block), reg) || usedAfter(reg, block, defPosition[other]);
+}
+
+bool Coalescer::interfere(int reg, int other) {
+    if (defBlock[reg] >= 0 && defBlock[reg] == defBlock[other] && defPosition[reg] == defPosition[other])
+        return true; // PHI instructions of one block are written simultaneously
+
+    return liveAt(reg, other) || liveAt(other, reg);
+}
+
+int Coalescer::find(int reg) {
+    while (parent[reg] != reg) {
+        parent[reg] = parent[parent[reg]];
+        reg = parent[reg];
+    }
+
+    return reg;
+}
+
+bool Coalescer::join(int reg, int other) {
+    int first = find(reg);
+    int second = find(other);
+    if (first == second)
+        return true;
+
+    for (int x = first;; x = next[x]) {
+        for (int y = second;; y = next[y]) {
+            if (interfere(x, y))
+                return false;
+
+            if (next[y] == second)
+                break;
+        }
+
+        if (next[x] == first)
+            break;
+    }
+
+    parent[second] = first;
+    int tmp = next[first]; // Splice circular member lists
+    next[first] = next[second];
+    next[second] = tmp;
+    return true;
+}
+
+static IROperand renameOperand(IROperand op, Coalescer &coalescer) {
+    return op.isConstant ? op : irRegister(coalescer.find(op.value));
+}
+
+static void emitParallelCopy(IRFunction &func, int block, int *dsts, IROperand *srcs, int count) {
+    bool *done = new bool[count]();
+    int remaining = 0;
+
+    for (int i = 0; i < count; i++) {
+        if (irIsRegister(srcs[i], dsts[i])) {
+            done[i] = true;
+        } else {
+            remaining++;
+        }
+    }
+
+    while (remaining > 0) {
+        bool progress = false;
+
+        for (int i = 0; i < count; i++) {
+            if (done[i])
+                continue;
+
+            bool blocked = false; // Destination is still read by another copy
+            for (int k = 0; k < count && !blocked; k++) {
+                blocked = !done[k] && k != i && irIsRegister(srcs[k], dsts[i]);
+            }
+
+            if (!blocked) {
+                func.emit(block, IR_COPY, dsts[i], srcs[i], irConstant(0));
+                done[i] = true;
+                remaining--;
+                progress = true;
+            }
+        }
+
+        if (progress)
+            continue;
+
+        for (int i = 0; i < count; i++) { // Only cycles are left, save one destination to break them
+            if (done[i])
+                continue;
+
+            int tmp = func.addRegister();
+            func.emit(block, IR_COPY, tmp, irRegister(dsts[i]), irConstant(0));
+            for (int k = 0; k < count; k++) {
+                if (!done[k] && irIsRegister(srcs[k], dsts[i]))
+                    srcs[k] = irRegister(tmp);
+            }
+            break;
+        }
+    }
+
+    delete[] done;
+}
+
+void irDestructSSA(IRFunction &func) {
+    splitPhiEdges(func);
+
+    vector<int> order;
+    func.reversePostorder(order);
+    IRLiveness liveness(func, order);
+    Coalescer coalescer(func, liveness);
+    int blockCount = func.blocks.getSize();
+
+    // Give PHI results and copies the name of their operands where lifetimes allow
+    for (int i = 0; i < blockCount; i++) {
+        IRBlock *block = func.blocks[i];
+        for (int j = 0; j < block->instructions.getSize(); j++) {
+            IRInstruction &instr = block->instructions[j];
+            if (instr.opcode != IR_PHI)
+                continue;
+
+            for (int k = 0; k < instr.poolCount; k++) {
+                IROperand op = func.pool[instr.poolStart + k];
+                if (!op.isConstant)
+                    coalescer.join(instr.dst, op.value);
+            }
+        }
+    }
+
+    for (int i = 0; i < blockCount; i++) {
+        IRBlock *block = func.blocks[i];
+        for (int j = 0; j < block->instructions.getSize(); j++) {
+            IRInstruction &instr = block->instructions[j];
+            if (instr.opcode == IR_COPY && !instr.a.isConstant)
+                coalescer.join(instr.dst, instr.a.value);
+        }
+    }
+
+    for (int i = 0; i < blockCount; i++) {
+        IRBlock *block = func.blocks[i];
+        for (int j = 0; j < block->instructions.getSize(); j++) {
+            IRInstruction &instr = block->instructions[j];
+            if (instr.opcode == IR_NOP)
+                continue;
+
+            if (instr.dst >= 0)
+                instr.dst = coalescer.find(instr.dst);
+
+            for (int k = 0; k < func.getUseCount(instr); k++) {
+                IROperand &op = func.getUse(instr, k);
+                op = renameOperand(op, coalescer);
+            }
+        }
+
+        for (int k = 0; k < func.getUseCount(block); k++) {
+            IROperand &op = func.getUse(block, k);
+            op = renameOperand(op, coalescer);
+        }
+    }
+
+    // Every incoming edge gets a parallel copy in its predecessor, edges were split where needed
+    for (int i = 0; i < blockCount; i++) {
+        IRBlock *block = func.blocks[i];
+        if (!hasPhi(block))
+            continue;
+
+        int phiCount = 0;
+        for (int j = 0; j < block->instructions.getSize(); j++) {
+            if (block->instructions[j].opcode == IR_PHI)
+                phiCount++;
+        }
+
+        int *dsts = new int[phiCount];
+        auto *srcs = new IROperand[phiCount];
+        for (int p = 0; p < block->predecessors.getSize(); p++) {
+            int count = 0;
+            for (int j = 0; j < block->instructions.getSize(); j++) {
+                IRInstruction &instr = block->instructions[j];
+                if (instr.opcode != IR_PHI)
+                    continue;
+
+                dsts[count] = instr.dst;
+                srcs[count++] = func.pool[instr.poolStart + p];
+            }
+
+            emitParallelCopy(func, block->predecessors[p], dsts, srcs, count);
+        }
+        delete[] dsts;
+        delete[] srcs;
+
+        vector<IRInstruction> instructions;
+        for (int j = 0; j < block->instructions.getSize(); j++) {
+            if (block->instructions[j].opcode != IR_PHI)
+                instructions.push_back(block->instructions[j]);
+        }
+        block->instructions = std::move(instructions);
+    }
+
+    for (int i = 0; i < blockCount; i++) {
+        IRBlock *block = func.blocks[i];
+        for (int j = 0; j < block->instructions.getSize(); j++) {
+            IRInstruction &instr = block->instructions[j];
+            if (instr.opcode == IR_COPY && irIsRegister(instr.a, instr.dst))
+                instr.opcode = IR_NOP;
+        }
+    }
+
+    func.threadJumps();
+    func.computePredecessors();
+    func.removeUnreachableBlocks();
+}
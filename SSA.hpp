@@ -0,0 +1,36 @@
+#ifndef X86COMPILERBACKEND_SSA_HPP
+#define X86COMPILERBACKEND_SSA_HPP
+
+#include "IR.hpp"
+
+class DominatorTree {
+private:
+    int blockCount;                                                 // Number of blocks in function
+    int *idom;                                                      // Immediate dominator, -1 for entry and unreachable blocks
+    int *childStart;                                                // First child of every block in children
+    int *children;                                                  // Children of all blocks grouped by parent
+    int *enter;                                                     // Preorder number of block in the tree
+    int *leave;                                                     // Last preorder number in subtree of block
+
+public:
+    vector<int> order;                                              // Reachable blocks in reverse postorder
+
+    explicit DominatorTree(IRFunction &func);                       // Build tree for current CFG
+    DominatorTree(const DominatorTree &other) = delete;             // Prohibit copy constructor
+    DominatorTree &operator=(const DominatorTree &other) = delete;  // Prohibit copy assignment
+    ~DominatorTree();                                               // Destructor
+
+    int getIdom(int block);                                         // Immediate dominator of block
+    bool dominates(int dominator, int block);                       // Whether every path to block passes dominator
+    int getChildCount(int block);                                   // Number of blocks block immediately dominates
+    int getChild(int block, int child);                             // Block immediately dominated by block
+};
+
+bool irFindLoop(IRFunction &func, DominatorTree &dom, int header, bool *inLoop,
+                int *worklist);                                     // Mark natural loop of header, false if it is no loop
+int irFindPreheader(IRFunction &func, int header, const bool *inLoop); // Only block entering loop, -1 if there is none
+
+void irConstructSSA(IRFunction &func);                              // Rename registers so that each is defined once
+void irDestructSSA(IRFunction &func);                               // Replace PHI instructions with copies
+
+#endif //X86COMPILERBACKEND_SSA_HPP
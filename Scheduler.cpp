@@ -0,0 +1,248 @@
+#include "IROptimizer.hpp"
+
+enum SCHEDULER_PORT {
+    PORT_ALU,                                                       // Additions, copies, compares
+    PORT_MUL,                                                       // Pipelined multiplier
+    PORT_DIV,                                                       // Divider, also computes square roots
+    PORT_NONE                                                       // Instruction is a scheduling barrier
+};
+
+const int SCHEDULER_PORT_COUNT = 3;                                 // Ports that execute instructions
+const int SCHEDULER_MAX_UNITS = 2;                                  // Most units behind one port
+const int SCHEDULER_PORT_UNITS[SCHEDULER_PORT_COUNT] = {2, 1, 1};   // Units behind every port
+const int SCHEDULER_ISSUE_WIDTH = 2;                                // Instructions started in one cycle
+const int SCHEDULER_MAX_REGION = 64;                                // Longer runs are scheduled in pieces
+
+struct IRLatency {
+    IR_OPCODE opcode;                                               // Instruction
+    int latency;                                                    // Cycles until result can be read
+    SCHEDULER_PORT port;                                            // Port that executes it
+    int occupancy;                                                  // Cycles the unit stays busy
+};
+
+// Calls, input and output clobber registers, so nothing is moved across them
+static const IRLatency LATENCIES[] = {
+        {IR_NOP,    0,  PORT_ALU,  0},
+        {IR_COPY,   1,  PORT_ALU,  1},
+        {IR_ADD,    1,  PORT_ALU,  1},
+        {IR_SUB,    1,  PORT_ALU,  1},
+        {IR_MUL,    3,  PORT_MUL,  1},
+        {IR_DIV,    26, PORT_DIV,  6},
+        {IR_SQRT,   20, PORT_DIV,  6},
+        {IR_ARG,    1,  PORT_NONE, 1},
+        {IR_INPUT,  1,  PORT_NONE, 1},
+        {IR_OUTPUT, 1,  PORT_NONE, 1},
+        {IR_CALL,   1,  PORT_NONE, 1},
+        {IR_PHI,    1,  PORT_NONE, 1},
+        {IR_SELECT, 2,  PORT_ALU,  1}
+};
+
+static const IRLatency &getLatency(IR_OPCODE opcode) {
+    for (int i = 0; i < static_cast<int>(sizeof(LATENCIES) / sizeof(LATENCIES[0])); i++) {
+        if (LATENCIES[i].opcode == opcode)
+            return LATENCIES[i];
+    }
+
+    return LATENCIES[0];
+}
+
+static bool isBarrier(IRInstruction &instr, const CompilerOptions &options) {
+    return getLatency(instr.opcode).port == PORT_NONE || (instr.opcode == IR_SQRT && !options.sse2); // Newton routine is a call
+}
+
+static bool reads(IRFunction &func, IRInstruction &instr, int reg) {
+    for (int k = 0; reg >= 0 && k < func.getUseCount(instr); k++) {
+        if (irIsRegister(func.getUse(instr, k), reg))
+            return true;
+    }
+
+    return false;
+}
+
+class ListScheduler {
+private:
+    IRFunction &func;                                               // Function outside of SSA form
+    IRInstruction *region;                                          // Instructions being scheduled
+    int size;                                                       // Number of them
+    bool *dependent;                                                // Instruction i has to follow instruction j, i * size + j
+    bool *flows;                                                    // Dependency passes a value, so latency counts
+    int *height;                                                    // Longest latency path to the end of region
+    int *start;                                                     // Cycle instruction was issued in, -1 for not yet
+    int *order;                                                     // Issue order
+
+    void analyze();                                                 // Fill dependencies and heights
+    int getReadyCycle(int instr);                                   // Cycle operands are available, -1 if some are not issued
+
+public:
+    explicit ListScheduler(IRFunction &func);                       // Scheduler for regions of function
+    ListScheduler(const ListScheduler &other) = delete;             // Prohibit copy constructor
+    ListScheduler &operator=(const ListScheduler &other) = delete;  // Prohibit copy assignment
+    ~ListScheduler();                                               // Destructor
+
+    int schedule(IRInstruction *instructions, int count);           // Reorder run without barriers, return moved count
+};
+
+ListScheduler::ListScheduler(IRFunction &func) : func(func), region(nullptr), size(0) {
+    dependent = new bool[SCHEDULER_MAX_REGION * SCHEDULER_MAX_REGION];
+    flows = new bool[SCHEDULER_MAX_REGION * SCHEDULER_MAX_REGION];
+    height = new int[SCHEDULER_MAX_REGION];
+    start = new int[SCHEDULER_MAX_REGION];
+    order = new int[SCHEDULER_MAX_REGION];
+}
+
+ListScheduler::~ListScheduler() {
+    delete[] dependent;
+    delete[] flows;
+    delete[] height;
+    delete[] start;
+    delete[] order;
+}
+
+void ListScheduler::analyze() {
+    for (int i = 0; i < size; i++) {
+        IRInstruction &later = region[i];
+        for (int j = 0; j < i; j++) {
+            IRInstruction &earlier = region[j];
+            bool value = earlier.dst >= 0 && reads(func, later, earlier.dst);
+            bool overwrites = later.dst >= 0 && (later.dst == earlier.dst || reads(func, earlier, later.dst));
+
+            dependent[i * size + j] = value || overwrites;
+            flows[i * size + j] = value;
+        }
+    }
+
+    for (int i = size - 1; i >= 0; i--) { // Critical path decides which ready instruction goes first
+        height[i] = getLatency(region[i].opcode).latency;
+        for (int k = i + 1; k < size; k++) {
+            if (dependent[k * size + i] && height[k] + getLatency(region[i].opcode).latency > height[i])
+                height[i] = height[k] + getLatency(region[i].opcode).latency;
+        }
+    }
+}
+
+int ListScheduler::getReadyCycle(int instr) {
+    int ready = 0;
+    for (int j = 0; j < instr; j++) {
+        if (!dependent[instr * size + j])
+            continue;
+
+        if (start[j] < 0)
+            return -1;
+
+        int available = start[j] + (flows[instr * size + j] ? getLatency(region[j].opcode).latency : 0);
+        if (available > ready)
+            ready = available;
+    }
+
+    return ready;
+}
+
+int ListScheduler::schedule(IRInstruction *instructions, int count) {
+    region = instructions;
+    size = count;
+    analyze();
+
+    for (int i = 0; i < size; i++) {
+        start[i] = -1;
+    }
+
+    int busy[SCHEDULER_PORT_COUNT][SCHEDULER_MAX_UNITS] = {}; // Cycle every unit becomes free
+    int cycle = 0;
+    int issued = 0;
+    int inCycle = 0;
+    int next = 0; // First instruction of original order that is not issued
+
+    while (issued < size) {
+        // Keep original order while it does not stall, otherwise fill the gap with the most critical ready instruction
+        int best = -1;
+        int unit = -1;
+        for (int i = next; i < size; i++) {
+            if (start[i] >= 0)
+                continue;
+
+            int ready = getReadyCycle(i);
+            const IRLatency &latency = getLatency(region[i].opcode);
+            int free = -1;
+            for (int u = 0; u < SCHEDULER_PORT_UNITS[latency.port]; u++) {
+                if (busy[latency.port][u] <= cycle)
+                    free = u;
+            }
+
+            if (ready < 0 || ready > cycle || free < 0)
+                continue;
+
+            if (i == next || best < 0 || height[i] > height[best]) {
+                best = i;
+                unit = free;
+            }
+            if (i == next)
+                break;
+        }
+
+        if (best < 0 || inCycle == SCHEDULER_ISSUE_WIDTH) {
+            cycle++;
+            inCycle = 0;
+            continue;
+        }
+
+        const IRLatency &latency = getLatency(region[best].opcode);
+        busy[latency.port][unit] = cycle + latency.occupancy;
+        start[best] = cycle;
+        order[issued++] = best;
+        inCycle++;
+
+        while (next < size && start[next] >= 0)
+            next++;
+    }
+
+    int moved = 0;
+    auto *copy = new IRInstruction[size];
+    for (int i = 0; i < size; i++) {
+        copy[i] = region[i];
+    }
+    for (int i = 0; i < size; i++) {
+        region[i] = copy[order[i]];
+        if (order[i] != i)
+            moved++;
+    }
+
+    delete[] copy;
+    return moved;
+}
+
+int irScheduleInstructions(IRFunction &func, const CompilerOptions &options) {
+    if (!options.schedule)
+        return 0;
+
+    ListScheduler scheduler(func);
+    int moved = 0;
+
+    for (int b = 0; b < func.blocks.getSize(); b++) {
+        IRBlock *block = func.blocks[b];
+        int count = block->instructions.getSize();
+        auto *instructions = new IRInstruction[count + 1];
+        int kept = 0;
+        for (int j = 0; j < count; j++) { // Removed instructions are dropped on the way
+            if (block->instructions[j].opcode != IR_NOP)
+                instructions[kept++] = block->instructions[j];
+        }
+
+        int from = 0;
+        for (int j = 0; j <= kept; j++) {
+            if (j < kept && !isBarrier(instructions[j], options) && j - from < SCHEDULER_MAX_REGION)
+                continue;
+
+            if (j - from > 1)
+                moved += scheduler.schedule(instructions + from, j - from);
+            from = j < kept && isBarrier(instructions[j], options) ? j + 1 : j;
+        }
+
+        block->instructions.clear();
+        for (int j = 0; j < kept; j++) {
+            block->instructions.push_back(instructions[j]);
+        }
+        delete[] instructions;
+    }
+
+    return moved;
+}
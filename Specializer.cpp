@@ -0,0 +1,278 @@
+#include "Specializer.hpp"
+#include "utilities.hpp"
+
+IRSpecializer::IRSpecializer() : functions(nullptr), functionCount(0), capacity(0), entry(-1), nextNumber(0), sites(),
+                                 report() {}
+
+IROperand &IRSpecializer::getArgument(SpecializationSite &site, int argument) {
+    IRFunction &caller = functions[site.caller];
+    return caller.pool[caller.blocks[site.block]->instructions[site.index].poolStart + argument];
+}
+
+bool IRSpecializer::isPassThrough(int caller, int callee, IROperand op, int argument) {
+    if (caller != callee || op.isConstant)
+        return false;
+
+    IRInstruction *def = functions[caller].findDefinition(op.value);
+    return def && def->opcode == IR_ARG && def->a.value == argument;
+}
+
+bool IRSpecializer::matches(SpecializationSite &site, bool *fixed, int *values, int count) {
+    for (int k = 0; k < count; k++) {
+        int value;
+        if (fixed[k] && (!functions[site.caller].getConstant(getArgument(site, k), value) || value != values[k]))
+            return false;
+    }
+
+    return true;
+}
+
+int IRSpecializer::getWeight(SpecializationSite &site) {
+    int weight = 1;
+    for (int depth = functions[site.caller].blocks[site.block]->loopDepth; depth > 0 && weight < 512; depth--) {
+        weight *= SPECIALIZER_LOOP_WEIGHT;
+    }
+
+    return weight;
+}
+
+bool IRSpecializer::collectSites(int callee) {
+    sites.clear();
+
+    bool valid = true;
+    for (int i = 0; i < functionCount; i++) {
+        IRFunction &func = functions[i];
+        for (int b = 0; b < func.blocks.getSize(); b++) {
+            IRBlock *block = func.blocks[b];
+            for (int j = 0; j < block->instructions.getSize(); j++) {
+                IRInstruction &instr = block->instructions[j];
+                if (instr.opcode != IR_CALL || instr.a.value != functions[callee].number)
+                    continue;
+
+                if (instr.poolCount != functions[callee].argumentCount) // Parameters of such call are not ours to move
+                    valid = false;
+                sites.push_back({i, b, j});
+            }
+        }
+    }
+
+    return valid;
+}
+
+void IRSpecializer::bind(int function, int argument, int value) {
+    IRFunction &func = functions[function];
+    for (int b = 0; b < func.blocks.getSize(); b++) {
+        IRBlock *block = func.blocks[b];
+        for (int j = 0; j < block->instructions.getSize(); j++) {
+            IRInstruction &instr = block->instructions[j];
+            if (instr.opcode != IR_ARG)
+                continue;
+
+            if (instr.a.value == argument) {
+                instr = {IR_COPY, instr.dst, irConstant(value), irConstant(0), 0, 0};
+            } else if (instr.a.value > argument) {
+                instr.a.value--;
+            }
+        }
+    }
+
+    func.argumentCount--;
+}
+
+void IRSpecializer::dropArgument(SpecializationSite &site, int argument) {
+    IRFunction &caller = functions[site.caller];
+    IRInstruction &call = caller.blocks[site.block]->instructions[site.index];
+    for (int k = argument; k + 1 < call.poolCount; k++) {
+        caller.pool[call.poolStart + k] = caller.pool[call.poolStart + k + 1];
+    }
+
+    call.poolCount--;
+}
+
+int IRSpecializer::clone(int function) {
+    IRFunction &from = functions[function];
+    IRFunction &to = functions[functionCount];
+
+    for (int i = 0; i < from.blocks.getSize(); i++) {
+        IRBlock *source = from.blocks[i];
+        IRBlock *block = to.blocks[to.addBlock(source->loopDepth)];
+
+        for (int j = 0; j < source->instructions.getSize(); j++) {
+            block->instructions.push_back(source->instructions[j]);
+        }
+        for (int j = 0; j < source->predecessors.getSize(); j++) {
+            block->predecessors.push_back(source->predecessors[j]);
+        }
+
+        block->terminator = source->terminator;
+        block->condition = source->condition;
+        block->a = source->a;
+        block->b = source->b;
+        block->targets[0] = source->targets[0];
+        block->targets[1] = source->targets[1];
+    }
+
+    for (int i = 0; i < from.pool.getSize(); i++) {
+        to.pool.push_back(from.pool[i]);
+    }
+
+    to.registerCount = from.registerCount;
+    to.argumentCount = from.argumentCount;
+    to.number = nextNumber++;
+    to.name = from.name;
+
+    return functionCount++;
+}
+
+int IRSpecializer::propagate(int callee) {
+    if (!collectSites(callee) || !sites.getSize())
+        return 0;
+
+    int bound = 0;
+    for (int k = functions[callee].argumentCount - 1; k >= 0; k--) { // Lower parameters keep their numbers
+        bool known = false;
+        bool same = true;
+        int value = 0;
+
+        for (int i = 0; i < sites.getSize() && same; i++) {
+            int current;
+            IROperand op = getArgument(sites[i], k);
+            if (isPassThrough(sites[i].caller, callee, op, k)) // Recursion cannot change the value it got
+                continue;
+
+            same = functions[sites[i].caller].getConstant(op, current) && (!known || current == value);
+            known = true;
+            value = current;
+        }
+
+        if (!same || !known)
+            continue;
+
+        bind(callee, k, value);
+        for (int i = 0; i < sites.getSize(); i++) {
+            dropArgument(sites[i], k);
+        }
+        bound++;
+    }
+
+    if (bound)
+        report.push_back({functions[callee].name, functions[callee].number, bound, static_cast<int>(sites.getSize())});
+
+    return bound;
+}
+
+int IRSpecializer::specialize(int callee) {
+    int count = functions[callee].argumentCount;
+    if (functionCount == capacity || !count || functions[callee].countInstructions() > SPECIALIZER_MAX_SIZE ||
+        !collectSites(callee))
+        return 0;
+
+    auto *fixed = new bool[count];
+    auto *values = new int[count];
+    auto *bestFixed = new bool[count];
+    auto *bestValues = new int[count];
+    int bestWeight = 0;
+
+    for (int i = 0; i < sites.getSize(); i++) { // Constants of every call are a candidate pattern
+        bool any = false;
+        for (int k = 0; k < count; k++) {
+            fixed[k] = functions[sites[i].caller].getConstant(getArgument(sites[i], k), values[k]);
+            any = any || fixed[k];
+        }
+
+        int weight = 0;
+        for (int j = 0; any && j < sites.getSize(); j++) {
+            if (matches(sites[j], fixed, values, count))
+                weight += getWeight(sites[j]);
+        }
+
+        if (weight > bestWeight) {
+            bestWeight = weight;
+            for (int k = 0; k < count; k++) {
+                bestFixed[k] = fixed[k];
+                bestValues[k] = values[k];
+            }
+        }
+    }
+
+    int bound = 0;
+    if (bestWeight >= SPECIALIZER_MIN_WEIGHT) {
+        int copy = clone(callee);
+        for (int k = count - 1; k >= 0; k--) {
+            if (bestFixed[k]) {
+                bind(copy, k, bestValues[k]);
+                bound++;
+            }
+        }
+
+        // Recursive calls of the copy see bound parameters as constants and follow it as well
+        int calls = 0;
+        collectSites(callee);
+        for (int i = 0; i < sites.getSize(); i++) {
+            if (!matches(sites[i], bestFixed, bestValues, count))
+                continue;
+
+            for (int k = count - 1; k >= 0; k--) {
+                if (bestFixed[k])
+                    dropArgument(sites[i], k);
+            }
+            IRFunction &caller = functions[sites[i].caller];
+            caller.blocks[sites[i].block]->instructions[sites[i].index].a.value = functions[copy].number;
+            calls++;
+        }
+
+        report.push_back({functions[copy].name, functions[copy].number, bound, calls});
+    }
+
+    delete[] fixed;
+    delete[] values;
+    delete[] bestFixed;
+    delete[] bestValues;
+    return bound;
+}
+
+int IRSpecializer::run(IRFunction *functions, int count, int capacity, int entry, const CompilerOptions &options) {
+    if (!functions)
+        throw_exception("Invalid pointer to functions provided");
+
+    if (capacity < count)
+        throw_exception("No space left for specialized functions");
+
+    this->functions = functions;
+    functionCount = count;
+    this->capacity = capacity;
+    this->entry = entry;
+
+    nextNumber = 0;
+    for (int i = 0; i < count; i++) {
+        if (functions[i].number >= nextNumber)
+            nextNumber = functions[i].number + 1;
+    }
+
+    for (int round = 0; round < SPECIALIZER_MAX_ROUNDS; round++) {
+        int bound = 0;
+        for (int i = 0; i < functionCount; i++) { // Clones made in this round are visited as well
+            if (functions[i].number == entry)
+                continue;
+
+            bound += propagate(i);
+            bound += specialize(i);
+        }
+
+        if (!bound)
+            break;
+    }
+
+    return functionCount;
+}
+
+void IRSpecializer::dump(FILE *out) {
+    if (!out)
+        throw_exception("Invalid pointer to output file");
+
+    for (int i = 0; i < report.getSize(); i++) {
+        fprintf(out, "Specialize: %-16s listing %d, %d parameters bound, %d calls\n",
+                report[i].name ? report[i].name : "?", report[i].number, report[i].bound, report[i].calls);
+    }
+    fprintf(out, "Specialize: %d functions\n", static_cast<int>(report.getSize()));
+}
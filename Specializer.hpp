@@ -0,0 +1,60 @@
+#ifndef X86COMPILERBACKEND_SPECIALIZER_HPP
+#define X86COMPILERBACKEND_SPECIALIZER_HPP
+
+#include <cstdio>
+#include "IR.hpp"
+#include "Vector.hpp"
+#include "CompilerOptions.hpp"
+
+const int SPECIALIZER_MAX_CLONES = 16;                              // Specialized copies added to one program
+const int SPECIALIZER_MAX_SIZE = 400;                               // Larger functions are never copied
+const int SPECIALIZER_LOOP_WEIGHT = 8;                              // Expected iterations of one enclosing loop
+const int SPECIALIZER_MIN_WEIGHT = 2;                               // Pattern must be passed at least this often
+const int SPECIALIZER_MAX_ROUNDS = 4;                               // Bound parameters expose constants to the next round
+
+struct SpecializationSite {
+    int caller;                                                     // Function index of the caller
+    int block;                                                      // Block that contains CALL
+    int index;                                                      // Position of CALL in the block
+};
+
+struct SpecializedFunction {
+    const char *name;                                               // Function whose parameters were bound
+    int number;                                                     // Listing of the bound body, a clone has a new one
+    int bound;                                                      // Parameters replaced by constants
+    int calls;                                                      // Call sites that stopped passing them
+};
+
+class IRSpecializer {
+private:
+    IRFunction *functions;                                          // All functions of the program, clones included
+    int functionCount;                                              // Number of functions
+    int capacity;                                                   // Size of functions array
+    int entry;                                                      // Listing of main, its signature is fixed
+    int nextNumber;                                                 // Listing of the next clone
+    vector<SpecializationSite> sites;                               // Calls of the function being processed
+    vector<SpecializedFunction> report;                             // Functions bound so far
+
+    IROperand &getArgument(SpecializationSite &site, int argument); // Pooled operand of the call
+    bool isPassThrough(int caller, int callee, IROperand op, int argument); // Self call forwards its own parameter
+    bool matches(SpecializationSite &site, bool *fixed, int *values, int count); // Call passes every constant of pattern
+    int getWeight(SpecializationSite &site);                        // Expected number of executions of the call
+    bool collectSites(int callee);                                  // Fill sites, false if some call has wrong arity
+    void bind(int function, int argument, int value);               // Replace parameter with constant
+    void dropArgument(SpecializationSite &site, int argument);      // Stop passing bound parameter
+    int clone(int function);                                        // Copy function into a new listing, return its index
+    int propagate(int callee);                                      // Bind parameters that are constant at every call
+    int specialize(int callee);                                     // Clone function for its hottest constant pattern
+
+public:
+    IRSpecializer();                                                // Default constructor
+    IRSpecializer(const IRSpecializer &other) = delete;             // Prohibit copy constructor
+    IRSpecializer &operator=(const IRSpecializer &other) = delete;  // Prohibit copy assignment
+    ~IRSpecializer() = default;                                     // Destructor
+
+    int run(IRFunction *functions, int count, int capacity, int entry,
+            const CompilerOptions &options);                        // Bind constant arguments, return new function count
+    void dump(FILE *out);                                           // Print bound functions
+};
+
+#endif //X86COMPILERBACKEND_SPECIALIZER_HPP
@@ -0,0 +1,252 @@
+#include "IROptimizer.hpp"
+#include "SSA.hpp"
+#include "AssemblyTools.hpp"
+
+class InductionVariables {
+private:
+    IRFunction &func;                                               // Function in SSA form
+    DominatorTree dom;                                              // Finds back edges
+    int registerCount;                                              // Registers that existed before the pass
+    int *defBlock;                                                  // Block that defines register, -1 for none
+    int *defIndex;                                                  // Position of definition in its block
+    bool *inLoop;                                                   // Blocks of loop being processed
+    int *worklist;                                                  // Blocks to add to loop
+
+    bool findOffset(IROperand op, int phi, int &offset);            // Whether op is PHI plus constant offset
+    IROperand scale(int preheader, IROperand factor, int value);    // Invariant factor * value computed in preheader
+    bool isInvariant(IROperand op);                                 // Operand is defined outside of loop
+    void replaceUses(int reg, int with);                            // Rewrite every read of reg
+    int reduce(int header);                                         // Turn products with basic induction variables into sums
+
+public:
+    explicit InductionVariables(IRFunction &func);                  // Record definitions
+    InductionVariables(const InductionVariables &other) = delete;   // Prohibit copy constructor
+    InductionVariables &operator=(const InductionVariables &other) = delete; // Prohibit copy assignment
+    ~InductionVariables();                                          // Destructor
+
+    int run();                                                      // Process every loop, return reduced count
+};
+
+InductionVariables::InductionVariables(IRFunction &func) : func(func), dom(func), registerCount(func.registerCount) {
+    int blockCount = func.blocks.getSize();
+    defBlock = new int[registerCount];
+    defIndex = new int[registerCount];
+    inLoop = new bool[blockCount];
+    worklist = new int[blockCount];
+
+    for (int i = 0; i < registerCount; i++) {
+        defBlock[i] = -1;
+    }
+
+    for (int i = 0; i < blockCount; i++) {
+        IRBlock *block = func.blocks[i];
+        for (int j = 0; j < block->instructions.getSize(); j++) {
+            IRInstruction &instr = block->instructions[j];
+            if (instr.opcode != IR_NOP && instr.dst >= 0) {
+                defBlock[instr.dst] = i;
+                defIndex[instr.dst] = j;
+            }
+        }
+    }
+}
+
+InductionVariables::~InductionVariables() {
+    delete[] defBlock;
+    delete[] defIndex;
+    delete[] inLoop;
+    delete[] worklist;
+}
+
+bool InductionVariables::findOffset(IROperand op, int phi, int &offset) {
+    // Chain of constant increments leads to the PHI, unrolled loops have one per copied iteration
+    unsigned int total = 0;
+    for (int count = 0; count < registerCount; count++) {
+        if (irIsRegister(op, phi)) {
+            offset = static_cast<int>(total);
+            return true;
+        }
+
+        if (op.isConstant || op.value >= registerCount || defBlock[op.value] < 0)
+            return false;
+
+        IRInstruction &update = func.blocks[defBlock[op.value]]->instructions[defIndex[op.value]];
+        if (update.opcode == IR_ADD && update.b.isConstant) {
+            total += static_cast<unsigned int>(update.b.value);
+            op = update.a;
+        } else if (update.opcode == IR_ADD && update.a.isConstant) {
+            total += static_cast<unsigned int>(update.a.value);
+            op = update.b;
+        } else if (update.opcode == IR_SUB && update.b.isConstant) {
+            total -= static_cast<unsigned int>(update.b.value);
+            op = update.a;
+        } else {
+            return false;
+        }
+    }
+
+    return false;
+}
+
+IROperand InductionVariables::scale(int preheader, IROperand factor, int value) {
+    if (value == 0)
+        return irConstant(0);
+
+    if (value == 1)
+        return factor;
+
+    if (factor.isConstant)
+        return irConstant(static_cast<int>(static_cast<unsigned int>(value) * static_cast<unsigned int>(factor.value)));
+
+    return irRegister(func.emit(preheader, IR_MUL, factor, irConstant(value)));
+}
+
+bool InductionVariables::isInvariant(IROperand op) {
+    if (op.isConstant)
+        return true;
+
+    return op.value < registerCount && defBlock[op.value] >= 0 && !inLoop[defBlock[op.value]];
+}
+
+void InductionVariables::replaceUses(int reg, int with) {
+    for (int i = 0; i < func.blocks.getSize(); i++) {
+        IRBlock *block = func.blocks[i];
+        for (int j = 0; j < block->instructions.getSize(); j++) {
+            IRInstruction &instr = block->instructions[j];
+            for (int k = 0; instr.opcode != IR_NOP && k < func.getUseCount(instr); k++) {
+                IROperand &op = func.getUse(instr, k);
+                if (irIsRegister(op, reg))
+                    op.value = with;
+            }
+        }
+
+        for (int k = 0; k < func.getUseCount(block); k++) {
+            IROperand &op = func.getUse(block, k);
+            if (irIsRegister(op, reg))
+                op.value = with;
+        }
+    }
+}
+
+int InductionVariables::reduce(int header) {
+    if (!irFindLoop(func, dom, header, inLoop, worklist))
+        return 0;
+
+    int preheader = irFindPreheader(func, header, inLoop);
+    IRBlock *top = func.blocks[header];
+    if (preheader < 0 || top->predecessors.getSize() != 2)
+        return 0;
+
+    int entry = func.getPredecessorIndex(header, preheader);
+    int back = 1 - entry;
+    int latch = top->predecessors[back];
+    vector<IRInstruction> phis; // New induction variables, placed in front of the header at the end
+
+    int reduced = 0;
+    for (int p = 0; p < top->instructions.getSize(); p++) {
+        IRInstruction basic = top->instructions[p];
+        int step = 0;
+        if (basic.opcode != IR_PHI || !findOffset(func.pool[basic.poolStart + back], basic.dst, step))
+            continue;
+
+        IROperand init = func.pool[basic.poolStart + entry];
+        vector<IROperand> factors;                                  // Invariants basic variable is multiplied by
+        vector<int> derived;                                        // Variable equal to product with every factor
+
+        for (int i = 0; i < dom.order.getSize(); i++) {
+            int current = dom.order[i];
+            if (!inLoop[current])
+                continue;
+
+            IRBlock *block = func.blocks[current];
+            for (int j = 0; j < block->instructions.getSize(); j++) {
+                IRInstruction instr = block->instructions[j];
+                if (instr.opcode != IR_MUL)
+                    continue;
+
+                // (i + c) * k with invariant k, unless lowering gets the product cheaper than an extra register
+                int offset;
+                IROperand factor = instr.b;
+                if (!findOffset(instr.a, basic.dst, offset)) {
+                    factor = instr.a;
+                    if (!findOffset(instr.b, basic.dst, offset))
+                        continue;
+                }
+
+                if (!isInvariant(factor) || (factor.isConstant && isReducibleMultiplier(factor.value)))
+                    continue;
+
+                int variable = 0;
+                while (variable < factors.getSize() && (factors[variable].isConstant != factor.isConstant ||
+                                                       factors[variable].value != factor.value))
+                    variable++;
+
+                if (variable == factors.getSize()) { // j = init * k on entry, j += step * k on every iteration
+                    int start;
+                    IROperand first;
+                    if (init.isConstant && init.value == 0) {
+                        first = irConstant(0);
+                    } else if (init.isConstant && factor.isConstant &&
+                               irFold(IR_MUL, init.value, factor.value, start)) {
+                        first = irConstant(start);
+                    } else {
+                        first = irRegister(func.emit(preheader, IR_MUL, init, factor));
+                    }
+
+                    int reg = func.addRegister();
+                    int next = func.emit(latch, IR_ADD, irRegister(reg), scale(preheader, factor, step));
+                    int poolStart = func.addPool(2);
+                    func.pool[poolStart + entry] = first;
+                    func.pool[poolStart + back] = irRegister(next);
+                    phis.push_back({IR_PHI, reg, irConstant(0), irConstant(0), poolStart, 2});
+                    factors.push_back(factor);
+                    derived.push_back(reg);
+                }
+
+                if (offset == 0) {
+                    block->instructions[j].opcode = IR_NOP;
+                    replaceUses(instr.dst, derived[variable]);
+                } else {
+                    IROperand delta = scale(preheader, factor, offset);
+                    block->instructions[j] = {IR_ADD, instr.dst, irRegister(derived[variable]), delta, 0, 0};
+                }
+                reduced++;
+            }
+        }
+    }
+
+    if (reduced) {
+        int size = top->instructions.getSize();
+        auto *instructions = new IRInstruction[size];
+        for (int j = 0; j < size; j++) {
+            instructions[j] = top->instructions[j];
+        }
+
+        top->instructions.clear();
+        for (int j = 0; j < phis.getSize(); j++) {
+            top->instructions.push_back(phis[j]);
+        }
+        for (int j = 0; j < size; j++) {
+            top->instructions.push_back(instructions[j]);
+            if (instructions[j].opcode != IR_NOP && instructions[j].dst >= 0 && instructions[j].dst < registerCount)
+                defIndex[instructions[j].dst] = phis.getSize() + j;
+        }
+        delete[] instructions;
+    }
+
+    return reduced;
+}
+
+int InductionVariables::run() {
+    int reduced = 0;
+
+    for (int i = 0; i < dom.order.getSize(); i++) {
+        reduced += reduce(dom.order[i]);
+    }
+
+    return reduced;
+}
+
+int irReduceInductions(IRFunction &func, const CompilerOptions &options) {
+    InductionVariables variables(func);
+    return variables.run();
+}
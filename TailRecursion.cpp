@@ -0,0 +1,194 @@
+#include "IROptimizer.hpp"
+
+struct TailSite {
+    int call;                                                       // Index of self call in block, -1 if block is no site
+    int combine;                                                    // Index of ADD or MUL applied to call result, -1 if none
+};
+
+static bool isSelfCall(IRFunction &func, IRInstruction &instr) {
+    return instr.opcode == IR_CALL && instr.a.value == func.number && instr.poolCount == func.argumentCount;
+}
+
+// Whether instruction can run before the call it followed without anyone noticing
+static bool canMoveAboveCall(IRInstruction &instr) {
+    switch (instr.opcode) {
+        case IR_NOP:
+        case IR_COPY:
+        case IR_ADD:
+        case IR_SUB:
+        case IR_MUL:
+        case IR_SQRT:
+            return true;
+
+        case IR_DIV:
+            return instr.b.isConstant && instr.b.value != 0 && instr.b.value != -1;
+
+        default:
+            return false;
+    }
+}
+
+// Block that returns result of self call, either directly or combined with another value by ADD or MUL
+static TailSite findTailSite(IRFunction &func, IRBlock *block) {
+    TailSite none = {-1, -1};
+    if (block->terminator != IR_RETURN || block->a.isConstant)
+        return none;
+
+    int last = block->instructions.getSize() - 1;
+    while (last >= 0 && block->instructions[last].opcode == IR_NOP)
+        last--;
+
+    if (last < 0)
+        return none;
+
+    IRInstruction &result = block->instructions[last];
+    if (result.dst != block->a.value)
+        return none;
+
+    if (isSelfCall(func, result))
+        return {last, -1};
+
+    if (result.opcode != IR_ADD && result.opcode != IR_MUL)
+        return none;
+
+    for (int j = last - 1; j >= 0; j--) { // Linear recursion: value = x (+|*) f(...)
+        IRInstruction &instr = block->instructions[j];
+        if (isSelfCall(func, instr) && (irIsRegister(result.a, instr.dst) != irIsRegister(result.b, instr.dst))) {
+            for (int k = j + 1; k < last; k++) { // Call result must not be read or clobbered on the way
+                IRInstruction &between = block->instructions[k];
+                if (between.opcode == IR_NOP)
+                    continue;
+
+                if (between.dst == instr.dst)
+                    return none;
+
+                for (int u = 0; u < func.getUseCount(between); u++) {
+                    if (irIsRegister(func.getUse(between, u), instr.dst))
+                        return none;
+                }
+
+                for (int u = 0; u < instr.poolCount; u++) {
+                    if (irIsRegister(func.pool[instr.poolStart + u], between.dst))
+                        return none;
+                }
+            }
+            return {j, last};
+        }
+
+        if (!canMoveAboveCall(instr))
+            return none;
+    }
+
+    return none;
+}
+
+int irEliminateTailRecursion(IRFunction &func, const CompilerOptions &options) {
+    int blockCount = func.blocks.getSize();
+    auto *sites = new TailSite[blockCount];
+    IR_OPCODE combine = IR_NOP; // Operator of accumulating sites, they all have to agree
+    int count = 0;
+
+    for (int i = 0; i < blockCount; i++) {
+        sites[i] = findTailSite(func, func.blocks[i]);
+        if (sites[i].call < 0)
+            continue;
+
+        if (sites[i].combine >= 0) {
+            IR_OPCODE opcode = func.blocks[i]->instructions[sites[i].combine].opcode;
+            if (combine != IR_NOP && combine != opcode) {
+                sites[i] = {-1, -1};
+                continue;
+            }
+            combine = opcode;
+        }
+        count++;
+    }
+
+    if (!count) {
+        delete[] sites;
+        return 0;
+    }
+
+    // Entry keeps reading arguments, locals are reset at the top of every iteration
+    IRBlock *entry = func.blocks[0];
+    int header = func.addBlock(0);
+    int *parameters = new int[func.argumentCount + 1];
+    int entrySize = entry->instructions.getSize();
+    auto *instructions = new IRInstruction[entrySize];
+    for (int j = 0; j < entrySize; j++) {
+        instructions[j] = entry->instructions[j];
+    }
+
+    entry->instructions.clear();
+    for (int j = 0; j < entrySize; j++) {
+        if (instructions[j].opcode == IR_ARG) {
+            parameters[instructions[j].a.value] = instructions[j].dst;
+            entry->instructions.push_back(instructions[j]);
+        } else {
+            func.blocks[header]->instructions.push_back(instructions[j]);
+        }
+    }
+    delete[] instructions;
+
+    func.jump(header, entry->targets[0]);
+    func.jump(0, header);
+
+    for (int i = 1; i < func.blocks.getSize(); i++) { // Whole body is now inside the loop
+        func.blocks[i]->loopDepth++;
+    }
+
+    // f(...) = x op f(...') becomes acc = acc op x and a jump, every other return yields acc op value
+    int accumulator = -1;
+    if (combine != IR_NOP) {
+        accumulator = func.addRegister();
+        func.emit(0, IR_COPY, accumulator, irConstant(combine == IR_ADD ? 0 : 1), irConstant(0));
+
+        for (int i = 0; i < blockCount; i++) {
+            IRBlock *block = func.blocks[i];
+            if (sites[i].call < 0 && block->terminator == IR_RETURN)
+                func.ret(i, irRegister(func.emit(i, combine, irRegister(accumulator), block->a)));
+        }
+    }
+
+    for (int i = 0; i < blockCount; i++) {
+        if (sites[i].call < 0)
+            continue;
+
+        IRBlock *block = func.blocks[i];
+        int size = block->instructions.getSize();
+        auto *body = new IRInstruction[size];
+        for (int j = 0; j < size; j++) {
+            body[j] = block->instructions[j];
+        }
+
+        IRInstruction call = body[sites[i].call];
+        int *values = new int[call.poolCount + 1];
+        block->instructions.clear();
+
+        for (int j = 0; j < size; j++) {
+            if (j == sites[i].call) { // Arguments are saved before any parameter changes
+                for (int k = 0; k < call.poolCount; k++) {
+                    values[k] = func.emit(i, IR_COPY, func.pool[call.poolStart + k], irConstant(0));
+                }
+            } else if (j == sites[i].combine) {
+                IRInstruction &instr = body[j];
+                IROperand other = irIsRegister(instr.a, call.dst) ? instr.b : instr.a;
+                func.emit(i, instr.opcode, accumulator, irRegister(accumulator), other);
+            } else {
+                block->instructions.push_back(body[j]);
+            }
+        }
+
+        for (int k = 0; k < call.poolCount; k++) {
+            func.emit(i, IR_COPY, parameters[k], irRegister(values[k]), irConstant(0));
+        }
+        func.jump(i, header);
+
+        delete[] values;
+        delete[] body;
+    }
+
+    delete[] parameters;
+    delete[] sites;
+    return count;
+}
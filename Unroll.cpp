@@ -0,0 +1,365 @@
+#include <climits>
+#include "IROptimizer.hpp"
+#include "SSA.hpp"
+
+const int UNROLL_MAX_TRIPS = 8;                                     // Loops running at most this many times are unrolled completely
+const int UNROLL_MAX_SIZE = 256;                                    // Limit of loop instructions after unrolling
+
+struct CountedLoop {
+    int header;                                                     // Entry of the loop
+    int latch;                                                      // Only block that branches back to header
+    int preheader;                                                  // Only block that enters the loop
+    int exit;                                                       // Block the latch leaves the loop to
+    int first;                                                      // First block of the loop in member list
+    int count;                                                      // Number of blocks in the loop
+    int counter;                                                    // Register changed by constant step once per iteration
+    int step;                                                       // Value added to counter on every iteration
+    IR_CONDITION condition;                                         // Loop goes on while counter condition bound holds
+    IROperand bound;                                                // Loop invariant operand counter is compared to
+    int trips;                                                      // Number of iterations, -1 if unknown
+};
+
+class LoopUnroller {
+private:
+    IRFunction &func;                                               // Function without PHI instructions
+    const CompilerOptions &options;                                 // Unroll factor
+    vector<CountedLoop> loops;                                      // Loops chosen for unrolling
+    vector<int> members;                                            // Blocks of chosen loops grouped by loop
+
+    void analyze(DominatorTree &dom, int header, bool *inLoop, int *worklist); // Choose innermost counted loop
+    bool findCounter(CountedLoop &loop, DominatorTree &dom, const bool *inLoop, int reg); // Recognize counter update
+    bool findConstant(int reg, int block, int &value);              // Constant reg holds when block ends, if provable
+    int getTripCount(CountedLoop &loop);                            // Iterations of loop, -1 if unknown or too many
+    void clone(CountedLoop &loop, int *map);                        // Copy loop blocks, map them to their copies
+    int addCheck(CountedLoop &loop, int depth, int ahead, int onTrue, int onFalse); // Whether ahead more iterations run
+    void unrollFully(CountedLoop &loop);                            // Straight-line copy for every iteration
+    void unrollPartially(CountedLoop &loop, int factor);            // Copies with one exit test, original for remainder
+
+public:
+    LoopUnroller(IRFunction &func, const CompilerOptions &options); // Unroller for function
+    LoopUnroller(const LoopUnroller &other) = delete;               // Prohibit copy constructor
+    LoopUnroller &operator=(const LoopUnroller &other) = delete;    // Prohibit copy assignment
+
+    int run();                                                      // Unroll chosen loops, return their number
+};
+
+LoopUnroller::LoopUnroller(IRFunction &func, const CompilerOptions &options) : func(func), options(options) {}
+
+bool LoopUnroller::findCounter(CountedLoop &loop, DominatorTree &dom, const bool *inLoop, int reg) {
+    int defs = 0;
+    IRInstruction update = {};
+    int updateBlock = -1;
+
+    for (int i = 0; i < func.blocks.getSize(); i++) {
+        if (!inLoop[i])
+            continue;
+
+        IRBlock *block = func.blocks[i];
+        for (int j = 0; j < block->instructions.getSize(); j++) {
+            IRInstruction &instr = block->instructions[j];
+            if (instr.opcode != IR_NOP && instr.dst == reg) {
+                defs++;
+                update = instr;
+                updateBlock = i;
+            }
+        }
+    }
+
+    // Exactly one counter = counter +- c on a path every iteration takes
+    if (defs != 1 || !dom.dominates(updateBlock, loop.latch))
+        return false;
+
+    if (update.opcode == IR_ADD && irIsRegister(update.a, reg) && update.b.isConstant) {
+        loop.step = update.b.value;
+    } else if (update.opcode == IR_ADD && irIsRegister(update.b, reg) && update.a.isConstant) {
+        loop.step = update.a.value;
+    } else if (update.opcode == IR_SUB && irIsRegister(update.a, reg) && update.b.isConstant &&
+               update.b.value != INT_MIN) {
+        loop.step = -update.b.value;
+    } else {
+        return false;
+    }
+
+    loop.counter = reg;
+    return loop.step != 0;
+}
+
+bool LoopUnroller::findConstant(int reg, int block, int &value) {
+    for (int steps = 0; steps < func.blocks.getSize(); steps++) {
+        IRBlock *current = func.blocks[block];
+        for (int j = current->instructions.getSize() - 1; j >= 0; j--) {
+            IRInstruction &instr = current->instructions[j];
+            if (instr.opcode == IR_NOP || instr.dst != reg)
+                continue;
+
+            value = instr.a.value;
+            return instr.opcode == IR_COPY && instr.a.isConstant;
+        }
+
+        if (current->predecessors.getSize() != 1) // Definitions merge here
+            return false;
+        block = current->predecessors[0];
+    }
+
+    return false;
+}
+
+int LoopUnroller::getTripCount(CountedLoop &loop) {
+    int counter, bound;
+    if (!findConstant(loop.counter, loop.preheader, counter))
+        return -1;
+
+    if (loop.bound.isConstant) {
+        bound = loop.bound.value;
+    } else if (!findConstant(loop.bound.value, loop.preheader, bound)) {
+        return -1;
+    }
+
+    // Preheader is only reached when the first iteration runs, the latch tests updated counter
+    int trips = 1;
+    while (true) {
+        counter = static_cast<int>(static_cast<unsigned int>(counter) + static_cast<unsigned int>(loop.step));
+        if (!irEvaluate(loop.condition, counter, bound))
+            return trips;
+
+        if (++trips > UNROLL_MAX_TRIPS)
+            return -1;
+    }
+}
+
+void LoopUnroller::analyze(DominatorTree &dom, int header, bool *inLoop, int *worklist) {
+    if (!irFindLoop(func, dom, header, inLoop, worklist))
+        return;
+
+    CountedLoop loop = {};
+    loop.header = header;
+    loop.latch = -1;
+    int size = 0;
+
+    for (int i = 0; i < func.blocks.getSize(); i++) {
+        if (!inLoop[i])
+            continue;
+
+        IRBlock *block = func.blocks[i];
+        for (int j = 0; j < block->predecessors.getSize(); j++) {
+            int predecessor = block->predecessors[j];
+            if (!inLoop[predecessor] || !dom.dominates(i, predecessor))
+                continue;
+
+            if (i != header || loop.latch >= 0) // Inner loop or second back edge
+                return;
+            loop.latch = predecessor;
+        }
+        size += block->instructions.getSize() + 1;
+    }
+
+    loop.preheader = irFindPreheader(func, header, inLoop);
+    IRBlock *latch = func.blocks[loop.latch];
+    if (loop.preheader < 0 || latch->terminator != IR_BRANCH)
+        return;
+
+    bool backOnTrue = latch->targets[0] == header;
+    loop.exit = latch->targets[backOnTrue ? 1 : 0];
+    if (inLoop[loop.exit])
+        return;
+
+    loop.condition = backOnTrue ? latch->condition : irNegate(latch->condition);
+    if (!latch->a.isConstant && findCounter(loop, dom, inLoop, latch->a.value)) {
+        loop.bound = latch->b;
+    } else if (!latch->b.isConstant && findCounter(loop, dom, inLoop, latch->b.value)) {
+        loop.condition = irMirror(loop.condition);
+        loop.bound = latch->a;
+    } else {
+        return;
+    }
+
+    if (!loop.bound.isConstant) {
+        if (loop.bound.value == loop.counter)
+            return;
+
+        for (int i = 0; i < func.blocks.getSize(); i++) {
+            IRBlock *block = func.blocks[i];
+            for (int j = 0; inLoop[i] && j < block->instructions.getSize(); j++) {
+                IRInstruction &instr = block->instructions[j];
+                if (instr.opcode != IR_NOP && instr.dst == loop.bound.value)
+                    return;
+            }
+        }
+    }
+
+    loop.trips = getTripCount(loop);
+    if (loop.trips < 0 || loop.trips * size > UNROLL_MAX_SIZE) {
+        loop.trips = -1;
+
+        // Partial unrolling tests only the last copied iteration, so counter has to move towards the bound
+        bool monotonic = loop.step > 0 ? loop.condition == IR_LT || loop.condition == IR_LE
+                                       : loop.condition == IR_GT || loop.condition == IR_GE;
+        long long ahead = static_cast<long long>(options.unrollFactor - 1) * loop.step;
+        if (options.unrollFactor < 2 || (options.unrollFactor + 1) * size > UNROLL_MAX_SIZE || !monotonic ||
+            ahead > INT_MAX / 2 || ahead < INT_MIN / 2)
+            return;
+    }
+
+    loop.first = members.getSize();
+    loop.count = 0;
+    for (int i = 0; i < func.blocks.getSize(); i++) {
+        if (inLoop[i]) {
+            members.push_back(i);
+            loop.count++;
+        }
+    }
+    loops.push_back(loop);
+}
+
+void LoopUnroller::clone(CountedLoop &loop, int *map) {
+    for (int i = 0; i < loop.count; i++) {
+        int block = members[loop.first + i];
+        map[block] = func.addBlock(func.blocks[block]->loopDepth);
+    }
+
+    for (int i = 0; i < loop.count; i++) {
+        IRBlock *from = func.blocks[members[loop.first + i]];
+        int to = map[members[loop.first + i]];
+
+        for (int j = 0; j < from->instructions.getSize(); j++) {
+            IRInstruction instr = from->instructions[j];
+            if (instr.opcode == IR_NOP)
+                continue;
+
+            if (instr.opcode == IR_CALL || instr.opcode == IR_SELECT) { // Every instruction owns its pooled operands
+                int poolStart = func.addPool(instr.poolCount);
+                for (int k = 0; k < instr.poolCount; k++) {
+                    func.pool[poolStart + k] = func.pool[instr.poolStart + k];
+                }
+                instr.poolStart = poolStart;
+            }
+            func.blocks[to]->instructions.push_back(instr);
+        }
+
+        int onTrue = from->targets[0] >= 0 && map[from->targets[0]] >= 0 ? map[from->targets[0]] : from->targets[0];
+        int onFalse = from->targets[1] >= 0 && map[from->targets[1]] >= 0 ? map[from->targets[1]] : from->targets[1];
+        switch (from->terminator) {
+            case IR_JUMP:
+                func.jump(to, onTrue);
+                break;
+
+            case IR_BRANCH:
+                func.branch(to, from->condition, from->a, from->b, onTrue, onFalse);
+                break;
+
+            case IR_RETURN:
+                func.ret(to, from->a);
+                break;
+        }
+    }
+}
+
+int LoopUnroller::addCheck(CountedLoop &loop, int depth, int ahead, int onTrue, int onFalse) {
+    // Counter must not wrap around on the way, then condition for the last iteration implies the ones before
+    int limit = loop.step > 0 ? INT_MAX - ahead : INT_MIN - ahead;
+    int check = func.addBlock(depth);
+    int test = func.addBlock(depth);
+
+    func.branch(check, loop.step > 0 ? IR_LE : IR_GE, irRegister(loop.counter), irConstant(limit), test, onFalse);
+    int last = func.emit(test, IR_ADD, irRegister(loop.counter), irConstant(ahead));
+    func.branch(test, loop.condition, irRegister(last), loop.bound, onTrue, onFalse);
+    return check;
+}
+
+void LoopUnroller::unrollFully(CountedLoop &loop) {
+    int blockCount = func.blocks.getSize();
+    int *map = new int[blockCount];
+    int previous = loop.latch;
+
+    for (int k = 1; k < loop.trips; k++) {
+        for (int i = 0; i < blockCount; i++) {
+            map[i] = -1;
+        }
+        clone(loop, map);
+        func.jump(previous, map[loop.header]);
+        previous = map[loop.latch];
+    }
+    func.jump(previous, loop.exit);
+
+    for (int i = 0; i < loop.count; i++) {
+        func.blocks[members[loop.first + i]]->loopDepth--;
+    }
+    for (int i = blockCount; i < func.blocks.getSize(); i++) {
+        func.blocks[i]->loopDepth--;
+    }
+
+    delete[] map;
+}
+
+void LoopUnroller::unrollPartially(CountedLoop &loop, int factor) {
+    int blockCount = func.blocks.getSize();
+    int *map = new int[blockCount];
+    int top = -1;
+    int previous = -1;
+
+    for (int k = 0; k < factor; k++) { // Copies run back to back, the original loop finishes what is left
+        for (int i = 0; i < blockCount; i++) {
+            map[i] = -1;
+        }
+        clone(loop, map);
+
+        if (previous >= 0) {
+            func.jump(previous, map[loop.header]);
+        } else {
+            top = map[loop.header];
+        }
+        previous = map[loop.latch];
+    }
+
+    int ahead = (factor - 1) * loop.step;
+    int depth = func.blocks[loop.header]->loopDepth;
+    int outer = func.blocks[loop.preheader]->loopDepth;
+
+    // Both loops get a preheader of their own, so later passes still find them
+    int enter = func.addBlock(outer);
+    int remainder = func.addBlock(outer);
+    func.jump(enter, top);
+    func.jump(remainder, loop.header);
+
+    // First iteration is certain on entry, after a round the original latch test decides
+    int rest = func.addBlock(outer);
+    func.branch(rest, loop.condition, irRegister(loop.counter), loop.bound, remainder, loop.exit);
+    func.jump(loop.preheader, addCheck(loop, outer, ahead, enter, remainder));
+    func.jump(previous, addCheck(loop, depth, ahead, top, rest));
+
+    delete[] map;
+}
+
+int LoopUnroller::run() {
+    func.computePredecessors();
+    DominatorTree dom(func);
+    int blockCount = func.blocks.getSize();
+    bool *inLoop = new bool[blockCount];
+    int *worklist = new int[blockCount];
+
+    for (int i = 0; i < dom.order.getSize(); i++) {
+        analyze(dom, dom.order[i], inLoop, worklist);
+    }
+
+    delete[] inLoop;
+    delete[] worklist;
+
+    // Innermost loops share no blocks, so unrolling one keeps others intact
+    for (int i = 0; i < loops.getSize(); i++) {
+        if (loops[i].trips > 0) {
+            unrollFully(loops[i]);
+        } else {
+            unrollPartially(loops[i], options.unrollFactor);
+        }
+    }
+
+    if (loops.getSize() > 0)
+        func.computePredecessors();
+
+    return static_cast<int>(loops.getSize());
+}
+
+int irUnrollLoops(IRFunction &func, const CompilerOptions &options) {
+    LoopUnroller unroller(func, options);
+    return unroller.run();
+}
@@ -27,6 +27,7 @@ public:
     void reserve(size_t newSize);                               // Vector resize
     void push_back(T&& elem);                                   // Append rvalue to back
     void push_back(const T& elem);                              // Append lvalue to back
+    void clear();                                               // Drop all elements, keep memory
 
     size_t getSize();
     T* data();
@@ -48,6 +49,8 @@ vector<T>::vector(vector<T> &&other) : size(other.size), capacity(other.capacity
 
 template<typename T>
 vector<T>& vector<T>::operator=(vector<T> &&other) {
+    delete[] elems;
+
     size = other.size;
     capacity = other.capacity;
     elems = other.elems;
@@ -102,6 +105,11 @@ void vector<T>::push_back(const T& elem) {
     size++;
 }
 
+template<typename T>
+void vector<T>::clear() {
+    size = 0;
+}
+
 template<typename T>
 vector<T>::~vector() {
     delete[] elems;
@@ -5,16 +5,26 @@
 #include "utilities.hpp"
 #include "AbstractSyntaxTree.hpp"
 #include "AssemblyTools.hpp"
+#include "Peephole.hpp"
+#include "IROptimizer.hpp"
+#include "Inliner.hpp"
+#include "Evaluator.hpp"
+#include "Specializer.hpp"
+#include "Memoizer.hpp"
+#include "CompilerOptions.hpp"
 
 
-void parseArgs(int argc, char *argv[], bool &toNasm, char *&input, char *&output);
+void parseArgs(int argc, char *argv[], bool &toNasm, bool &statistics, CompilerOptions &options,
+               const char *&input, const char *&output);
 
 int main(const int argc, char *argv[]) {
     const char *input = nullptr;
     const char *output = nullptr;
     bool toNasm = false;
+    bool statistics = false;
+    CompilerOptions options;
 
-    parseArgs(argc, argv, toNasm, input, output);
+    parseArgs(argc, argv, toNasm, statistics, options, input, output);
 
     if(!input) {
         printf("\nInput file is not specified\n");
@@ -28,7 +38,39 @@ int main(const int argc, char *argv[]) {
     AbstractSyntaxTree prog;
     prog.load(input);
 
-    AssemblyProgram compiled = prog.compile(); // Compile program
+    if(options.optimize) {
+        SimplificationStats stats = prog.simplify(); // Fold constants before code generation
+
+        if(statistics) {
+            printf("Simplification: %d folded, %d identities, %d reassociated, %d nodes removed\n",
+                   stats.folded, stats.identities, stats.reassociated, stats.nodesRemoved);
+        }
+    }
+
+    IREvaluator evaluator;
+    IRSpecializer specializer;
+    IRInliner inliner;
+    IROptimizer irOptimizer;
+    IRMemoizer memoizer;
+    AssemblyProgram compiled = prog.compile(options, evaluator, specializer, inliner, irOptimizer,
+                                            memoizer); // Compile program
+
+    if(options.optimize && statistics) {
+        evaluator.dump(stdout);
+        specializer.dump(stdout);
+        inliner.dump(stdout);
+        irOptimizer.dump(stdout);
+        memoizer.dump(stdout);
+    }
+
+    if(options.optimize) {
+        PeepholeOptimizer peephole;
+        compiled.optimize(peephole); // Clean up listings before offsets are placed
+
+        if(statistics) {
+            peephole.dump(stdout);
+        }
+    }
 
     if(toNasm) {
         compiled.toNASM(output);
@@ -39,9 +81,10 @@ int main(const int argc, char *argv[]) {
     return 0;
 }
 
-void parseArgs(const int argc, char *argv[], bool &toNasm, const char *&input, const char *&output) {
+void parseArgs(const int argc, char *argv[], bool &toNasm, bool &statistics, CompilerOptions &options,
+               const char *&input, const char *&output) {
     int res = 0;
-    while ((res = getopt(argc, argv, "i:o:n")) != -1) {
+    while ((res = getopt(argc, argv, "i:o:nOsxt:u:fmld")) != -1) {
         switch (res) {
             case 'i':
                 input = optarg;
@@ -55,6 +98,42 @@ void parseArgs(const int argc, char *argv[], bool &toNasm, const char *&input, c
                 toNasm = true;
                 break;
 
+            case 'O':
+                options.optimize = true;
+                break;
+
+            case 's':
+                statistics = true;
+                break;
+
+            case 'x':
+                options.sse2 = false;
+                break;
+
+            case 't':
+                options.inlineThreshold = atoi(optarg);
+                break;
+
+            case 'u':
+                options.unrollFactor = atoi(optarg);
+                break;
+
+            case 'f':
+                options.omitFramePointer = true;
+                break;
+
+            case 'm':
+                options.memoize = true;
+                break;
+
+            case 'l':
+                options.schedule = true;
+                break;
+
+            case 'd':
+                options.dumpIR = true;
+                break;
+
             case '?':
                 printf("\nInvalid argument: %c\n", res);
                 exit(0);